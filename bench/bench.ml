@@ -0,0 +1,365 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(* Benchmarks of Luv's hot paths. Run all of them with
+
+     make bench
+
+   or some of them with
+
+     dune exec bench/bench.exe -- tcp_echo timer_churn
+
+   Each benchmark uses fixed sizes and iteration counts, and runs on the
+   default loop over loopback or a temporary file. Each result is printed on
+   stdout as one JSON object per line, for example:
+
+     {"benchmark":"tcp_echo","metric":"throughput","value":812.345,"unit":"MB/s"}
+
+   The first line describes the environment instead. Compare results only
+   between runs on the same machine. *)
+
+let get step = function
+  | Ok value -> value
+  | Error error ->
+    Printf.eprintf "%s: %s\n" step (Luv.Error.strerror error);
+    exit 1
+
+let now () =
+  Unsigned.UInt64.to_int (Luv.Time.hrtime ())
+
+let seconds nanoseconds =
+  float_of_int nanoseconds /. 1e9
+
+let report benchmark metric unit value =
+  Printf.printf
+    "{\"benchmark\":\"%s\",\"metric\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}\n%!"
+    benchmark metric value unit
+
+let report_percentiles benchmark samples =
+  let samples = Array.of_list samples in
+  Array.sort compare samples;
+  let percentile fraction =
+    let index =
+      min
+        (Array.length samples - 1)
+        (int_of_float (fraction *. float_of_int (Array.length samples)))
+    in
+    float_of_int samples.(index) /. 1000.
+  in
+  report benchmark "latency_p50" "us" (percentile 0.5);
+  report benchmark "latency_p99" "us" (percentile 0.99);
+  report benchmark "latency_max" "us" (percentile 1.)
+
+let run_loop () =
+  ignore (Luv.Loop.run () : bool)
+
+let loopback () =
+  Luv.Sockaddr.ipv4 "127.0.0.1" 0 |> get "ipv4"
+
+(* Starts a TCP server on an ephemeral loopback port, which calls on_data with
+   each buffer it reads. Returns the server and its address. *)
+let tcp_server on_data =
+  let server = Luv.TCP.init () |> get "TCP.init" in
+  Luv.TCP.bind server (loopback ()) |> get "TCP.bind";
+  Luv.Stream.listen server begin fun result ->
+    get "listen" result;
+    let client = Luv.TCP.init () |> get "TCP.init" in
+    Luv.Stream.accept ~server ~client |> get "accept";
+    Luv.TCP.nodelay client true |> get "nodelay";
+    Luv.Stream.read_start client (function
+      | Error `EOF -> Luv.Handle.close client ignore
+      | Error error -> get "read" (Error error)
+      | Ok buffer -> on_data client buffer)
+  end;
+  server, Luv.TCP.getsockname server |> get "getsockname"
+
+let tcp_client address connected =
+  let client = Luv.TCP.init () |> get "TCP.init" in
+  Luv.TCP.connect client address begin fun result ->
+    get "connect" result;
+    Luv.TCP.nodelay client true |> get "nodelay";
+    connected client
+  end
+
+let echo client buffer =
+  Luv.Stream.write client [buffer] (fun result _ -> get "echo" result)
+
+
+
+let tcp_echo () =
+  let chunk_size = 65536 in
+  let total = 256 * chunk_size in
+  let chunk = Luv.Buffer.create chunk_size in
+  Luv.Buffer.fill chunk 'a';
+
+  let server, address = tcp_server echo in
+  tcp_client address begin fun client ->
+    let start = now () in
+    let received = ref 0 in
+    let rec write_next sent =
+      if sent < total then
+        Luv.Stream.write client [chunk] (fun result _ ->
+          get "write" result;
+          write_next (sent + chunk_size))
+    in
+    write_next 0;
+    Luv.Stream.read_start client (function
+      | Error error -> get "read" (Error error)
+      | Ok buffer ->
+        received := !received + Luv.Buffer.size buffer;
+        if !received >= total then begin
+          let elapsed = now () - start in
+          report "tcp_echo" "throughput" "MB/s"
+            (float_of_int total /. 1e6 /. seconds elapsed);
+          Luv.Handle.close client ignore;
+          Luv.Handle.close server ignore
+        end)
+  end;
+  run_loop ();
+
+  let message_size = 64 in
+  let round_trips = 10000 in
+  let message = Luv.Buffer.create message_size in
+  Luv.Buffer.fill message 'b';
+
+  let server, address = tcp_server echo in
+  tcp_client address begin fun client ->
+    let samples = ref [] in
+    let completed = ref 0 in
+    let received = ref 0 in
+    let sent_at = ref 0 in
+    let send () =
+      sent_at := now ();
+      Luv.Stream.write client [message] (fun result _ -> get "write" result)
+    in
+    Luv.Stream.read_start client (function
+      | Error error -> get "read" (Error error)
+      | Ok buffer ->
+        received := !received + Luv.Buffer.size buffer;
+        if !received >= message_size then begin
+          received := !received - message_size;
+          samples := (now () - !sent_at)::!samples;
+          incr completed;
+          if !completed < round_trips then
+            send ()
+          else begin
+            report_percentiles "tcp_echo" !samples;
+            Luv.Handle.close client ignore;
+            Luv.Handle.close server ignore
+          end
+        end);
+    send ()
+  end;
+  run_loop ()
+
+let udp_pps () =
+  let datagrams = 200000 in
+  let window = 64 in
+  let datagram = Luv.Buffer.create 64 in
+  Luv.Buffer.fill datagram 'c';
+
+  let receiver = Luv.UDP.init () |> get "UDP.init" in
+  Luv.UDP.bind receiver (loopback ()) |> get "UDP.bind";
+  let address = Luv.UDP.getsockname receiver |> get "getsockname" in
+  let sender = Luv.UDP.init () |> get "UDP.init" in
+
+  let start = now () in
+  let received = ref 0 in
+  let last_received = ref start in
+  Luv.UDP.recv_start receiver (function
+    | Error error -> get "recv" (Error error)
+    | Ok (_, None, _) -> ()
+    | Ok _ ->
+      incr received;
+      last_received := now ());
+
+  (* Datagrams dropped by the kernel never arrive, so the receiver is given a
+     grace period after the last send completes. *)
+  let finish () =
+    let timer = Luv.Timer.init () |> get "Timer.init" in
+    Luv.Timer.start timer 200 begin fun () ->
+      report "udp" "received_pps" "datagrams/s"
+        (float_of_int !received /. seconds (!last_received - start));
+      report "udp" "loss" "%"
+        (100. *. float_of_int (datagrams - !received) /.
+          float_of_int datagrams);
+      Luv.Handle.close timer ignore;
+      Luv.Handle.close sender ignore;
+      Luv.Handle.close receiver ignore
+    end
+    |> get "Timer.start"
+  in
+
+  let sent = ref 0 in
+  let completed = ref 0 in
+  let rec send () =
+    if !sent < datagrams then begin
+      incr sent;
+      Luv.UDP.send sender [datagram] address begin fun result ->
+        get "send" result;
+        incr completed;
+        if !completed = datagrams then
+          finish ()
+        else
+          send ()
+      end
+    end
+  in
+  for _ = 1 to window do
+    send ()
+  done;
+  run_loop ()
+
+let stream_write () =
+  let writes = 200000 in
+  let window = 1024 in
+  let message = Luv.Buffer.create 16 in
+  Luv.Buffer.fill message 'd';
+
+  let server, address = tcp_server (fun _ _ -> ()) in
+  tcp_client address begin fun client ->
+    let start = now () in
+    let issued = ref 0 in
+    let completed = ref 0 in
+    let rec write () =
+      if !issued < writes then begin
+        incr issued;
+        Luv.Stream.write client [message] begin fun result _ ->
+          get "write" result;
+          incr completed;
+          if !completed = writes then begin
+            report "stream_write" "small_writes" "writes/s"
+              (float_of_int writes /. seconds (now () - start));
+            Luv.Handle.close client ignore;
+            Luv.Handle.close server ignore
+          end
+          else
+            write ()
+        end
+      end
+    in
+    for _ = 1 to window do
+      write ()
+    done
+  end;
+  run_loop ()
+
+let file () =
+  let chunk_size = 1024 * 1024 in
+  let chunks = 64 in
+  let path =
+    Filename.concat (Filename.get_temp_dir_name ())
+      (Printf.sprintf "luv_bench_%i.tmp" (Luv.Pid.getpid ()))
+  in
+  let buffer = Luv.Buffer.create chunk_size in
+  Luv.Buffer.fill buffer 'e';
+  let megabytes = float_of_int (chunks * chunk_size) /. 1e6 in
+
+  let rec transfer ~writing file index callback =
+    if index = chunks then
+      callback ()
+    else
+      let operation = if writing then Luv.File.write else Luv.File.read in
+      let file_offset = Int64.of_int (index * chunk_size) in
+      operation ~file_offset file [buffer] begin fun result ->
+        ignore (get "transfer" result);
+        transfer ~writing file (index + 1) callback
+      end
+  in
+
+  Luv.File.open_ path [`CREAT; `TRUNC; `RDWR] ~mode:[`NUMERIC 0o644]
+      begin fun result ->
+    let file = get "open" result in
+    let start = now () in
+    transfer ~writing:true file 0 begin fun () ->
+      report "file" "write_throughput" "MB/s"
+        (megabytes /. seconds (now () - start));
+      let start = now () in
+      transfer ~writing:false file 0 begin fun () ->
+        report "file" "read_throughput" "MB/s"
+          (megabytes /. seconds (now () - start));
+        Luv.File.close file begin fun result ->
+          get "close" result;
+          Luv.File.unlink path (fun result -> get "unlink" result)
+        end
+      end
+    end
+  end;
+  run_loop ()
+
+let thread_pool () =
+  let jobs = 100000 in
+  let window = 256 in
+  let start = now () in
+  let issued = ref 0 in
+  let completed = ref 0 in
+  let rec queue () =
+    if !issued < jobs then begin
+      incr issued;
+      Luv.Thread_pool.queue_work ignore begin fun result ->
+        get "queue_work" result;
+        incr completed;
+        if !completed = jobs then
+          report "thread_pool" "queue_work_overhead" "ns/job"
+            (float_of_int (now () - start) /. float_of_int jobs)
+        else
+          queue ()
+      end
+    end
+  in
+  for _ = 1 to window do
+    queue ()
+  done;
+  run_loop ()
+
+let timer_churn () =
+  let timers = 100000 in
+  let churn ?pool metric =
+    let start = now () in
+    for _ = 1 to timers do
+      let timer = Luv.Timer.init ?object_pool:pool () |> get "Timer.init" in
+      Luv.Timer.start timer 1000 ignore |> get "Timer.start";
+      Luv.Timer.stop timer |> get "Timer.stop";
+      Luv.Handle.close timer ignore;
+      (* Closed timers return to the pool only once the loop runs their close
+         callbacks. The loop is run the same way without a pool, so that both
+         variants do the same work. *)
+      ignore (Luv.Loop.run ~mode:`NOWAIT () : bool)
+    done;
+    run_loop ();
+    report "timer_churn" metric "timers/s"
+      (float_of_int timers /. seconds (now () - start))
+  in
+  churn "start_stop_close";
+  churn ~pool:(Luv.Object_pool.create ()) "start_stop_close_pooled"
+
+
+
+let benchmarks = [
+  "tcp_echo", tcp_echo;
+  "udp", udp_pps;
+  "stream_write", stream_write;
+  "file", file;
+  "thread_pool", thread_pool;
+  "timer_churn", timer_churn;
+]
+
+let () =
+  let selected =
+    match List.tl (Array.to_list Sys.argv) with
+    | [] -> List.map fst benchmarks
+    | names -> names
+  in
+  selected |> List.iter (fun name ->
+    if not (List.mem_assoc name benchmarks) then begin
+      Printf.eprintf "Unknown benchmark: %s\n" name;
+      exit 2
+    end);
+
+  Printf.printf
+    "{\"libuv\":\"%s\",\"ocaml\":\"%s\",\"os\":\"%s\",\"word_size\":%i}\n%!"
+    (Luv.Version.string ()) Sys.ocaml_version Sys.os_type Sys.word_size;
+
+  selected |> List.iter (fun name -> (List.assoc name benchmarks) ())
@@ -226,3 +226,154 @@ struct
 end
 
 include Async
+
+(* Each entry is keyed by the arguments of getaddrinfo. An entry is pending
+   while a lookup for it is in flight, whether it is the first lookup, or a
+   refresh of an expired or prefetched entry. Callers that need a fresh result
+   while an entry is pending are added to its waiters, and all of them are
+   called when the one lookup completes. A failed prefetch does not replace a
+   result that is still valid. Entries dropped from the table while pending
+   still deliver their result to their waiters. *)
+module Cache =
+struct
+  type key =
+    Sockaddr.Address_family.t option *
+    Sockaddr.Socket_type.t option *
+    int option *
+    Addr_info.Flag.t list option *
+    string option *
+    string option
+
+  type entry = {
+    mutable resolved : (Addr_info.t list, Error.t) result option;
+    mutable expires : int;
+    mutable pending : bool;
+    mutable waiters : ((Addr_info.t list, Error.t) result -> unit) list;
+  }
+
+  type t = {
+    loop : Loop.t;
+    capacity : int;
+    ttl : int;
+    negative_ttl : int;
+    prefetch : int;
+    entries : (key, entry) Hashtbl.t;
+  }
+
+  let create
+      ?loop
+      ?(capacity = 1024)
+      ?(ttl = 60_000)
+      ?(negative_ttl = 5_000)
+      ?(prefetch = 0)
+      () =
+
+    {
+      loop = Loop.or_default loop;
+      capacity = max 1 capacity;
+      ttl = max 0 ttl;
+      negative_ttl = max 0 negative_ttl;
+      prefetch = max 0 prefetch;
+      entries = Hashtbl.create 64;
+    }
+
+  let now cache =
+    Unsigned.UInt64.to_int (Loop.now cache.loop)
+
+  let resolve cache key entry =
+    let (family, socktype, protocol, flags, node, service) = key in
+    entry.pending <- true;
+    getaddrinfo
+        ~loop:cache.loop ?family ?socktype ?protocol ?flags ?node ?service ()
+        begin fun result ->
+
+      entry.pending <- false;
+      begin match result, entry.resolved, entry.waiters with
+      | Error _, Some (Ok _), [] ->
+        ()
+      | Ok _, _, _ ->
+        entry.resolved <- Some result;
+        entry.expires <- now cache + cache.ttl
+      | Error _, _, _ ->
+        entry.resolved <- Some result;
+        entry.expires <- now cache + cache.negative_ttl
+      end;
+      let waiters = List.rev entry.waiters in
+      entry.waiters <- [];
+      List.iter (fun waiter -> waiter result) waiters
+    end
+
+  (* Called before adding an entry to a full cache. Drops expired entries, and,
+     if that is not enough, the entry closest to expiring. Pending entries are
+     never dropped. *)
+  let make_room cache now =
+    if Hashtbl.length cache.entries >= cache.capacity then begin
+      cache.entries |> Hashtbl.filter_map_inplace (fun _ entry ->
+        if not entry.pending && entry.expires <= now then None
+        else Some entry);
+
+      if Hashtbl.length cache.entries >= cache.capacity then begin
+        let oldest = ref None in
+        cache.entries |> Hashtbl.iter begin fun key entry ->
+          if not entry.pending then
+            match !oldest with
+            | Some (_, expires) when expires <= entry.expires -> ()
+            | _ -> oldest := Some (key, entry.expires)
+        end;
+        match !oldest with
+        | Some (key, _) -> Hashtbl.remove cache.entries key
+        | None -> ()
+      end
+    end
+
+  let getaddrinfo
+      cache ?family ?socktype ?protocol ?flags ?node ?service () callback =
+
+    let callback = Error.catch_exceptions callback in
+    let flags =
+      match flags with
+      | None -> None
+      | Some flags -> Some (List.sort_uniq compare flags)
+    in
+    let key = (family, socktype, protocol, flags, node, service) in
+    let now = now cache in
+
+    match Hashtbl.find cache.entries key with
+    | exception Not_found ->
+      make_room cache now;
+      let entry =
+        {resolved = None; expires = now; pending = false; waiters = [callback]}
+      in
+      Hashtbl.replace cache.entries key entry;
+      resolve cache key entry
+
+    | entry ->
+      match entry.resolved with
+      | Some result when now < entry.expires ->
+        begin match result with
+        | Ok _ when
+            cache.prefetch > 0 &&
+            not entry.pending &&
+            entry.expires - now <= cache.prefetch ->
+          resolve cache key entry
+        | _ ->
+          ()
+        end;
+        callback result
+
+      | _ ->
+        entry.waiters <- callback::entry.waiters;
+        if not entry.pending then
+          resolve cache key entry
+
+  let invalidate cache node =
+    cache.entries |> Hashtbl.filter_map_inplace (fun key entry ->
+      let (_, _, _, _, node', _) = key in
+      if node' = Some node then None else Some entry)
+
+  let clear cache =
+    Hashtbl.reset cache.entries
+
+  let size cache =
+    Hashtbl.length cache.entries
+end
@@ -108,3 +108,93 @@ val getnameinfo :
     [uv_getnameinfo]}. See
     {{:http://man7.org/linux/man-pages/man3/getnameinfo.3.html}
     [getnameinfo(3)]}. *)
+
+(** In-process cache in front of {!Luv.DNS.getaddrinfo}.
+
+    Each call to {!Luv.DNS.getaddrinfo} occupies a thread of the libuv thread
+    pool for the duration of a system resolver lookup. A program that resolves
+    the same names over and over can instead look them up through a cache:
+
+    {[
+      let cache = Luv.DNS.Cache.create () in
+
+      Luv.DNS.Cache.getaddrinfo cache ~node:"example.com" ~service:"443" ()
+          begin fun result ->
+        ...
+      end
+    ]}
+
+    Results are cached per combination of arguments. Concurrent lookups that
+    miss the cache are coalesced: only one call to {!Luv.DNS.getaddrinfo} is
+    made, and its result is passed to all of them. Failures are cached, too,
+    for a shorter time.
+
+    [getaddrinfo(3)] does not report the TTLs of the DNS records it is based
+    on, so cached results instead expire after fixed times given to
+    {!Luv.DNS.Cache.create}.
+
+    A cache is bound to one loop, and must be used only from the thread running
+    that loop. *)
+module Cache :
+sig
+  type t
+  (** Resolver caches. *)
+
+  val create :
+    ?loop:Loop.t ->
+    ?capacity:int ->
+    ?ttl:int ->
+    ?negative_ttl:int ->
+    ?prefetch:int ->
+    unit ->
+      t
+  (** Creates an empty cache, which performs lookups on [?loop].
+
+      [?capacity] is the largest number of entries the cache holds. When it is
+      full, expired entries are dropped, and, if there are none, the entry
+      closest to expiring. The default is 1024.
+
+      [?ttl] is how long successful results are kept, in milliseconds. The
+      default is 60000.
+
+      [?negative_ttl] is how long errors are kept, in milliseconds. The default
+      is 5000. Pass [0] to disable negative caching.
+
+      If [?prefetch] is positive, a lookup that hits an entry with at most
+      [?prefetch] milliseconds left before it expires is answered from the
+      cache, and also starts a refresh of the entry in the background, so that
+      frequently used names do not expire. If the refresh fails, the entry
+      keeps its current result until it expires. The default is [0], which
+      disables prefetching. *)
+
+  val getaddrinfo :
+    t ->
+    ?family:Sockaddr.Address_family.t ->
+    ?socktype:Sockaddr.Socket_type.t ->
+    ?protocol:int ->
+    ?flags:Addr_info.Flag.t list ->
+    ?node:string ->
+    ?service:string ->
+    unit ->
+    ((Addr_info.t list, Error.t) result -> unit) ->
+      unit
+  (** Like {!Luv.DNS.getaddrinfo}, but answers from the cache when possible.
+
+      On a hit, the callback is called immediately, before this function
+      returns. Otherwise, it is called once the lookup completes, from the
+      loop.
+
+      All callers that hit the same entry receive the same, physically equal,
+      list. *)
+
+  val invalidate : t -> string -> unit
+  (** Drops all entries for the given node. Lookups already in flight still
+      complete, but their results are not cached. *)
+
+  val clear : t -> unit
+  (** Drops all entries. *)
+
+  val size : t -> int
+  (** Number of entries in the cache, including ones that have expired but not
+      yet been dropped, and ones whose first lookup is in flight. *)
+end
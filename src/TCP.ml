@@ -5,8 +5,8 @@
 
 type t = [ `TCP ] Stream.t
 
-let init ?loop ?domain () =
-  let tcp = Stream.allocate C.Types.TCP.t in
+let init ?loop ?domain ?object_pool () =
+  let tcp = Stream.allocate ?object_pool C.Types.TCP.t in
   let loop = Loop.or_default loop in
   let result =
     match domain with
@@ -62,11 +62,66 @@ let simultaneous_accepts tcp enable =
   C.Functions.TCP.simultaneous_accepts tcp enable
   |> Error.to_result ()
 
-let bind ?(ipv6only = false) tcp address =
-  let flags = if ipv6only then C.Types.TCP.ipv6only else 0 in
+let bind ?(ipv6only = false) ?(reuseport = false) tcp address =
+  let flags =
+    let accumulate = Helpers.Bit_field.accumulate in
+    0
+    |> accumulate C.Types.TCP.ipv6only ipv6only
+    |> accumulate C.Types.TCP.reuseport reuseport
+  in
   C.Functions.TCP.bind tcp (Sockaddr.as_sockaddr address) flags
   |> Error.to_result ()
 
+(* The client handles passed to the C side are bare structs, which are retained
+   only once they are delivered, so that the ones still unused when the server
+   is closed are simply collected. Each delivered handle is replaced by a fresh
+   struct, so that the C side always has a full batch of handles to accept
+   into. *)
+let listen_batch ?(backlog = Stream.somaxconn) ?(max_connections = 64)
+    server callback =
+
+  let bare_client () = Ctypes.addr (Ctypes.make C.Types.TCP.t) in
+  let capacity = max 1 max_connections in
+  let clients = Array.init capacity (fun _ -> bare_client ()) in
+  let pointers = Ctypes.CArray.make (Ctypes.ptr C.Types.TCP.t) capacity in
+  let statuses = Ctypes.CArray.make Ctypes.int capacity in
+  Array.iteri (Ctypes.CArray.set pointers) clients;
+
+  let wrapped_callback = Error.catch_exceptions callback in
+  Handle.set_reference
+      ~index:C.Types.Stream.connection_callback_index server
+      begin fun error_code count ->
+    let accepted = ref [] in
+    for index = count - 1 downto 0 do
+      let client = clients.(index) in
+      Stream.retain client;
+      let replacement = bare_client () in
+      clients.(index) <- replacement;
+      Ctypes.CArray.set pointers index replacement;
+      if Ctypes.CArray.get statuses index < 0 then
+        Handle.close client ignore
+      else
+        accepted := client::!accepted
+    done;
+    begin match !accepted with
+    | [] -> ()
+    | accepted -> wrapped_callback (Ok accepted)
+    end;
+    if error_code < 0 then
+      wrapped_callback (Error.result_from_c error_code)
+  end;
+
+  let immediate_result =
+    C.Functions.TCP.listen_batch
+      server
+      backlog
+      (Ctypes.CArray.start pointers)
+      (Ctypes.CArray.start statuses)
+      (Unsigned.Size_t.of_int capacity)
+  in
+  if immediate_result < 0 then
+    callback (Error.result_from_c immediate_result)
+
 let getsockname =
   Sockaddr.wrap_c_getter C.Functions.TCP.getsockname
 
@@ -74,7 +129,7 @@ let getpeername =
   Sockaddr.wrap_c_getter C.Functions.TCP.getpeername
 
 let connect tcp address callback =
-  let request = Stream.Connect_request.make () in
+  let request = Stream.Connect_request.make ?object_pool:(Handle.pool tcp) () in
   let wrapped_callback result =
     Error.catch_exceptions callback (Error.to_result () result)
   in
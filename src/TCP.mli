@@ -21,7 +21,10 @@ type t = [ `TCP ] Stream.t
     {!Luv.Stream.read_start}, {!Luv.Stream.write}. *)
 
 val init :
-  ?loop:Loop.t -> ?domain:Sockaddr.Address_family.t -> unit ->
+  ?loop:Loop.t ->
+  ?domain:Sockaddr.Address_family.t ->
+  ?object_pool:Object_pool.t ->
+  unit ->
     (t, Error.t) result
 (** Allocates and initializes a TCP stream.
 
@@ -31,6 +34,10 @@ val init :
     The stream is not yet connected or listening. See {!Luv.TCP.bind},
     {!Luv.Stream.listen}, and {!Luv.TCP.connect}.
 
+    If [?object_pool] is given, the stream is taken from it, and returned to it
+    when closed. Its write, connect, and shutdown requests are also taken from
+    the pool. See {!Luv.Object_pool}.
+
     On libuv prior to 1.7.0, using [?domain] causes this function to return
     [Error `ENOSYS] ("Function not implemented").
 
@@ -91,12 +98,47 @@ val simultaneous_accepts : t -> bool -> (unit, Error.t) result
     {{:http://docs.libuv.org/en/v1.x/tcp.html#c.uv_tcp_simultaneous_accepts}
     [uv_tcp_simultaneous_accepts]}. *)
 
-val bind : ?ipv6only:bool -> t -> Sockaddr.t -> (unit, Error.t) result
+val bind :
+  ?ipv6only:bool -> ?reuseport:bool -> t -> Sockaddr.t ->
+    (unit, Error.t) result
 (** Assigns an address to the given TCP socket.
 
     Binds {{:http://docs.libuv.org/en/v1.x/tcp.html#c.uv_tcp_bind}
     [uv_tcp_bind]}. See {{:http://man7.org/linux/man-pages/man3/bind.3p.html}
-    [bind(3p)]}. *)
+    [bind(3p)]}.
+
+    [~reuseport:true] sets [SO_REUSEPORT], so that several sockets, typically
+    each on its own loop, can listen on the same address. The kernel then
+    spreads incoming connections between them. See {!Luv.Sharded_server}.
+    Fails with [`ENOTSUP] on systems on which [SO_REUSEPORT] does not balance
+    connections. With libuv older than 1.49.0, it is supported only on
+    Linux. *)
+
+val listen_batch :
+  ?backlog:int ->
+  ?max_connections:int ->
+  t ->
+  ((t list, Error.t) result -> unit) ->
+    unit
+(** Like {!Luv.Stream.listen}, but accepts incoming connections itself, and
+    calls its callback once per batch of accepted connections, rather than once
+    per connection.
+
+    When libuv reports a new connection, Luv accepts it in C, and then drains
+    the rest of the listener's accept queue with [accept(2)], up to
+    [?max_connections] connections in total, which defaults to 64. Each
+    connection is accepted into one of a set of client handles preallocated
+    when this function is called, so there are no calls into OCaml until the
+    batch is passed to the callback. Handles passed to the callback are
+    replaced right after that. On Windows, each connection is passed as a batch
+    of one.
+
+    The handles passed to the callback are ready to use, as if by
+    {!Luv.Stream.accept}, and should eventually be closed with
+    {!Luv.Handle.close}. Connections that could not be accepted are closed
+    without being passed to the callback.
+
+    The default value of [?backlog] is [SOMAXCONN]. *)
 
 val getsockname : t -> (Sockaddr.t, Error.t) result
 (** Retrieves the address assigned to the given TCP socket.
@@ -7,10 +7,10 @@ type t = [ `UDP ] Handle.t
 
 module Membership = C.Types.UDP.Membership
 
-let init ?loop ?(domain = `UNSPEC) ?(recvmmsg = false) () =
+let init ?loop ?(domain = `UNSPEC) ?(recvmmsg = false) ?object_pool () =
   let udp =
     Handle.allocate
-      C.Types.UDP.t ~reference_count:C.Types.UDP.reference_count
+      ?pool:object_pool C.Types.UDP.t ~reference_count:C.Types.UDP.reference_count
   in
   let loop = Loop.or_default loop in
   let domain = Sockaddr.Address_family.to_c domain in
@@ -81,7 +81,8 @@ let send_general udp buffers address callback =
   let count = List.length buffers in
   let iovecs = Helpers.Buf.bigstrings_to_iovecs buffers count in
 
-  let request = Request.allocate C.Types.UDP.Send_request.t in
+  let request =
+    Request.allocate ?pool:(Handle.pool udp) C.Types.UDP.Send_request.t in
 
   Request.set_callback request begin fun result ->
     let module Sys = Compatibility.Sys in
@@ -129,6 +130,87 @@ let try_send_general udp buffers address =
 let try_send udp buffers address =
   try_send_general udp buffers (Sockaddr.as_sockaddr address)
 
+let try_send_batch_general udp datagrams =
+  let count = List.length datagrams in
+  if count = 0 then
+    Ok 0
+  else begin
+    let buffers = List.concat (List.map fst datagrams) in
+    let iovecs =
+      Helpers.Buf.bigstrings_to_iovecs buffers (List.length buffers) in
+    let buffer_counts =
+      datagrams
+      |> List.map (fun (buffers, _) ->
+        Unsigned.UInt.of_int (List.length buffers))
+      |> Ctypes.CArray.of_list Ctypes.uint
+    in
+    let addresses =
+      Ctypes.CArray.of_list
+        (Ctypes.ptr C.Types.Sockaddr.t) (List.map snd datagrams)
+    in
+
+    let result =
+      C.Functions.UDP.try_send_batch
+        udp
+        (Unsigned.UInt.of_int count)
+        (Ctypes.CArray.start iovecs)
+        (Ctypes.CArray.start buffer_counts)
+        (Ctypes.CArray.start addresses)
+    in
+
+    let module Sys = Compatibility.Sys in
+    ignore (Sys.opaque_identity datagrams);
+    ignore (Sys.opaque_identity iovecs);
+
+    if result < 0 then
+      Error.result_from_c result
+    else
+      Ok result
+  end
+
+let send_batch_general udp datagrams callback =
+  let sent =
+    match try_send_batch_general udp datagrams with
+    | Ok sent -> sent
+    | Error _ -> 0
+  in
+  let rec drop count datagrams =
+    match datagrams with
+    | _::rest when count > 0 -> drop (count - 1) rest
+    | _ -> datagrams
+  in
+
+  match drop sent datagrams with
+  | [] ->
+    callback (Ok ())
+  | remaining ->
+    let pending = ref (List.length remaining) in
+    let first_error = ref None in
+    remaining |> List.iter begin fun (buffers, address) ->
+      send_general udp buffers address begin fun result ->
+        begin match result, !first_error with
+        | Error _, None -> first_error := Some result
+        | _ -> ()
+        end;
+        decr pending;
+        if !pending = 0 then
+          match !first_error with
+          | None -> callback (Ok ())
+          | Some error -> callback error
+      end
+    end
+
+let with_c_addresses datagrams =
+  List.map
+    (fun (buffers, address) -> buffers, Sockaddr.as_sockaddr address)
+    datagrams
+
+let send_batch udp datagrams callback =
+  send_batch_general udp (with_c_addresses datagrams) callback
+
+let try_send_batch udp datagrams =
+  try_send_batch_general udp (with_c_addresses datagrams)
+
 module Recv_flag =
 struct
   type t = [
@@ -144,15 +226,29 @@ let alloc_trampoline =
 let recv_trampoline =
   C.Functions.UDP.get_recv_trampoline ()
 
-let recv_start ?(allocate = Buffer.create) udp callback =
+let empty_buffer =
+  Buffer.create 0
+
+let recv_start ?(allocate = Buffer.create) ?pool udp callback =
+  let allocate, discard, pooled =
+    match pool with
+    | None -> allocate, ignore, false
+    | Some pool -> Buffer_pool.allocate pool, Buffer_pool.release pool, true
+  in
+
   let last_allocated_buffer = ref None in
 
   Handle.set_reference udp begin fun nread_or_error sockaddr flags ->
     let maybe_buffer = !last_allocated_buffer in
     last_allocated_buffer := None;
 
-    if nread_or_error < 0 then
+    if nread_or_error < 0 then begin
+      begin match maybe_buffer with
+      | Some buffer -> discard buffer
+      | None -> ()
+      end;
       callback (Error.result_from_c nread_or_error)
+    end
 
     else begin
       let length = nread_or_error in
@@ -162,7 +258,11 @@ let recv_start ?(allocate = Buffer.create) udp callback =
         | None -> assert false
       in
       let buffer =
-        if Buffer.size buffer <= length then
+        if pooled && sockaddr = Nativeint.zero then begin
+          discard buffer;
+          empty_buffer
+        end
+        else if Buffer.size buffer <= length then
           buffer
         else
           Buffer.sub buffer ~offset:0 ~length
@@ -213,6 +313,83 @@ let recv_stop udp =
 let using_recvmmsg =
   C.Functions.UDP.using_recvmmsg
 
+module Batch =
+struct
+  type t = {
+    buffer : Buffer.t;
+    info : (int32, Bigarray.int32_elt, Bigarray.c_layout) Bigarray.Array1.t;
+    peers : Buffer.t;
+    count : int;
+  }
+
+  let count batch =
+    batch.count
+
+  let buffer batch =
+    batch.buffer
+
+  let field batch index field =
+    if index < 0 || index >= batch.count then
+      invalid_arg "Luv.UDP.Batch: index out of bounds";
+    let index = index * C.Types.UDP.Batch.info_fields + field in
+    Int32.to_int (Bigarray.Array1.unsafe_get batch.info index)
+
+  let offset batch index =
+    field batch index C.Types.UDP.Batch.offset
+
+  let length batch index =
+    field batch index C.Types.UDP.Batch.length
+
+  let partial batch index =
+    field batch index C.Types.UDP.Batch.partial <> 0
+
+  let datagram batch index =
+    Buffer.sub
+      batch.buffer ~offset:(offset batch index) ~length:(length batch index)
+
+  let peer batch index =
+    if index < 0 || index >= batch.count then
+      invalid_arg "Luv.UDP.Batch.peer: index out of bounds";
+    let open Ctypes in
+    let size = sizeof C.Types.Sockaddr.storage in
+    bigarray_start array1 batch.peers +@ (index * size)
+    |> to_voidp
+    |> from_voidp C.Types.Sockaddr.storage
+    |> Sockaddr.copy_storage
+
+  let peers batch =
+    batch.peers
+end
+
+let recv_batch_start ?(max_datagrams = 20) udp callback =
+  let capacity = if using_recvmmsg udp then max 1 max_datagrams else 1 in
+  let buffer = Buffer.create (capacity * C.Types.UDP.Batch.datagram_size) in
+  let info =
+    Bigarray.(Array1.create Int32 C_layout)
+      (capacity * C.Types.UDP.Batch.info_fields)
+  in
+  let peers =
+    Buffer.create (capacity * Ctypes.sizeof C.Types.Sockaddr.storage) in
+
+  let wrapped_callback = Error.catch_exceptions callback in
+  Handle.set_reference udp begin fun error_code count ->
+    if error_code < 0 then
+      wrapped_callback (Error.result_from_c error_code)
+    else
+      wrapped_callback (Ok {Batch.buffer; info; peers; count})
+  end;
+
+  let immediate_result =
+    C.Functions.UDP.recv_batch_start
+      udp
+      Ctypes.(bigarray_start array1 buffer)
+      (Unsigned.Size_t.of_int capacity)
+      Ctypes.(bigarray_start array1 info)
+      Ctypes.(bigarray_start array1 peers)
+  in
+  if immediate_result < 0 then
+    callback (Error.result_from_c immediate_result)
+
 let get_send_queue_size udp =
   C.Functions.UDP.get_send_queue_size udp
   |> Unsigned.Size_t.to_int
@@ -238,4 +415,13 @@ struct
 
   let try_send udp buffers =
     try_send_general udp buffers Sockaddr.null
+
+  let without_addresses datagrams =
+    List.map (fun buffers -> buffers, Sockaddr.null) datagrams
+
+  let send_batch udp datagrams callback =
+    send_batch_general udp (without_addresses datagrams) callback
+
+  let try_send_batch udp datagrams =
+    try_send_batch_general udp (without_addresses datagrams)
 end
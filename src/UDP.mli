@@ -17,7 +17,11 @@ type t = [ `UDP ] Handle.t
     {!Luv.Handle.close}. *)
 
 val init :
-  ?loop:Loop.t -> ?domain:Sockaddr.Address_family.t -> ?recvmmsg:bool -> unit ->
+  ?loop:Loop.t ->
+  ?domain:Sockaddr.Address_family.t ->
+  ?recvmmsg:bool ->
+  ?object_pool:Object_pool.t ->
+  unit ->
     (t, Error.t) result
 (** Allocates and initializes a UDP socket.
 
@@ -30,6 +34,10 @@ val init :
     [?recvmmsg] is requires Luv 0.5.2 and libuv 1.37.0. Passing it with earlier
     libuv has no effect.
 
+    If [?object_pool] is given, the socket is taken from it, and returned to it
+    when closed. Its send requests are also taken from the pool. See
+    {!Luv.Object_pool}.
+
     {{!Luv.Require} Feature checks}:
 
     - [Luv.Require.(has udp_init_ex)]
@@ -144,6 +152,39 @@ val try_send : t -> Buffer.t list -> Sockaddr.t -> (unit, Error.t) result
 
     For connected UDP sockets, see {!Luv.UDP.Connected.try_send}. *)
 
+val send_batch :
+  t ->
+  (Buffer.t list * Sockaddr.t) list ->
+  ((unit, Error.t) result -> unit) ->
+    unit
+(** Sends many datagrams, each to its own address.
+
+    As many datagrams as possible are first sent immediately, as by
+    {!Luv.UDP.try_send_batch}. The rest are queued with
+    {{:http://docs.libuv.org/en/v1.x/udp.html#c.uv_udp_send} [uv_udp_send]}.
+
+    The callback is called once, after all datagrams have been sent, with the
+    first error that occurred, if any. If all datagrams are sent immediately,
+    the callback is called before [Luv.UDP.send_batch] returns.
+
+    For connected UDP sockets, see {!Luv.UDP.Connected.send_batch}. *)
+
+val try_send_batch :
+  t -> (Buffer.t list * Sockaddr.t) list -> (int, Error.t) result
+(** Like {!Luv.UDP.try_send}, but for many datagrams.
+
+    On Linux, the datagrams are sent with as few calls to
+    {{:https://man7.org/linux/man-pages/man2/sendmmsg.2.html} [sendmmsg(2)]} as
+    possible, typically one. Elsewhere, this is equivalent to calling
+    {!Luv.UDP.try_send} in a loop.
+
+    Evaluates to [Ok n], where [n] is the number of datagrams, from the start of
+    the list, that were sent. Sending stops at the first datagram that can't be
+    sent immediately. If not even the first datagram could be sent, evaluates to
+    the error, for example [Error `EAGAIN].
+
+    For connected UDP sockets, see {!Luv.UDP.Connected.try_send_batch}. *)
+
 (** Binds {{:http://docs.libuv.org/en/v1.x/udp.html#c.uv_udp_flags}
     [uv_udp_flags]}. *)
 module Recv_flag :
@@ -165,6 +206,7 @@ end
 
 val recv_start :
   ?allocate:(int -> Buffer.t) ->
+  ?pool:Buffer_pool.t ->
   t ->
   ((Buffer.t * Sockaddr.t option * Recv_flag.t list, Error.t) result -> unit) ->
     unit
@@ -177,7 +219,12 @@ val recv_start :
     [recv(3p)]}.
 
     The behavior is similar to {!Luv.Stream.read_start}. See that function for
-    the meaning of the [?allocate] callback.
+    the meaning of the [?allocate] callback and of [?pool].
+
+    When [?pool] is given, the buffer passed with sender address [None] is an
+    empty buffer that does not belong to the pool, and should not be released.
+    Buffers passed with [Some peer] should be released with
+    {!Luv.Buffer_pool.release}.
 
     The main callback takes a [Sockaddr.t option]. This is usually [Some
     sender_address], carrying the address of the peer. [None] usually indicates
@@ -226,6 +273,66 @@ val using_recvmmsg : t -> bool
 
     {{!Luv.Require} Feature check}: [Luv.Require.(has udp_using_recvmmsg)] *)
 
+(** Batches of received datagrams, for {!Luv.UDP.recv_batch_start}.
+
+    A batch holds all the datagrams received by one
+    {{:https://www.man7.org/linux/man-pages/man2/recvmmsg.2.html}
+    [recvmmsg(2)]} call. The datagrams are stored in slots of a single buffer,
+    which is reused for each batch. A batch, and all buffers obtained from it,
+    are valid only until the callback it was passed to returns. *)
+module Batch :
+sig
+  type t
+  (** Received datagrams. *)
+
+  val count : t -> int
+  (** Number of datagrams in the batch. *)
+
+  val buffer : t -> Buffer.t
+  (** The whole receive buffer. Datagram [i] occupies [length batch i] bytes
+      starting at [offset batch i]. *)
+
+  val offset : t -> int -> int
+  (** Offset of datagram [i] in {!Luv.UDP.Batch.buffer}. *)
+
+  val length : t -> int -> int
+  (** Length of datagram [i]. *)
+
+  val partial : t -> int -> bool
+  (** Whether datagram [i] was truncated, because it did not fit in its slot.
+      See [`PARTIAL] in {!Luv.UDP.recv_start}. *)
+
+  val datagram : t -> int -> Buffer.t
+  (** A {{!Luv.Buffer.sub} view} into {!Luv.UDP.Batch.buffer}, holding datagram
+      [i]. *)
+
+  val peer : t -> int -> Sockaddr.t
+  (** A copy of the address of the sender of datagram [i]. *)
+
+  val peers : t -> Buffer.t
+  (** Sender addresses of all datagrams in the batch, packed as an array of C
+      [struct sockaddr_storage]. Reading addresses directly from this buffer
+      avoids allocating a {!Luv.Sockaddr.t} for each datagram. *)
+end
+
+val recv_batch_start :
+  ?max_datagrams:int -> t -> ((Batch.t, Error.t) result -> unit) -> unit
+(** Like {!Luv.UDP.recv_start}, but calls its callback once per batch of
+    datagrams, rather than once per datagram.
+
+    When the handle was created with [~recvmmsg:true] and the platform supports
+    [recvmmsg(2)] (see {!Luv.UDP.using_recvmmsg}), the datagrams received by
+    each [recvmmsg(2)] call are collected in C and passed to the callback
+    together, without intermediate calls into OCaml. Otherwise, each datagram is
+    passed as a batch of one.
+
+    [?max_datagrams] is the number of datagrams that can be received in one
+    batch, and defaults to 20. libuv itself currently caps [recvmmsg(2)] calls
+    at 20 datagrams. A receive buffer of 64 KiB per datagram is allocated once,
+    when this function is called.
+
+    Call {!Luv.UDP.recv_stop} to stop receiving. *)
+
 val get_send_queue_size : t -> int
 (** Binds
     {{:http://docs.libuv.org/en/v1.x/udp.html#c.uv_udp_get_send_queue_size}
@@ -274,4 +381,13 @@ sig
 
       Binds {{:http://docs.libuv.org/en/v1.x/udp.html#c.uv_udp_try_send}
       [uv_udp_try_send]}. *)
+
+  val send_batch :
+    t -> Buffer.t list list -> ((unit, Error.t) result -> unit) -> unit
+  (** Like {!Luv.UDP.send_batch}, but all datagrams are sent to the peer address
+      assigned to the socket. *)
+
+  val try_send_batch : t -> Buffer.t list list -> (int, Error.t) result
+  (** Like {!Luv.UDP.try_send_batch}, but all datagrams are sent to the peer
+      address assigned to the socket. *)
 end
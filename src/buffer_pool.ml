@@ -0,0 +1,115 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(* Each buffer handed out by a pool is a view into a larger slab. Buffers are
+   found again on release by the address of their first byte, which is the same
+   for a buffer and for any view into it that starts at offset 0, such as the
+   views passed by Stream.read_start and UDP.recv_start to their callbacks. *)
+
+type slot = {
+  size_class : size_class;
+  buffer : Buffer.t;
+}
+
+and size_class = {
+  size : int;
+  slab_size : int;
+  mutable free : slot array;
+  mutable free_count : int;
+}
+
+type t = {
+  size_classes : size_class array;
+  outstanding : (nativeint, slot) Hashtbl.t;
+}
+
+let default_size_classes = [4096; 16384; 65536]
+
+let default_slab_size = 1024 * 1024
+
+let address buffer =
+  Ctypes.(raw_address_of_ptr (to_voidp (bigarray_start array1 buffer)))
+
+let create
+    ?(size_classes = default_size_classes) ?(slab_size = default_slab_size) () =
+
+  let size_classes =
+    size_classes
+    |> List.filter (fun size -> size > 0)
+    |> List.sort_uniq compare
+    |> List.map (fun size ->
+      {
+        size;
+        slab_size = max size slab_size;
+        free = [||];
+        free_count = 0;
+      })
+    |> Array.of_list
+  in
+  if Array.length size_classes = 0 then
+    invalid_arg "Luv.Buffer_pool.create: no size classes";
+  {
+    size_classes;
+    outstanding = Hashtbl.create 64;
+  }
+
+let size_class_for pool size =
+  let last = Array.length pool.size_classes - 1 in
+  let rec search index =
+    if index >= last || pool.size_classes.(index).size >= size then
+      pool.size_classes.(index)
+    else
+      search (index + 1)
+  in
+  search 0
+
+let push size_class slot =
+  if size_class.free_count >= Array.length size_class.free then begin
+    let free = Array.make (max 16 (2 * size_class.free_count)) slot in
+    Array.blit size_class.free 0 free 0 size_class.free_count;
+    size_class.free <- free
+  end;
+  size_class.free.(size_class.free_count) <- slot;
+  size_class.free_count <- size_class.free_count + 1
+
+let carve_slab size_class =
+  let count = size_class.slab_size / size_class.size in
+  let slab = Buffer.create (count * size_class.size) in
+  for index = 0 to count - 1 do
+    let buffer =
+      Buffer.sub slab ~offset:(index * size_class.size) ~length:size_class.size
+    in
+    push size_class {size_class; buffer}
+  done
+
+let allocate pool size =
+  let size_class = size_class_for pool size in
+  if size_class.free_count = 0 then
+    carve_slab size_class;
+  size_class.free_count <- size_class.free_count - 1;
+  let slot = size_class.free.(size_class.free_count) in
+  Hashtbl.replace pool.outstanding (address slot.buffer) slot;
+  slot.buffer
+
+let release pool buffer =
+  let key = address buffer in
+  match Hashtbl.find pool.outstanding key with
+  | exception Not_found ->
+    invalid_arg "Luv.Buffer_pool.release: buffer not allocated from this pool"
+  | slot ->
+    Hashtbl.remove pool.outstanding key;
+    push slot.size_class slot
+
+let outstanding pool =
+  Hashtbl.length pool.outstanding
+
+let available pool =
+  Array.fold_left
+    (fun total size_class -> total + size_class.free_count)
+    0 pool.size_classes
+
+let size_classes pool =
+  Array.to_list pool.size_classes
+  |> List.map (fun size_class -> size_class.size)
@@ -0,0 +1,82 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(** Pools of reusable buffers.
+
+    By default, {!Luv.Stream.read_start} and {!Luv.UDP.recv_start} allocate a
+    fresh {!Luv.Buffer.t} for each read. Each such buffer is a separate C
+    allocation with a finalizer, and a program handling many connections can
+    spend a lot of time allocating and collecting them.
+
+    A buffer pool instead carves buffers out of large slabs, grouped into size
+    classes, and hands them out and takes them back explicitly. Once a program
+    reaches a steady state, buffers are only recycled, and no new buffers are
+    allocated.
+
+    To read into pooled buffers, pass [~pool] to {!Luv.Stream.read_start} or
+    {!Luv.UDP.recv_start}, and call {!Luv.Buffer_pool.release} on each buffer
+    passed to the read callback once its data is no longer needed:
+
+    {[
+      let pool = Luv.Buffer_pool.create () in
+      Luv.Stream.read_start ~pool tcp (function
+        | Error _ -> Luv.Handle.close tcp ignore
+        | Ok buffer ->
+          handle_data buffer;
+          Luv.Buffer_pool.release pool buffer)
+    ]}
+
+    Pools are not thread-safe. Each pool should be used only by the thread
+    running the loop of the handles that read into it. *)
+
+type t
+(** Buffer pools. *)
+
+val create : ?size_classes:int list -> ?slab_size:int -> unit -> t
+(** Creates an empty pool.
+
+    [?size_classes] lists the sizes of buffers the pool hands out. The default
+    is [[4096; 16384; 65536]]. The largest class should typically be at least
+    65536, because that is the size libuv suggests for stream and UDP reads.
+
+    [?slab_size] is the size of the slabs buffers are carved out of, when a size
+    class runs out of free buffers. The default is 1 MiB. Slabs are never
+    smaller than one buffer of their size class.
+
+    Raises [Invalid_argument] if [?size_classes] contains no positive sizes. *)
+
+val allocate : t -> int -> Buffer.t
+(** [Luv.Buffer_pool.allocate pool size] takes a buffer out of [pool].
+
+    The buffer comes from the smallest size class that can hold [size] bytes,
+    or from the largest size class if none can. Its size is that of the class.
+
+    This function has the right type to be passed as [?allocate] to
+    {!Luv.Stream.read_start} or {!Luv.UDP.recv_start}, but in that case
+    buffers passed to libuv that end up receiving no data are not returned to
+    the pool. Prefer passing [~pool] instead. *)
+
+val release : t -> Buffer.t -> unit
+(** Returns a buffer to the pool it was allocated from.
+
+    The argument can be the buffer returned by {!Luv.Buffer_pool.allocate}, or
+    any view into it that starts at its beginning, such as the buffers passed
+    to the callbacks of {!Luv.Stream.read_start} and {!Luv.UDP.recv_start}.
+
+    The buffer must not be used after it is released, as its storage will be
+    handed out again.
+
+    Raises [Invalid_argument] if the buffer is not currently allocated from
+    [pool]. This includes releasing the same buffer twice. *)
+
+val outstanding : t -> int
+(** Number of buffers currently allocated from the pool and not yet
+    released. *)
+
+val available : t -> int
+(** Number of free buffers held by the pool, across all size classes. *)
+
+val size_classes : t -> int list
+(** Buffer sizes handed out by the pool, in increasing order. *)
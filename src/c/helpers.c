@@ -3,9 +3,22 @@
 
 
 
+// For sendmmsg, splice, and pipe2.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 #define CAML_NAME_SPACE
 #include <caml/alloc.h>
 #include <caml/bigarray.h>
@@ -45,12 +58,56 @@
     value *gc_root = uv_req_get_data((uv_req_t*)c_request); \
     GET_REFERENCES(callback_index)
 
+// Calls into OCaml are timed if instrumentation is enabled on their loop, or
+// tracing is enabled. See "Loop instrumentation" and "Tracing" below. The loop,
+// callback kind, and object are computed before the call, because the callback
+// may release the handle or request. Trampolines that time their callbacks
+// acquire the runtime lock with luv_acquire_runtime_system, which measures how
+// long that took while tracing.
+static uint64_t luv_instrumentation_start(uv_loop_t *loop);
+static void luv_instrumentation_record(
+    uv_loop_t *loop, int kind, void *object, uint64_t start);
+static void luv_instrumentation_record_wait(
+    uv_loop_t *loop, uint64_t queued_at, uint64_t started_at);
+static void luv_acquire_runtime_system(void);
+
+#define TIMED_CALLBACK(loop, kind, object, call) \
+    do { \
+        uv_loop_t *luv_loop = (loop); \
+        int luv_kind = (kind); \
+        void *luv_object = (object); \
+        uint64_t luv_start = luv_instrumentation_start(luv_loop); \
+        call; \
+        luv_instrumentation_record(luv_loop, luv_kind, luv_object, luv_start); \
+    } while (0)
+
+#define TIMED_HANDLE_CALLBACK(call) \
+    TIMED_CALLBACK( \
+        ((uv_handle_t*)c_handle)->loop, \
+        uv_handle_get_type((uv_handle_t*)c_handle), \
+        c_handle, \
+        call)
+
+#define TIMED_REQUEST_CALLBACK(loop, call) \
+    TIMED_CALLBACK( \
+        loop, \
+        UV_HANDLE_TYPE_MAX + uv_req_get_type((uv_req_t*)c_request), \
+        c_request, \
+        call)
+
 static void luv_after_work_trampoline(uv_work_t *c_request, int status)
 {
     caml_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    value queued_at = Field(reference_array, LUV_WORK_QUEUED_AT);
+    value started_at = Field(reference_array, LUV_WORK_STARTED_AT);
+    if (Is_long(queued_at) && Is_long(started_at)) {
+        luv_instrumentation_record_wait(
+            c_request->loop, Long_val(queued_at), Long_val(started_at));
+    }
+    TIMED_REQUEST_CALLBACK(c_request->loop,
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
@@ -72,75 +129,86 @@ static void luv_alloc_trampoline(
 
 static void luv_async_trampoline(uv_async_t *c_handle)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_unit);
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_unit));
     caml_release_runtime_system();
 }
 
 static void luv_check_trampoline(uv_check_t *c_handle)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_unit);
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_unit));
     caml_release_runtime_system();
 }
 
+static void luv_detach(uv_handle_t *c_handle);
+
 static void luv_close_trampoline(uv_handle_t *c_handle)
 {
-    caml_acquire_runtime_system();
+    luv_detach(c_handle);
+
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_CLOSE_CALLBACK);
-    caml_callback(callback, Val_unit);
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_unit));
     caml_release_runtime_system();
 }
 
 static void luv_connect_trampoline(uv_connect_t *c_request, int status)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    TIMED_REQUEST_CALLBACK(c_request->handle->loop,
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
 static void luv_connection_trampoline(uv_stream_t *c_handle, int status)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_CONNECTION_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
 static void luv_exit_trampoline(
     uv_process_t *c_handle, int64_t exit_status, int term_signal)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     CAMLparam0();
     CAMLlocal1(callback);
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback2(
-        callback, caml_copy_int64(exit_status), Val_int(term_signal));
+    TIMED_HANDLE_CALLBACK(
+        caml_callback2(
+            callback, caml_copy_int64(exit_status), Val_int(term_signal)));
     CAMLdrop;
     caml_release_runtime_system();
 }
 
 static void luv_fs_trampoline(uv_fs_t *c_request)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_unit);
+    TIMED_REQUEST_CALLBACK(c_request->loop,
+        caml_callback(callback, Val_unit));
     caml_release_runtime_system();
 }
 
 static void luv_fs_event_trampoline(
     uv_fs_event_t *c_handle, char *filename, int events, int status)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     CAMLparam0();
     CAMLlocal2(callback, option);
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
@@ -150,8 +218,9 @@ static void luv_fs_event_trampoline(
         option = caml_alloc_small(1, 0);
         Field(option, 0) = caml_copy_string(filename);
     }
-    caml_callback3(
-        callback, option, Val_int(events), Val_int(status));
+    TIMED_HANDLE_CALLBACK(
+        caml_callback3(
+            callback, option, Val_int(events), Val_int(status)));
     CAMLdrop;
     caml_release_runtime_system();
 }
@@ -159,13 +228,14 @@ static void luv_fs_event_trampoline(
 static void luv_fs_poll_trampoline(
     uv_fs_poll_t *c_handle, int status, uv_stat_t *prev, uv_stat_t *curr)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     CAMLparam0();
     CAMLlocal1(callback);
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback3(
-        callback, Val_int(status), caml_copy_nativeint((intnat)prev),
-        caml_copy_nativeint((intnat)curr));
+    TIMED_HANDLE_CALLBACK(
+        caml_callback3(
+            callback, Val_int(status), caml_copy_nativeint((intnat)prev),
+            caml_copy_nativeint((intnat)curr)));
     CAMLdrop;
     caml_release_runtime_system();
 }
@@ -173,10 +243,11 @@ static void luv_fs_poll_trampoline(
 static void luv_getaddrinfo_trampoline(
     uv_getaddrinfo_t *c_request, int status, struct addrinfo *res)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    TIMED_REQUEST_CALLBACK(c_request->loop,
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
@@ -184,19 +255,21 @@ static void luv_getnameinfo_trampoline(
     uv_getnameinfo_t *c_request, int status, const char *hostname,
     const char *service)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    TIMED_REQUEST_CALLBACK(c_request->loop,
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
 static void luv_idle_trampoline(uv_idle_t *c_handle)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_unit);
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_unit));
     caml_release_runtime_system();
 }
 
@@ -210,39 +283,43 @@ static void luv_once_trampoline(void)
 
 static void luv_poll_trampoline(uv_poll_t *c_handle, int status, int event)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback2(callback, Val_int(status), Val_int(event));
+    TIMED_HANDLE_CALLBACK(
+        caml_callback2(callback, Val_int(status), Val_int(event)));
     caml_release_runtime_system();
 }
 
 static void luv_prepare_trampoline(uv_prepare_t *c_handle)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_unit);
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_unit));
     caml_release_runtime_system();
 }
 
 static void luv_random_trampoline(
     uv_random_t *c_request, int status, void *buffer, size_t length)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    TIMED_REQUEST_CALLBACK(c_request->loop,
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
 static void luv_read_trampoline(
     uv_stream_t *c_handle, ssize_t nread, uv_buf_t *buffer)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int((int)nread));
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_int((int)nread)));
     caml_release_runtime_system();
 }
 
@@ -250,41 +327,45 @@ static void luv_recv_trampoline(
     uv_udp_t *c_handle, ssize_t nread, uv_buf_t *buffer, struct sockaddr *addr,
     unsigned int flags)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     CAMLparam0();
     CAMLlocal1(callback);
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback3(
-        callback, Val_int((int)nread), caml_copy_nativeint((intnat)addr),
-        Val_int(flags));
+    TIMED_HANDLE_CALLBACK(
+        caml_callback3(
+            callback, Val_int((int)nread), caml_copy_nativeint((intnat)addr),
+            Val_int(flags)));
     CAMLdrop;
     caml_release_runtime_system();
 }
 
 static void luv_send_trampoline(uv_udp_send_t *c_request, int status)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    TIMED_REQUEST_CALLBACK(c_request->handle->loop,
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
 static void luv_shutdown_trampoline(uv_shutdown_t *c_request, int status)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    TIMED_REQUEST_CALLBACK(c_request->handle->loop,
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
 static void luv_signal_trampoline(uv_signal_t *c_handle, int signum)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_unit);
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_unit));
     caml_release_runtime_system();
 }
 
@@ -310,10 +391,11 @@ static void luv_thread_trampoline(void *argument)
 
 static void luv_timer_trampoline(uv_timer_t *c_handle)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_unit);
+    TIMED_HANDLE_CALLBACK(
+        caml_callback(callback, Val_unit));
     caml_release_runtime_system();
 }
 
@@ -324,11 +406,16 @@ static void luv_work_trampoline(uv_work_t *c_request)
     // communicating it back to OCaml code. Perhaps the data structures need to
     // be adjusted to permit this.
 
+    uint64_t started_at = uv_hrtime();
+
     caml_c_thread_register();
     caml_acquire_runtime_system();
 
     value callback;
     GET_REQUEST_CALLBACK(LUV_WORK_FUNCTION);
+    if (Long_val(Field(reference_array, LUV_WORK_QUEUED_AT)) != 0)
+        Store_field(
+            reference_array, LUV_WORK_STARTED_AT, Val_long(started_at));
     caml_callback(callback, Val_unit);
 
     caml_release_runtime_system();
@@ -337,10 +424,11 @@ static void luv_work_trampoline(uv_work_t *c_request)
 
 static void luv_write_trampoline(uv_write_t *c_request, int status)
 {
-    caml_acquire_runtime_system();
+    luv_acquire_runtime_system();
     value callback;
     GET_REQUEST_CALLBACK(LUV_GENERIC_CALLBACK);
-    caml_callback(callback, Val_int(status));
+    TIMED_REQUEST_CALLBACK(c_request->handle->loop,
+        caml_callback(callback, Val_int(status)));
     caml_release_runtime_system();
 }
 
@@ -501,6 +589,8 @@ enum {
     C_OCAML_GC_ROOT,
     C_FUNCTION,
     C_ARGUMENT,
+    C_QUEUED_AT,
+    C_STARTED_AT,
     C_FIELD_COUNT
 };
 
@@ -514,6 +604,8 @@ int luv_add_c_function_and_argument(
     c_fields[C_OCAML_GC_ROOT] = uv_req_get_data((uv_req_t*)c_request);
     c_fields[C_FUNCTION] = (void*)function;
     c_fields[C_ARGUMENT] = (void*)argument;
+    c_fields[C_QUEUED_AT] = NULL;
+    c_fields[C_STARTED_AT] = NULL;
 
     uv_req_set_data((uv_req_t*)c_request, c_fields);
 
@@ -523,6 +615,11 @@ int luv_add_c_function_and_argument(
 static void luv_after_c_work_trampoline(uv_work_t *c_request, int status)
 {
     void **c_fields = uv_req_get_data((uv_req_t*)c_request);
+    if (c_fields[C_QUEUED_AT] != NULL && c_fields[C_STARTED_AT] != NULL) {
+        luv_instrumentation_record_wait(
+            c_request->loop, (uintptr_t)c_fields[C_QUEUED_AT],
+            (uintptr_t)c_fields[C_STARTED_AT]);
+    }
     uv_req_set_data((uv_req_t*)c_request, c_fields[C_OCAML_GC_ROOT]);
     free(c_fields);
 
@@ -532,6 +629,8 @@ static void luv_after_c_work_trampoline(uv_work_t *c_request, int status)
 static void luv_c_work_trampoline(uv_work_t *c_request)
 {
     void **c_fields = uv_req_get_data((uv_req_t*)c_request);
+    if (c_fields[C_QUEUED_AT] != NULL)
+        c_fields[C_STARTED_AT] = (void*)(uintptr_t)uv_hrtime();
     void (*function)(void*) = c_fields[C_FUNCTION];
     void *argument = c_fields[C_ARGUMENT];
     function(argument);
@@ -547,6 +646,32 @@ uv_work_cb luv_get_c_work_trampoline(void)
     return luv_c_work_trampoline;
 }
 
+int luv_queue_work(
+    uv_loop_t *loop, uv_work_t *c_request, uv_work_cb work_cb,
+    uv_after_work_cb after_work_cb)
+{
+    // Requests can be reused, so the time stamps are reset on every call. They
+    // are recorded only if the loop is instrumented.
+    uint64_t queued_at = luv_instrumentation_start(loop);
+
+    if (work_cb == luv_c_work_trampoline) {
+        void **c_fields = uv_req_get_data((uv_req_t*)c_request);
+        c_fields[C_QUEUED_AT] = (void*)(uintptr_t)queued_at;
+        c_fields[C_STARTED_AT] = NULL;
+
+        value *gc_root = c_fields[C_OCAML_GC_ROOT];
+        Store_field(*gc_root, LUV_WORK_QUEUED_AT, Val_long(0));
+        Store_field(*gc_root, LUV_WORK_STARTED_AT, Val_long(0));
+    }
+    else {
+        value *gc_root = uv_req_get_data((uv_req_t*)c_request);
+        Store_field(*gc_root, LUV_WORK_QUEUED_AT, Val_long(queued_at));
+        Store_field(*gc_root, LUV_WORK_STARTED_AT, Val_long(0));
+    }
+
+    return uv_queue_work(loop, c_request, work_cb, after_work_cb);
+}
+
 int luv_thread_create_c(
     uv_thread_t *tid,
     const uv_thread_options_t* options,
@@ -583,151 +708,2513 @@ CAMLprim value luv_set_once_callback(value callback)
 
 
 
+// Per-loop state.
+//
+// Luv keeps some C state for each loop, pointed to by the loop's data field. It
+// is allocated on first use, and freed by luv_loop_close. It is used only from
+// the thread running the loop, so it needs no locking.
+
+struct luv_instrumentation_s;
+struct luv_attachment_s;
+
+typedef struct {
+    struct luv_instrumentation_s *instrumentation;
+    struct luv_attachment_s **attachments;
+    size_t attachment_buckets;
+    size_t attachment_count;
+} luv_loop_state_t;
+
+static luv_loop_state_t* luv_loop_state(uv_loop_t *loop, int create)
+{
+    luv_loop_state_t *state = uv_loop_get_data(loop);
+    if (state == NULL && create) {
+        state = calloc(1, sizeof(luv_loop_state_t));
+        uv_loop_set_data(loop, state);
+    }
+    return state;
+}
 
-// Warning-suppressing wrappers.
+int luv_loop_close(uv_loop_t *loop)
+{
+    int result = uv_loop_close(loop);
+    if (result < 0)
+        return result;
 
-char* luv_version_string(void)
+    // All handles have been closed, so no state is still attached.
+    luv_loop_state_t *state = uv_loop_get_data(loop);
+    if (state != NULL) {
+        free(state->attachments);
+        free(state);
+        uv_loop_set_data(loop, NULL);
+    }
+    return 0;
+}
+
+
+
+// C-side handle state.
+//
+// Some fast paths, such as framed stream reads, keep per-handle state in C, and
+// look it up from libuv callbacks without taking the runtime lock. Such state
+// can't be kept in the handle's OCaml reference array, so it is instead
+// attached to the handle in a hash table of the handle's loop, keyed by the
+// handle's address. The table grows with the number of attachments, so lookups
+// stay short with many open handles. All state attached to a handle is
+// detached and freed when the handle is closed.
+//
+// Each handle has at most one exclusive attachment, such as the state of a
+// framed read, which is replaced by the next exclusive attachment. A handle can
+// also have any number of shared attachments, which are removed only by their
+// owners, or when the handle is closed.
+//
+// State that is attached while its own callback into OCaml is running is not
+// freed immediately, because the OCaml code may replace it or close the handle.
+// It is instead marked as detached, and freed by the running callback once
+// control returns to C.
+//
+// State that owns libuv resources of its own sets release, which is then called
+// instead of free, and is responsible for eventually freeing the state.
+
+typedef struct luv_attachment_s {
+    struct luv_attachment_s *next;
+    uv_handle_t *handle;
+    int exclusive;
+    int in_callback;
+    int detached;
+    void (*release)(struct luv_attachment_s *attachment);
+} luv_attachment_t;
+
+#define LUV_ATTACHMENT_INITIAL_BUCKETS 16
+
+static size_t luv_attachment_hash(uv_handle_t *handle, size_t buckets)
 {
-    return (char*)uv_version_string();
+    uint64_t key = (uint64_t)(uintptr_t)handle;
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    return (size_t)(key >> 32) & (buckets - 1);
 }
 
-char* luv_req_type_name(uv_req_type type)
+static luv_attachment_t** luv_attachment_bucket(
+    luv_loop_state_t *state, uv_handle_t *handle)
 {
-    return (char*)uv_req_type_name(type);
+    return
+        &state->attachments[
+            luv_attachment_hash(handle, state->attachment_buckets)];
+}
+
+// Doubles the number of buckets once there are more attachments than buckets.
+// If that fails, the table keeps working with longer chains.
+static void luv_grow_attachments(luv_loop_state_t *state)
+{
+    if (state->attachment_count < state->attachment_buckets)
+        return;
+
+    size_t buckets =
+        state->attachment_buckets == 0 ?
+            LUV_ATTACHMENT_INITIAL_BUCKETS : state->attachment_buckets * 2;
+    luv_attachment_t **attachments =
+        calloc(buckets, sizeof(luv_attachment_t*));
+    if (attachments == NULL)
+        return;
+
+    for (size_t index = 0; index < state->attachment_buckets; ++index) {
+        luv_attachment_t *attachment = state->attachments[index];
+        while (attachment != NULL) {
+            luv_attachment_t *next = attachment->next;
+            size_t bucket = luv_attachment_hash(attachment->handle, buckets);
+            attachment->next = attachments[bucket];
+            attachments[bucket] = attachment;
+            attachment = next;
+        }
+    }
+
+    free(state->attachments);
+    state->attachments = attachments;
+    state->attachment_buckets = buckets;
 }
 
-char* luv_fs_get_path(const uv_fs_t *req)
+// Returns the exclusive attachment of handle, if any.
+static luv_attachment_t* luv_find_attachment(uv_handle_t *handle)
 {
-    return (char*)uv_fs_get_path(req);
+    luv_loop_state_t *state = luv_loop_state(handle->loop, 0);
+    if (state == NULL || state->attachment_count == 0)
+        return NULL;
+
+    luv_attachment_t *attachment = *luv_attachment_bucket(state, handle);
+    while (attachment != NULL &&
+            (attachment->handle != handle || !attachment->exclusive))
+        attachment = attachment->next;
+    return attachment;
 }
 
-char* luv_dlerror(const uv_lib_t *lib)
+static void luv_free_attachment(luv_attachment_t *attachment)
 {
-    return (char*)uv_dlerror(lib);
+    if (attachment->in_callback)
+        attachment->detached = 1;
+    else if (attachment->release != NULL)
+        attachment->release(attachment);
+    else
+        free(attachment);
+}
+
+// Unlinks the attachments of handle that match, and returns them as a list.
+static luv_attachment_t* luv_unlink_attachments(
+    uv_handle_t *handle, int exclusive_only)
+{
+    luv_loop_state_t *state = luv_loop_state(handle->loop, 0);
+    if (state == NULL || state->attachment_count == 0)
+        return NULL;
+
+    luv_attachment_t *unlinked = NULL;
+    luv_attachment_t **link = luv_attachment_bucket(state, handle);
+    while (*link != NULL) {
+        luv_attachment_t *attachment = *link;
+        if (attachment->handle == handle &&
+                (attachment->exclusive || !exclusive_only)) {
+            *link = attachment->next;
+            attachment->next = unlinked;
+            unlinked = attachment;
+            --state->attachment_count;
+        }
+        else
+            link = &attachment->next;
+    }
+    return unlinked;
 }
 
-int luv_fs_event_start(
-    uv_fs_event_t *handle, luv_fs_event_cb cb, const char *path,
-    unsigned int flags)
+static void luv_free_attachments(luv_attachment_t *attachments)
 {
-    return uv_fs_event_start(handle, (uv_fs_event_cb)cb, path, flags);
+    while (attachments != NULL) {
+        luv_attachment_t *next = attachments->next;
+        luv_free_attachment(attachments);
+        attachments = next;
+    }
 }
 
-int luv_fs_poll_start(
-    uv_fs_poll_t *handle, luv_fs_poll_cb poll_cb, const char *path,
-    unsigned int interval)
+static int luv_link_attachment(
+    uv_handle_t *handle, luv_attachment_t *attachment, int exclusive)
 {
-    return uv_fs_poll_start(handle, (uv_fs_poll_cb)poll_cb, path, interval);
+    luv_loop_state_t *state = luv_loop_state(handle->loop, 1);
+    if (state == NULL)
+        return UV_ENOMEM;
+
+    luv_grow_attachments(state);
+    if (state->attachment_buckets == 0)
+        return UV_ENOMEM;
+
+    attachment->handle = handle;
+    attachment->exclusive = exclusive;
+    attachment->in_callback = 0;
+    attachment->detached = 0;
+    luv_attachment_t **bucket = luv_attachment_bucket(state, handle);
+    attachment->next = *bucket;
+    *bucket = attachment;
+    ++state->attachment_count;
+    return 0;
 }
 
-int luv_read_start(
-    uv_stream_t *stream, uv_alloc_cb alloc_cb, luv_read_cb read_cb)
+// Attaches replacement to handle as its exclusive attachment, or only detaches
+// the current one if replacement is NULL. The previous one, if any, is freed.
+// Fails only if the table can't be allocated.
+static int luv_attach(uv_handle_t *handle, luv_attachment_t *replacement)
 {
-    return uv_read_start(stream, alloc_cb, (uv_read_cb)read_cb);
+    luv_attachment_t *previous = luv_unlink_attachments(handle, 1);
+    int result = 0;
+    if (replacement != NULL)
+        result = luv_link_attachment(handle, replacement, 1);
+    luv_free_attachments(previous);
+    return result;
 }
 
-int luv_udp_recv_start(
-    uv_udp_t *handle, uv_alloc_cb alloc_cb, luv_udp_recv_cb recv_cb)
+// Attaches state to handle alongside its other attachments.
+static int luv_attach_shared(uv_handle_t *handle, luv_attachment_t *attachment)
 {
-    return uv_udp_recv_start(handle, alloc_cb, (uv_udp_recv_cb)recv_cb);
+    return luv_link_attachment(handle, attachment, 0);
 }
 
-int luv_os_uname(char *buffer)
+// Removes one attachment without freeing it. Does nothing if it has already
+// been detached.
+static void luv_remove_attachment(luv_attachment_t *attachment)
 {
-    return uv_os_uname((uv_utsname_t*)buffer);
+    luv_loop_state_t *state = luv_loop_state(attachment->handle->loop, 0);
+    if (state == NULL || state->attachment_count == 0)
+        return;
+
+    luv_attachment_t **link = luv_attachment_bucket(state, attachment->handle);
+    while (*link != NULL && *link != attachment)
+        link = &(*link)->next;
+    if (*link != NULL) {
+        *link = attachment->next;
+        --state->attachment_count;
+    }
 }
 
+static void luv_detach(uv_handle_t *c_handle)
+{
+    uv_handle_type type = uv_handle_get_type(c_handle);
+    if (type != UV_TCP && type != UV_NAMED_PIPE && type != UV_TTY &&
+            type != UV_UDP)
+        return;
 
+    luv_free_attachments(luv_unlink_attachments(c_handle, 0));
+}
 
-// String conversion functions.
 
-size_t luv_utf16_length_as_wtf8(const char *utf16, ssize_t utf16_len)
-{
-    return uv_utf16_length_as_wtf8((const uint16_t*)utf16, utf16_len);
+
+
+// Framed reads.
+//
+// luv_read_frames_start reads a stream into a buffer managed entirely in C,
+// and calls into OCaml only once a complete frame has arrived, rather than
+// twice for each chunk read from the kernel.
+
+typedef struct {
+    luv_attachment_t attachment;
+    int framing;
+    unsigned int parameter;
+    size_t capacity;
+    size_t filled;
+    size_t scanned;
+    char data[];
+} luv_framer_t;
+
+enum {
+    LUV_FRAME_INCOMPLETE,
+    LUV_FRAME_COMPLETE,
+    LUV_FRAME_TOO_LARGE
+};
+
+// Looks for a frame starting at offset start in the buffered data. If one is
+// complete, stores the offset and length of its payload, and the offset of the
+// byte following the frame.
+static int luv_next_frame(
+    luv_framer_t *framer, size_t start, size_t *payload, size_t *length,
+    size_t *end)
+{
+    if (framer->framing == LUV_FRAMING_LENGTH_PREFIXED) {
+        size_t prefix_length = framer->parameter;
+        if (framer->filled - start < prefix_length)
+            return LUV_FRAME_INCOMPLETE;
+
+        const unsigned char *prefix =
+            (const unsigned char*)framer->data + start;
+        size_t frame_length = 0;
+        for (size_t index = 0; index < prefix_length; ++index)
+            frame_length = (frame_length << 8) | prefix[index];
+
+        if (frame_length > framer->capacity - prefix_length)
+            return LUV_FRAME_TOO_LARGE;
+        if (framer->filled - start - prefix_length < frame_length)
+            return LUV_FRAME_INCOMPLETE;
+
+        *payload = start + prefix_length;
+        *length = frame_length;
+        *end = *payload + frame_length;
+        return LUV_FRAME_COMPLETE;
+    }
+    else {
+        if (framer->scanned < start)
+            framer->scanned = start;
+
+        const char *delimiter =
+            memchr(
+                framer->data + framer->scanned, (int)framer->parameter,
+                framer->filled - framer->scanned);
+
+        if (delimiter == NULL) {
+            framer->scanned = framer->filled;
+            if (framer->filled - start >= framer->capacity)
+                return LUV_FRAME_TOO_LARGE;
+            return LUV_FRAME_INCOMPLETE;
+        }
+
+        *payload = start;
+        *length = (size_t)(delimiter - framer->data) - start;
+        *end = *payload + *length + 1;
+        return LUV_FRAME_COMPLETE;
+    }
 }
 
-int luv_utf16_to_wtf8(
-    const char *utf16, ssize_t utf16_len, char **wtf8_ptr,
-    size_t *wtf8_len_ptr)
+static void luv_framed_read_trampoline(
+    uv_stream_t *c_handle, ssize_t nread, const uv_buf_t *buffer);
+
+// The stream is still being read by this framer if it hasn't been closed, and
+// the OCaml code hasn't stopped reading, or started reading in some other way.
+static int luv_still_framing(uv_stream_t *c_handle, luv_framer_t *framer)
 {
     return
-        uv_utf16_to_wtf8(
-            (const uint16_t*)utf16, utf16_len, wtf8_ptr, wtf8_len_ptr);
+        !framer->attachment.detached &&
+        !uv_is_closing((uv_handle_t*)c_handle) &&
+        uv_is_active((uv_handle_t*)c_handle) &&
+        c_handle->read_cb == luv_framed_read_trampoline;
+}
+
+static void luv_deliver_read_error(uv_stream_t *c_handle, int status)
+{
+    luv_acquire_runtime_system();
+    value callback;
+    GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
+    TIMED_HANDLE_CALLBACK(
+        caml_callback2(callback, Val_int(status), Val_int(0)));
+    caml_release_runtime_system();
 }
 
+static void luv_deliver_frames(uv_stream_t *c_handle, luv_framer_t *framer)
+{
+    luv_acquire_runtime_system();
+    CAMLparam0();
+    CAMLlocal3(callback, frame, option);
 
+    size_t consumed = 0;
+    size_t payload;
+    size_t length;
+    size_t end;
+    int status = LUV_FRAME_INCOMPLETE;
 
-// Other helpers.
+    framer->attachment.in_callback = 1;
 
-char* luv_version_suffix(void)
+    while (luv_still_framing(c_handle, framer)) {
+        status = luv_next_frame(framer, consumed, &payload, &length, &end);
+        if (status != LUV_FRAME_COMPLETE)
+            break;
+
+        frame =
+            caml_ba_alloc_dims(
+                CAML_BA_UINT8 | CAML_BA_C_LAYOUT, 1, NULL, (intnat)length);
+        memcpy(Caml_ba_data_val(frame), framer->data + payload, length);
+        option = caml_alloc_small(1, 0);
+        Field(option, 0) = frame;
+        consumed = end;
+
+        GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
+        TIMED_HANDLE_CALLBACK(caml_callback2(callback, Val_int(0), option));
+    }
+
+    framer->attachment.in_callback = 0;
+
+    if (framer->attachment.detached)
+        free(framer);
+    else if (status == LUV_FRAME_TOO_LARGE) {
+        framer->filled = 0;
+        framer->scanned = 0;
+        uv_read_stop(c_handle);
+        GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
+        TIMED_HANDLE_CALLBACK(
+            caml_callback2(callback, Val_int(UV_ENOBUFS), Val_int(0)));
+    }
+    else {
+        framer->filled -= consumed;
+        framer->scanned =
+            framer->scanned > consumed ? framer->scanned - consumed : 0;
+        memmove(framer->data, framer->data + consumed, framer->filled);
+    }
+
+    CAMLdrop;
+    caml_release_runtime_system();
+}
+
+static void luv_framed_alloc_trampoline(
+    uv_handle_t *c_handle, size_t suggested_size, uv_buf_t *buffer)
 {
-    return UV_VERSION_SUFFIX;
+    luv_framer_t *framer = (luv_framer_t*)luv_find_attachment(c_handle);
+    if (framer == NULL) {
+        buffer->base = NULL;
+        buffer->len = 0;
+        return;
+    }
+
+    buffer->base = framer->data + framer->filled;
+    buffer->len = framer->capacity - framer->filled;
 }
 
-int luv_spawn(
-    uv_loop_t *loop,
-    uv_process_t *handle,
-    uv_exit_cb exit_cb,
-    const char *file,
-    char **args,
-    int arg_count,
-    char **env,
-    int env_count,
-    int set_env,
-    const char *cwd,
-    int do_cwd,
-    int flags,
-    int stdio_count,
-    uv_stdio_container_t *stdio,
-    int uid,
-    int gid)
+static void luv_framed_read_trampoline(
+    uv_stream_t *c_handle, ssize_t nread, const uv_buf_t *buffer)
 {
-    args[arg_count] = NULL;
+    if (nread == 0)
+        return;
 
-    if (set_env)
-        env[env_count] = NULL;
-    else
-        env = NULL;
+    luv_framer_t *framer =
+        (luv_framer_t*)luv_find_attachment((uv_handle_t*)c_handle);
+    if (framer == NULL) {
+        luv_deliver_read_error(c_handle, nread < 0 ? (int)nread : UV_ENOBUFS);
+        return;
+    }
 
-    if (do_cwd == 0)
-        cwd = NULL;
+    if (nread < 0) {
+        framer->filled = 0;
+        framer->scanned = 0;
+        luv_deliver_read_error(c_handle, (int)nread);
+        return;
+    }
 
-    uv_process_options_t options;
-    options.exit_cb = exit_cb;
-    options.file = file;
-    options.args = args;
-    options.env = env;
-    options.cwd = cwd;
-    options.flags = flags;
-    options.stdio_count = stdio_count;
-    options.stdio = stdio;
-    options.uid = uid;
-    options.gid = gid;
+    framer->filled += (size_t)nread;
+
+    // Most reads of a large frame don't complete it, so check before taking the
+    // runtime lock.
+    size_t payload;
+    size_t length;
+    size_t end;
+    if (luv_next_frame(framer, 0, &payload, &length, &end) ==
+            LUV_FRAME_INCOMPLETE)
+        return;
+
+    luv_deliver_frames(c_handle, framer);
+}
+
+int luv_read_frames_start(
+    uv_stream_t *stream, int framing, unsigned int parameter,
+    size_t max_frame_size)
+{
+    size_t overhead =
+        framing == LUV_FRAMING_LENGTH_PREFIXED ? (size_t)parameter : 1;
+    luv_framer_t *framer =
+        malloc(sizeof(luv_framer_t) + max_frame_size + overhead);
+    if (framer == NULL)
+        return UV_ENOMEM;
+
+    framer->attachment.release = NULL;
+    framer->framing = framing;
+    framer->parameter = parameter;
+    framer->capacity = max_frame_size + overhead;
+    framer->filled = 0;
+    framer->scanned = 0;
+
+    // The alloc and read callbacks can't be called before control returns to
+    // the loop, so the framer can be installed after starting the read.
+    int result =
+        uv_read_start(
+            stream, luv_framed_alloc_trampoline, luv_framed_read_trampoline);
+    if (result < 0) {
+        free(framer);
+        return result;
+    }
 
-    caml_release_runtime_system();
-    int result = uv_spawn(loop, handle, &options);
-    caml_acquire_runtime_system();
+    result = luv_attach((uv_handle_t*)stream, &framer->attachment);
+    if (result < 0) {
+        uv_read_stop(stream);
+        free(framer);
+        return result;
+    }
 
-    return result;
+    return 0;
 }
 
-int luv_is_invalid_handle_value(uv_os_fd_t handle)
+
+
+// Batched UDP receive.
+//
+// When a UDP handle uses recvmmsg, libuv calls the receive callback once for
+// each datagram received by one recvmmsg call, with flag UV_UDP_MMSG_CHUNK, and
+// then once more with UV_UDP_MMSG_FREE. luv_udp_recv_batch_start records the
+// chunks in C, and calls into OCaml only once for the whole batch. Without
+// recvmmsg, each datagram is delivered as a batch of one.
+//
+// The receive buffer, datagram info, and peer addresses are all allocated by
+// OCaml, which keeps them alive until the handle is closed.
+
+typedef struct {
+    luv_attachment_t attachment;
+    char *buffer;
+    size_t capacity;
+    size_t count;
+    int32_t *info;
+    struct sockaddr_storage *peers;
+} luv_udp_batch_t;
+
+static void luv_deliver_udp_batch(
+    uv_udp_t *c_handle, luv_udp_batch_t *batch, int status)
 {
-    if (handle == (uv_os_fd_t)-1)
-        return 1;
+    luv_acquire_runtime_system();
+
+    value callback;
+    GET_HANDLE_CALLBACK(LUV_GENERIC_CALLBACK);
+
+    batch->attachment.in_callback = 1;
+    TIMED_HANDLE_CALLBACK(
+        caml_callback2(
+            callback, Val_int(status), Val_int((int)batch->count)));
+    batch->attachment.in_callback = 0;
+
+    if (batch->attachment.detached)
+        free(batch);
     else
-        return 0;
+        batch->count = 0;
+
+    caml_release_runtime_system();
 }
 
-int luv_is_invalid_socket_value(uv_os_sock_t socket)
+static void luv_udp_batch_alloc_trampoline(
+    uv_handle_t *c_handle, size_t suggested_size, uv_buf_t *buffer)
 {
-    if (socket == -1)
-        return 1;
-    else
-        return 0;
+    luv_udp_batch_t *batch = (luv_udp_batch_t*)luv_find_attachment(c_handle);
+    if (batch == NULL) {
+        buffer->base = NULL;
+        buffer->len = 0;
+        return;
+    }
+
+    buffer->base = batch->buffer;
+    buffer->len = batch->capacity * LUV_UDP_BATCH_DATAGRAM_SIZE;
 }
 
-int luv_sa_family_to_int(sa_family_t family)
+static void luv_udp_batch_recv_trampoline(
+    uv_udp_t *c_handle, ssize_t nread, const uv_buf_t *buffer,
+    const struct sockaddr *peer, unsigned int flags)
 {
-    return family;
+    luv_udp_batch_t *batch =
+        (luv_udp_batch_t*)luv_find_attachment((uv_handle_t*)c_handle);
+    if (batch == NULL)
+        return;
+
+    if (nread < 0) {
+        luv_deliver_udp_batch(c_handle, batch, (int)nread);
+        return;
+    }
+
+    if (flags & UV_UDP_MMSG_FREE) {
+        if (batch->count > 0)
+            luv_deliver_udp_batch(c_handle, batch, 0);
+        return;
+    }
+
+    // A NULL peer address means that nothing was received.
+    if (peer == NULL)
+        return;
+
+    if (batch->count < batch->capacity) {
+        size_t index = batch->count++;
+        int32_t *info = batch->info + index * LUV_UDP_BATCH_INFO_FIELDS;
+        info[LUV_UDP_BATCH_OFFSET] = (int32_t)(buffer->base - batch->buffer);
+        info[LUV_UDP_BATCH_LENGTH] = (int32_t)nread;
+        info[LUV_UDP_BATCH_PARTIAL] = (flags & UV_UDP_PARTIAL) != 0;
+
+        size_t peer_length =
+            peer->sa_family == AF_INET6 ?
+                sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        memcpy(&batch->peers[index], peer, peer_length);
+    }
+
+    if (!(flags & UV_UDP_MMSG_CHUNK))
+        luv_deliver_udp_batch(c_handle, batch, 0);
+}
+
+int luv_udp_recv_batch_start(
+    uv_udp_t *handle, char *buffer, size_t capacity, int32_t *info,
+    char *peers)
+{
+    luv_udp_batch_t *batch = malloc(sizeof(luv_udp_batch_t));
+    if (batch == NULL)
+        return UV_ENOMEM;
+
+    batch->attachment.release = NULL;
+    batch->buffer = buffer;
+    batch->capacity = capacity;
+    batch->count = 0;
+    batch->info = info;
+    batch->peers = (struct sockaddr_storage*)peers;
+
+    int result =
+        uv_udp_recv_start(
+            handle, luv_udp_batch_alloc_trampoline,
+            luv_udp_batch_recv_trampoline);
+    if (result < 0) {
+        free(batch);
+        return result;
+    }
+
+    result = luv_attach((uv_handle_t*)handle, &batch->attachment);
+    if (result < 0) {
+        uv_udp_recv_stop(handle);
+        free(batch);
+        return result;
+    }
+
+    return 0;
+}
+
+
+
+// Batched UDP send.
+//
+// luv_udp_try_send_batch sends count datagrams. Datagram i consists of the
+// next buffer_counts[i] buffers, and is sent to addresses[i], which is NULL for
+// connected sockets. On Linux, the datagrams are sent with as few sendmmsg
+// calls as possible. Elsewhere, or if the socket has not been created yet, it
+// falls back to calling uv_udp_try_send in a loop.
+//
+// Returns the number of datagrams sent, which is less than count if sending
+// stopped early, or an error code if not even the first datagram was sent.
+
+#define LUV_SENDMMSG_WIDTH 64
+
+#ifdef __linux__
+static int luv_sendmmsg(
+    uv_os_fd_t fd, unsigned int count, uv_buf_t *buffers,
+    unsigned int *buffer_counts, struct sockaddr **addresses)
+{
+    struct mmsghdr messages[LUV_SENDMMSG_WIDTH];
+    unsigned int sent = 0;
+
+    while (sent < count) {
+        unsigned int width = count - sent;
+        if (width > LUV_SENDMMSG_WIDTH)
+            width = LUV_SENDMMSG_WIDTH;
+
+        uv_buf_t *message_buffers = buffers;
+        for (unsigned int index = 0; index < width; ++index) {
+            struct msghdr *header = &messages[index].msg_hdr;
+            struct sockaddr *address = addresses[sent + index];
+            memset(header, 0, sizeof(struct msghdr));
+            if (address != NULL) {
+                header->msg_name = address;
+                header->msg_namelen =
+                    address->sa_family == AF_INET6 ?
+                        sizeof(struct sockaddr_in6) :
+                        sizeof(struct sockaddr_in);
+            }
+            header->msg_iov = (struct iovec*)message_buffers;
+            header->msg_iovlen = buffer_counts[sent + index];
+            message_buffers += buffer_counts[sent + index];
+        }
+
+        int result;
+        do {
+            result = sendmmsg(fd, messages, width, 0);
+        } while (result == -1 && errno == EINTR);
+
+        if (result < 0) {
+            if (sent > 0)
+                return (int)sent;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return UV_EAGAIN;
+            return -errno;
+        }
+
+        for (int index = 0; index < result; ++index)
+            buffers += buffer_counts[sent + index];
+        sent += (unsigned int)result;
+
+        if ((unsigned int)result < width)
+            break;
+    }
+
+    return (int)sent;
+}
+#endif
+
+int luv_udp_try_send_batch(
+    uv_udp_t *handle, unsigned int count, uv_buf_t *buffers,
+    unsigned int *buffer_counts, struct sockaddr **addresses)
+{
+    unsigned int sent = 0;
+
+#ifdef __linux__
+    // Like uv_udp_try_send, don't jump ahead of datagrams queued by
+    // uv_udp_send.
+    if (uv_udp_get_send_queue_count(handle) != 0)
+        return UV_EAGAIN;
+
+    uv_os_fd_t fd;
+    if (uv_fileno((uv_handle_t*)handle, &fd) == 0)
+        return luv_sendmmsg(fd, count, buffers, buffer_counts, addresses);
+#endif
+
+    while (sent < count) {
+        int result =
+            uv_udp_try_send(
+                handle, buffers, buffer_counts[sent], addresses[sent]);
+        if (result < 0)
+            return sent > 0 ? (int)sent : result;
+
+        buffers += buffer_counts[sent];
+        ++sent;
+    }
+
+    return (int)sent;
+}
+
+
+// Splice proxies.
+//
+// luv_proxy_start moves data between two stream sockets in both directions,
+// without it ever reaching user space. Each direction has its own kernel pipe.
+// Data is spliced from the source socket into the pipe, and from the pipe into
+// the destination socket. The sockets are watched with poll handles on
+// duplicates of their descriptors, because libuv doesn't allow two handles to
+// watch the same descriptor.
+//
+// When a source reaches EOF and its pipe is drained, the destination is shut
+// down for writing. The proxy finishes once both directions have been shut
+// down, on the first error, or when either stream is closed. It then closes its
+// poll handles, and calls the OCaml callback with an error code and the number
+// of bytes moved in each direction.
+
+#ifdef __linux__
+
+#define LUV_PROXY_CHUNK (64 * 1024)
+
+typedef struct luv_proxy_s luv_proxy_t;
+
+typedef struct {
+    luv_attachment_t attachment;
+    luv_proxy_t *proxy;
+    uv_stream_t *stream;
+    uv_poll_t poll;
+    int fd;
+    int attached;
+    int events;
+} luv_proxy_side_t;
+
+typedef struct {
+    int pipe[2];
+    size_t buffered;
+    size_t transferred;
+    int eof;
+    int shut_down;
+} luv_proxy_direction_t;
+
+struct luv_proxy_s {
+    luv_proxy_side_t sides[2];
+    luv_proxy_direction_t directions[2];
+    value *callback;
+    int status;
+    int finished;
+    int open_polls;
+};
+
+static void luv_proxy_close_descriptors(luv_proxy_t *proxy)
+{
+    for (int index = 0; index < 2; ++index) {
+        if (proxy->sides[index].fd != -1)
+            close(proxy->sides[index].fd);
+        if (proxy->directions[index].pipe[0] != -1) {
+            close(proxy->directions[index].pipe[0]);
+            close(proxy->directions[index].pipe[1]);
+        }
+    }
+}
+
+static void luv_proxy_poll_close_callback(uv_handle_t *poll)
+{
+    luv_proxy_t *proxy = uv_handle_get_data(poll);
+    if (--proxy->open_polls > 0)
+        return;
+
+    luv_proxy_close_descriptors(proxy);
+
+    int status = proxy->status;
+    size_t forward = proxy->directions[0].transferred;
+    size_t backward = proxy->directions[1].transferred;
+    value *gc_root = proxy->callback;
+    free(proxy);
+
+    // There is no callback if the proxy failed to start.
+    if (gc_root == NULL)
+        return;
+
+    caml_acquire_runtime_system();
+    value callback = *gc_root;
+    caml_remove_generational_global_root(gc_root);
+    caml_stat_free(gc_root);
+    caml_callback3(
+        callback, Val_int(status), Val_long(forward), Val_long(backward));
+    caml_release_runtime_system();
+}
+
+static void luv_proxy_finish(luv_proxy_t *proxy, int status)
+{
+    if (proxy->finished)
+        return;
+    proxy->finished = 1;
+    proxy->status = status;
+
+    for (int index = 0; index < 2; ++index) {
+        luv_proxy_side_t *side = &proxy->sides[index];
+        if (side->attached)
+            luv_attach((uv_handle_t*)side->stream, NULL);
+        uv_close((uv_handle_t*)&side->poll, luv_proxy_poll_close_callback);
+    }
+}
+
+// Called when either stream is closed, or something else is attached to it.
+static void luv_proxy_detached(luv_attachment_t *attachment)
+{
+    luv_proxy_side_t *side = (luv_proxy_side_t*)attachment;
+    side->attached = 0;
+    luv_proxy_finish(side->proxy, UV_ECANCELED);
+}
+
+static ssize_t luv_splice(int from, int to, size_t length)
+{
+    ssize_t result;
+    do {
+        result =
+            splice(
+                from, NULL, to, NULL, length,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return UV_EAGAIN;
+        return -errno;
+    }
+    return result;
+}
+
+// Moves as much data as possible in one direction, without blocking. Returns
+// an error code, or whether any data was moved.
+//
+// Splicing into a pipe also fails with EAGAIN when the pipe is full, which may
+// happen before LUV_PROXY_CHUNK bytes are buffered, since partial pages take up
+// whole pipe slots. So a direction waits for its source to become readable
+// only while its pipe is empty. Otherwise, it waits for its destination to
+// become writable, and retries reading after draining the pipe.
+static int luv_proxy_pump(
+    luv_proxy_direction_t *direction, int source, int destination)
+{
+    int progress = 0;
+
+    while (1) {
+        int moved = 0;
+
+        if (!direction->eof && direction->buffered < LUV_PROXY_CHUNK) {
+            ssize_t result =
+                luv_splice(
+                    source, direction->pipe[1],
+                    LUV_PROXY_CHUNK - direction->buffered);
+            if (result == 0)
+                direction->eof = 1;
+            else if (result > 0) {
+                direction->buffered += (size_t)result;
+                moved = 1;
+            }
+            else if (result != UV_EAGAIN)
+                return (int)result;
+        }
+
+        if (direction->buffered > 0) {
+            ssize_t result =
+                luv_splice(
+                    direction->pipe[0], destination, direction->buffered);
+            if (result > 0) {
+                direction->buffered -= (size_t)result;
+                direction->transferred += (size_t)result;
+                moved = 1;
+            }
+            else if (result < 0 && result != UV_EAGAIN)
+                return (int)result;
+        }
+
+        if (direction->eof && direction->buffered == 0 &&
+                !direction->shut_down) {
+            direction->shut_down = 1;
+            // Pipes that are not sockets can't be half-closed.
+            if (shutdown(destination, SHUT_WR) == -1 && errno != ENOTSOCK)
+                return -errno;
+        }
+
+        if (!moved)
+            return progress;
+        progress = 1;
+    }
+}
+
+static void luv_proxy_poll_callback(uv_poll_t *poll, int status, int events);
+
+static void luv_proxy_run(luv_proxy_t *proxy)
+{
+    int forward = 1;
+    int backward = 1;
+
+    while (forward > 0 || backward > 0) {
+        forward =
+            luv_proxy_pump(
+                &proxy->directions[0], proxy->sides[0].fd,
+                proxy->sides[1].fd);
+        if (forward < 0) {
+            luv_proxy_finish(proxy, forward);
+            return;
+        }
+
+        backward =
+            luv_proxy_pump(
+                &proxy->directions[1], proxy->sides[1].fd,
+                proxy->sides[0].fd);
+        if (backward < 0) {
+            luv_proxy_finish(proxy, backward);
+            return;
+        }
+    }
+
+    if (proxy->directions[0].shut_down && proxy->directions[1].shut_down) {
+        luv_proxy_finish(proxy, 0);
+        return;
+    }
+
+    for (int index = 0; index < 2; ++index) {
+        luv_proxy_direction_t *outgoing = &proxy->directions[index];
+        luv_proxy_direction_t *incoming = &proxy->directions[1 - index];
+        luv_proxy_side_t *side = &proxy->sides[index];
+
+        int events = 0;
+        if (!outgoing->eof && outgoing->buffered == 0)
+            events |= UV_READABLE;
+        if (incoming->buffered > 0)
+            events |= UV_WRITABLE;
+
+        if (events == side->events)
+            continue;
+        side->events = events;
+
+        int result;
+        if (events == 0)
+            result = uv_poll_stop(&side->poll);
+        else
+            result =
+                uv_poll_start(&side->poll, events, luv_proxy_poll_callback);
+        if (result < 0) {
+            luv_proxy_finish(proxy, result);
+            return;
+        }
+    }
+}
+
+static void luv_proxy_poll_callback(uv_poll_t *poll, int status, int events)
+{
+    luv_proxy_t *proxy = uv_handle_get_data((uv_handle_t*)poll);
+    if (status < 0)
+        luv_proxy_finish(proxy, status);
+    else
+        luv_proxy_run(proxy);
+}
+
+#endif
+
+int luv_proxy_start(uv_stream_t *first, uv_stream_t *second, void *callback)
+{
+#ifndef __linux__
+    return UV_ENOTSUP;
+#else
+    uv_stream_t *streams[2] = {first, second};
+    uv_os_fd_t fds[2];
+
+    if (first == second)
+        return UV_EINVAL;
+
+    for (int index = 0; index < 2; ++index) {
+        int result = uv_fileno((uv_handle_t*)streams[index], &fds[index]);
+        if (result < 0)
+            return result;
+    }
+
+    luv_proxy_t *proxy = calloc(1, sizeof(luv_proxy_t));
+    if (proxy == NULL)
+        return UV_ENOMEM;
+
+    for (int index = 0; index < 2; ++index) {
+        proxy->sides[index].fd = -1;
+        proxy->directions[index].pipe[0] = -1;
+    }
+
+    for (int index = 0; index < 2; ++index) {
+        proxy->sides[index].fd = dup(fds[index]);
+        if (proxy->sides[index].fd == -1 ||
+                pipe2(proxy->directions[index].pipe, O_NONBLOCK | O_CLOEXEC)
+                    == -1) {
+            int result = -errno;
+            luv_proxy_close_descriptors(proxy);
+            free(proxy);
+            return result;
+        }
+    }
+
+    uv_loop_t *loop = uv_handle_get_loop((uv_handle_t*)first);
+    for (int index = 0; index < 2; ++index) {
+        luv_proxy_side_t *side = &proxy->sides[index];
+        int result = uv_poll_init(loop, &side->poll, side->fd);
+        if (result < 0) {
+            if (index == 0) {
+                luv_proxy_close_descriptors(proxy);
+                free(proxy);
+            }
+            else {
+                // The first poll handle can only be released by closing it.
+                // Its close callback frees the proxy without calling into
+                // OCaml.
+                proxy->open_polls = 1;
+                uv_close(
+                    (uv_handle_t*)&proxy->sides[0].poll,
+                    luv_proxy_poll_close_callback);
+            }
+            return result;
+        }
+        uv_handle_set_data((uv_handle_t*)&side->poll, proxy);
+    }
+
+    proxy->callback = callback;
+    proxy->open_polls = 2;
+
+    for (int index = 0; index < 2; ++index) {
+        luv_proxy_side_t *side = &proxy->sides[index];
+        uv_read_stop(streams[index]);
+        side->proxy = proxy;
+        side->stream = streams[index];
+        side->attachment.release = luv_proxy_detached;
+        side->attached =
+            luv_attach((uv_handle_t*)streams[index], &side->attachment) == 0;
+    }
+
+    // The callback has been stored, so a failure is reported through it.
+    if (!proxy->sides[0].attached || !proxy->sides[1].attached) {
+        luv_proxy_finish(proxy, UV_ENOMEM);
+        return 0;
+    }
+
+    luv_proxy_run(proxy);
+
+    return 0;
+#endif
+}
+
+
+
+// Writability waits.
+//
+// Stream.send_file calls sendfile on a stream's own socket. When the socket's
+// send buffer is full, it waits for the socket to become writable through a
+// poll handle on a duplicate of the socket, because libuv doesn't allow two
+// handles to watch the same descriptor. The waiter is attached to the stream,
+// so that closing the stream also closes the poll handle and the duplicate.
+// Otherwise, the duplicate would keep the socket open, and the poll handle
+// would keep the loop alive.
+//
+// If the stream is closed during a wait, the callback is called with
+// UV_ECANCELED. The callback is not called after luv_writable_close.
+//
+// The waiter is freed once both OCaml has called luv_writable_close, and the
+// poll handle has been closed.
+
+#ifndef _WIN32
+
+typedef struct {
+    luv_attachment_t attachment;
+    uv_poll_t poll;
+    int fd;
+    value *callback;
+    int attached;
+    int waiting;
+    int closing;
+    int references;
+} luv_writable_t;
+
+static void luv_writable_unref(luv_writable_t *waiter)
+{
+    if (--waiter->references == 0)
+        free(waiter);
+}
+
+static void luv_writable_call(luv_writable_t *waiter, int status)
+{
+    caml_acquire_runtime_system();
+    caml_callback(*waiter->callback, Val_int(status));
+    caml_release_runtime_system();
+}
+
+static void luv_writable_close_callback(uv_handle_t *poll)
+{
+    luv_writable_t *waiter = uv_handle_get_data(poll);
+    close(waiter->fd);
+
+    if (waiter->waiting) {
+        waiter->waiting = 0;
+        luv_writable_call(waiter, UV_ECANCELED);
+    }
+
+    luv_writable_unref(waiter);
+}
+
+static void luv_writable_shut(luv_writable_t *waiter)
+{
+    if (waiter->closing)
+        return;
+    waiter->closing = 1;
+    uv_close((uv_handle_t*)&waiter->poll, luv_writable_close_callback);
+}
+
+// Called when the stream is closed.
+static void luv_writable_detached(luv_attachment_t *attachment)
+{
+    luv_writable_t *waiter = (luv_writable_t*)attachment;
+    waiter->attached = 0;
+    luv_writable_shut(waiter);
+}
+
+static void luv_writable_callback(uv_poll_t *poll, int status, int events)
+{
+    luv_writable_t *waiter = uv_handle_get_data((uv_handle_t*)poll);
+    uv_poll_stop(poll);
+    waiter->waiting = 0;
+    luv_writable_call(waiter, status);
+}
+
+#endif
+
+int luv_writable_create(uv_stream_t *stream, void *callback, void **result)
+{
+#ifdef _WIN32
+    return UV_ENOTSUP;
+#else
+    uv_os_fd_t fd;
+    int error = uv_fileno((uv_handle_t*)stream, &fd);
+    if (error < 0)
+        return error;
+
+    luv_writable_t *waiter = calloc(1, sizeof(luv_writable_t));
+    if (waiter == NULL)
+        return UV_ENOMEM;
+
+    waiter->fd = dup(fd);
+    if (waiter->fd == -1) {
+        error = -errno;
+        free(waiter);
+        return error;
+    }
+
+    error =
+        uv_poll_init(
+            uv_handle_get_loop((uv_handle_t*)stream), &waiter->poll,
+            waiter->fd);
+    if (error < 0) {
+        close(waiter->fd);
+        free(waiter);
+        return error;
+    }
+    uv_handle_set_data((uv_handle_t*)&waiter->poll, waiter);
+
+    waiter->callback = callback;
+    waiter->references = 2;
+    waiter->attachment.release = luv_writable_detached;
+    error = luv_attach_shared((uv_handle_t*)stream, &waiter->attachment);
+    if (error < 0) {
+        // The poll handle can only be released by closing it.
+        waiter->references = 1;
+        luv_writable_shut(waiter);
+        return error;
+    }
+    waiter->attached = 1;
+
+    *result = waiter;
+    return 0;
+#endif
+}
+
+int luv_writable_wait(void *waiter)
+{
+#ifdef _WIN32
+    return UV_ENOTSUP;
+#else
+    luv_writable_t *c_waiter = waiter;
+    if (c_waiter->closing)
+        return UV_ECANCELED;
+
+    int result =
+        uv_poll_start(&c_waiter->poll, UV_WRITABLE, luv_writable_callback);
+    if (result == 0)
+        c_waiter->waiting = 1;
+    return result;
+#endif
+}
+
+void luv_writable_close(void *waiter)
+{
+#ifndef _WIN32
+    luv_writable_t *c_waiter = waiter;
+    if (c_waiter->attached) {
+        c_waiter->attached = 0;
+        luv_remove_attachment(&c_waiter->attachment);
+    }
+    c_waiter->waiting = 0;
+    luv_writable_shut(c_waiter);
+    luv_writable_unref(c_waiter);
+#endif
+}
+
+
+
+// Memory-mapped files.
+//
+// mmap, munmap, msync, and madvise require page-aligned addresses and
+// offsets. These helpers map whole pages, but hand out and take back
+// addresses of the exact byte requested, so that the OCaml side doesn't need
+// to know the page size.
+
+#ifndef _WIN32
+static uintptr_t luv_page_offset(uintptr_t address)
+{
+    return address % (uintptr_t)sysconf(_SC_PAGESIZE);
+}
+#endif
+
+void* luv_mmap(
+    int fd, int64_t offset, size_t length, int writable, int *error)
+{
+#ifdef _WIN32
+    *error = UV_ENOTSUP;
+    return NULL;
+#else
+    if (length == 0 || offset < 0) {
+        *error = UV_EINVAL;
+        return NULL;
+    }
+
+    size_t delta = (size_t)luv_page_offset((uintptr_t)offset);
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    char *address =
+        mmap(
+            NULL, length + delta, protection, MAP_SHARED, fd,
+            (off_t)(offset - (int64_t)delta));
+    if (address == MAP_FAILED) {
+        *error = -errno;
+        return NULL;
+    }
+
+    *error = 0;
+    return address + delta;
+#endif
+}
+
+int luv_munmap(void *address, size_t length)
+{
+#ifdef _WIN32
+    return UV_ENOTSUP;
+#else
+    uintptr_t delta = luv_page_offset((uintptr_t)address);
+    if (munmap((char*)address - delta, length + delta) == -1)
+        return -errno;
+    return 0;
+#endif
+}
+
+typedef struct {
+    void *address;
+    size_t length;
+    int operation;
+    int parameter;
+    int result;
+} luv_mapping_request_t;
+
+static void luv_mapping_work(void *argument)
+{
+    luv_mapping_request_t *request = argument;
+
+#ifdef _WIN32
+    request->result = UV_ENOTSUP;
+#else
+    uintptr_t delta = luv_page_offset((uintptr_t)request->address);
+    char *address = (char*)request->address - delta;
+    size_t length = request->length + delta;
+    int result;
+
+    if (request->operation == LUV_MAPPING_SYNC) {
+        int flags = request->parameter ? MS_SYNC | MS_INVALIDATE : MS_SYNC;
+        result = msync(address, length, flags);
+    }
+    else {
+        int advice;
+        switch (request->parameter) {
+        case LUV_ADVICE_RANDOM: advice = MADV_RANDOM; break;
+        case LUV_ADVICE_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+        case LUV_ADVICE_WILLNEED: advice = MADV_WILLNEED; break;
+        case LUV_ADVICE_DONTNEED: advice = MADV_DONTNEED; break;
+        default: advice = MADV_NORMAL; break;
+        }
+        result = madvise(address, length, advice);
+    }
+
+    request->result = result == -1 ? -errno : 0;
+#endif
+}
+
+void* luv_mapping_request(
+    void *address, size_t length, int operation, int parameter)
+{
+    luv_mapping_request_t *request = malloc(sizeof(luv_mapping_request_t));
+    if (request == NULL)
+        return NULL;
+
+    request->address = address;
+    request->length = length;
+    request->operation = operation;
+    request->parameter = parameter;
+    request->result = 0;
+
+    return request;
+}
+
+intnat luv_get_mapping_work(void)
+{
+    return (intnat)luv_mapping_work;
+}
+
+int luv_mapping_result(void *request)
+{
+    int result = ((luv_mapping_request_t*)request)->result;
+    free(request);
+    return result;
+}
+
+
+
+// Batched thread pool work.
+//
+// luv_queue_batch queues count jobs on the thread pool, using requests that
+// are allocated together with the batch in one block. The GC root points to a
+// pair of an array of OCaml jobs, and a completion callback. Completions of
+// individual jobs are only counted, and don't take the runtime lock. The
+// callback is called once, after the last job has completed.
+
+typedef struct {
+    value *gc_root;
+    unsigned int remaining;
+    int status;
+    uv_work_t requests[];
+} luv_work_batch_t;
+
+static void luv_batch_work_trampoline(uv_work_t *c_request)
+{
+    luv_work_batch_t *batch = uv_req_get_data((uv_req_t*)c_request);
+    size_t index = (size_t)(c_request - batch->requests);
+
+    caml_c_thread_register();
+    caml_acquire_runtime_system();
+
+    value job = Field(Field(*batch->gc_root, 0), index);
+    caml_callback(job, Val_unit);
+
+    caml_release_runtime_system();
+    caml_c_thread_unregister();
+}
+
+static void luv_batch_after_work_trampoline(uv_work_t *c_request, int status)
+{
+    luv_work_batch_t *batch = uv_req_get_data((uv_req_t*)c_request);
+    if (status < 0 && batch->status == 0)
+        batch->status = status;
+    if (--batch->remaining > 0)
+        return;
+
+    // The batch is freed only after the callback, so that its address, which
+    // identifies the batch in traces, can't be reused by then.
+    value *gc_root = batch->gc_root;
+    luv_acquire_runtime_system();
+    value callback = Field(*gc_root, 1);
+    caml_remove_generational_global_root(gc_root);
+    caml_stat_free(gc_root);
+    TIMED_CALLBACK(
+        c_request->loop, UV_HANDLE_TYPE_MAX + UV_WORK, batch,
+        caml_callback(callback, Val_int(batch->status)));
+    caml_release_runtime_system();
+
+    free(batch);
+}
+
+int luv_queue_batch(uv_loop_t *loop, unsigned int count, void *gc_root)
+{
+    luv_work_batch_t *batch =
+        malloc(sizeof(luv_work_batch_t) + count * sizeof(uv_work_t));
+    if (batch == NULL)
+        return UV_ENOMEM;
+
+    batch->gc_root = gc_root;
+    batch->remaining = count;
+    batch->status = 0;
+
+    // Completions are only counted once control returns to the loop, so it is
+    // safe to adjust the count after queueing some of the jobs.
+    for (unsigned int index = 0; index < count; ++index) {
+        uv_work_t *c_request = &batch->requests[index];
+        uv_req_set_data((uv_req_t*)c_request, batch);
+        int result =
+            uv_queue_work(
+                loop, c_request, luv_batch_work_trampoline,
+                luv_batch_after_work_trampoline);
+        if (result < 0) {
+            if (index == 0) {
+                free(batch);
+                return result;
+            }
+            batch->status = result;
+            batch->remaining = index;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+
+// C work pipelines.
+//
+// A pipeline is a fixed sequence of C stages, each of type
+// int (*)(void *argument), and a fixed number of slots. Running the pipeline in
+// a slot calls the stages one after another on the same worker thread, each
+// with the same argument, stopping early if a stage returns a negative error
+// code. Everything a run needs is preallocated in its slot, so running doesn't
+// allocate. The OCaml callback, stored once for the whole pipeline, is called
+// after each run with the slot index, the index of the last stage called, and
+// that stage's return value.
+
+typedef int (*luv_stage_t)(void *argument);
+
+typedef struct luv_pipeline_s luv_pipeline_t;
+
+typedef struct {
+    uv_work_t request;
+    luv_pipeline_t *pipeline;
+    void *argument;
+    unsigned int stage;
+    int result;
+    uint64_t queued_at;
+    uint64_t started_at;
+} luv_pipeline_slot_t;
+
+struct luv_pipeline_s {
+    uv_loop_t *loop;
+    value *gc_root;
+    unsigned int stage_count;
+    luv_stage_t *stages;
+    luv_pipeline_slot_t slots[];
+};
+
+static void luv_pipeline_work(uv_work_t *c_request)
+{
+    luv_pipeline_slot_t *slot = (luv_pipeline_slot_t*)c_request;
+    luv_pipeline_t *pipeline = slot->pipeline;
+
+    if (slot->queued_at != 0)
+        slot->started_at = uv_hrtime();
+
+    slot->result = 0;
+    for (slot->stage = 0; slot->stage < pipeline->stage_count; ++slot->stage) {
+        slot->result = pipeline->stages[slot->stage](slot->argument);
+        if (slot->result < 0)
+            return;
+    }
+    slot->stage = pipeline->stage_count - 1;
+}
+
+static void luv_pipeline_after_work(uv_work_t *c_request, int status)
+{
+    luv_pipeline_slot_t *slot = (luv_pipeline_slot_t*)c_request;
+    luv_pipeline_t *pipeline = slot->pipeline;
+    int result = status < 0 ? status : slot->result;
+
+    luv_instrumentation_record_wait(
+        pipeline->loop, slot->queued_at, slot->started_at);
+
+    luv_acquire_runtime_system();
+    value callback = *pipeline->gc_root;
+    TIMED_REQUEST_CALLBACK(pipeline->loop,
+        caml_callback3(
+            callback, Val_long(slot - pipeline->slots), Val_int(slot->stage),
+            Val_int(result)));
+    caml_release_runtime_system();
+}
+
+void* luv_pipeline_create(
+    uv_loop_t *loop, intnat *stages, unsigned int stage_count,
+    unsigned int slot_count, void *gc_root)
+{
+    if (stage_count == 0 || slot_count == 0)
+        return NULL;
+
+    luv_pipeline_t *pipeline =
+        malloc(
+            sizeof(luv_pipeline_t) + slot_count * sizeof(luv_pipeline_slot_t));
+    if (pipeline == NULL)
+        return NULL;
+
+    pipeline->stages = malloc(stage_count * sizeof(luv_stage_t));
+    if (pipeline->stages == NULL) {
+        free(pipeline);
+        return NULL;
+    }
+
+    pipeline->loop = loop;
+    pipeline->gc_root = gc_root;
+    pipeline->stage_count = stage_count;
+    for (unsigned int index = 0; index < stage_count; ++index)
+        pipeline->stages[index] = (luv_stage_t)stages[index];
+    for (unsigned int index = 0; index < slot_count; ++index)
+        pipeline->slots[index].pipeline = pipeline;
+
+    return pipeline;
+}
+
+int luv_pipeline_run(void *pipeline, unsigned int slot, intnat argument)
+{
+    luv_pipeline_t *c_pipeline = pipeline;
+    luv_pipeline_slot_t *c_slot = &c_pipeline->slots[slot];
+    c_slot->argument = (void*)argument;
+    c_slot->stage = 0;
+    c_slot->queued_at = luv_instrumentation_start(c_pipeline->loop);
+    c_slot->started_at = 0;
+    return
+        uv_queue_work(
+            c_pipeline->loop, &c_slot->request, luv_pipeline_work,
+            luv_pipeline_after_work);
+}
+
+void luv_pipeline_destroy(void *pipeline)
+{
+    free(((luv_pipeline_t*)pipeline)->stages);
+    free(pipeline);
+}
+
+
+
+// Channels.
+//
+// A channel is a lock-free stack of messages, each a GC root, pushed by any
+// number of threads and popped only by the loop thread. Producers push with a
+// compare-and-swap on the head of the stack. The loop thread takes the whole
+// stack at once with an exchange, and reverses it, so that messages are popped
+// in the order they were pushed. Only the first push after the loop thread
+// starts draining calls uv_async_send, so a burst of messages costs one wakeup.
+// Each drain takes the stack only once, so messages pushed while it runs are
+// left for the next wakeup, and a busy producer can't keep the loop thread in
+// one callback indefinitely. The push and the wakeup flag are ordered
+// sequentially consistently on both sides, so a producer that sees a wakeup
+// already pending knows its message will be taken by the drain that clears the
+// flag.
+
+typedef struct luv_channel_node_s {
+    struct luv_channel_node_s *next;
+    void *gc_root;
+} luv_channel_node_t;
+
+typedef struct {
+    uv_async_t *async;
+    luv_channel_node_t *head;
+    luv_channel_node_t *taken;
+    int wakeup_pending;
+} luv_channel_t;
+
+void* luv_channel_create(uv_async_t *async)
+{
+    luv_channel_t *channel = malloc(sizeof(luv_channel_t));
+    if (channel == NULL)
+        return NULL;
+
+    channel->async = async;
+    channel->head = NULL;
+    channel->taken = NULL;
+    channel->wakeup_pending = 0;
+
+    return channel;
+}
+
+int luv_channel_push(void *channel, void *gc_root)
+{
+    luv_channel_t *c_channel = channel;
+
+    luv_channel_node_t *node = malloc(sizeof(luv_channel_node_t));
+    if (node == NULL)
+        return UV_ENOMEM;
+    node->gc_root = gc_root;
+
+    node->next = __atomic_load_n(&c_channel->head, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(
+        &c_channel->head, &node->next, node, 1,
+        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+    }
+
+    if (__atomic_exchange_n(&c_channel->wakeup_pending, 1, __ATOMIC_SEQ_CST))
+        return 0;
+    return uv_async_send(c_channel->async);
+}
+
+void luv_channel_take(void *channel)
+{
+    luv_channel_t *c_channel = channel;
+
+    __atomic_store_n(&c_channel->wakeup_pending, 0, __ATOMIC_SEQ_CST);
+
+    luv_channel_node_t *node =
+        __atomic_exchange_n(&c_channel->head, NULL, __ATOMIC_SEQ_CST);
+    luv_channel_node_t *taken = NULL;
+    while (node != NULL) {
+        luv_channel_node_t *next = node->next;
+        node->next = taken;
+        taken = node;
+        node = next;
+    }
+
+    luv_channel_node_t **tail = &c_channel->taken;
+    while (*tail != NULL)
+        tail = &(*tail)->next;
+    *tail = taken;
+}
+
+void* luv_channel_pop(void *channel)
+{
+    luv_channel_t *c_channel = channel;
+
+    luv_channel_node_t *node = c_channel->taken;
+    if (node == NULL)
+        return NULL;
+
+    void *gc_root = node->gc_root;
+    c_channel->taken = node->next;
+    free(node);
+
+    return gc_root;
+}
+
+void luv_channel_destroy(void *channel)
+{
+    free(channel);
+}
+
+
+
+
+
+// Loop instrumentation.
+//
+// When enabled on a loop, the instrumentation hangs off the loop's data
+// pointer. Trampolines time each call into OCaml, and record it in a histogram
+// for the type of the handle or request that the callback is for. An unref'd
+// prepare and check handle pair bracket each poll phase: the time between them,
+// minus the time spent in I/O callbacks called during poll, is time blocked in
+// the kernel. The rest of each iteration is its lag, the longest that a newly
+// ready event could have waited for the loop to notice it. Thread pool requests
+// carry the times at which they were queued and started, and their wait is
+// recorded by their after-work callbacks, so all recording happens on the loop
+// thread.
+//
+// Histograms are log-linear: values below 8 ns have their own buckets, and
+// every further power of two is split into 8 buckets, so each bucket is within
+// 12.5% of the values it holds.
+
+typedef struct {
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[LUV_HISTOGRAM_BUCKETS];
+} luv_histogram_t;
+
+typedef struct luv_instrumentation_s {
+    uv_prepare_t prepare;
+    uv_check_t check;
+    int open_handles;
+    uint64_t poll_started_at;
+    uint64_t callback_time_at_poll;
+    uint64_t blocked;
+    uint64_t iterations;
+    uint64_t poll_time;
+    uint64_t callback_time;
+    luv_histogram_t histograms[LUV_INSTRUMENTATION_HISTOGRAMS];
+} luv_instrumentation_t;
+
+static luv_instrumentation_t* luv_loop_instrumentation(uv_loop_t *loop)
+{
+    luv_loop_state_t *state = luv_loop_state(loop, 0);
+    return state == NULL ? NULL : state->instrumentation;
+}
+
+static int luv_histogram_index(uint64_t duration)
+{
+    int shift = 0;
+    while (duration >= 2 * LUV_HISTOGRAM_SUB_BUCKETS) {
+        duration >>= 1;
+        ++shift;
+    }
+    if (duration < LUV_HISTOGRAM_SUB_BUCKETS)
+        return (int)duration;
+    return
+        (shift + 1) * LUV_HISTOGRAM_SUB_BUCKETS +
+        (int)duration - LUV_HISTOGRAM_SUB_BUCKETS;
+}
+
+static void luv_histogram_record(luv_histogram_t *histogram, uint64_t duration)
+{
+    if (histogram->count == 0 || duration < histogram->min)
+        histogram->min = duration;
+    if (duration > histogram->max)
+        histogram->max = duration;
+    ++histogram->count;
+    histogram->total += duration;
+    ++histogram->buckets[luv_histogram_index(duration)];
+}
+
+static int luv_tracing_enabled(void);
+static void luv_trace_record(
+    int kind, void *object, uint64_t start, uint64_t end);
+
+static uint64_t luv_instrumentation_start(uv_loop_t *loop)
+{
+    if (luv_loop_instrumentation(loop) == NULL && !luv_tracing_enabled())
+        return 0;
+    return uv_hrtime();
+}
+
+static void luv_instrumentation_record(
+    uv_loop_t *loop, int kind, void *object, uint64_t start)
+{
+    if (start == 0)
+        return;
+
+    uint64_t end = uv_hrtime();
+
+    if (luv_tracing_enabled())
+        luv_trace_record(kind, object, start, end);
+
+    luv_instrumentation_t *instrumentation = luv_loop_instrumentation(loop);
+    if (instrumentation == NULL)
+        return;
+
+    instrumentation->callback_time += end - start;
+    luv_histogram_record(&instrumentation->histograms[kind], end - start);
+}
+
+static void luv_instrumentation_record_wait(
+    uv_loop_t *loop, uint64_t queued_at, uint64_t started_at)
+{
+    luv_instrumentation_t *instrumentation = luv_loop_instrumentation(loop);
+    if (instrumentation == NULL || queued_at == 0 || started_at < queued_at)
+        return;
+
+    luv_histogram_record(
+        &instrumentation->histograms[LUV_INSTRUMENTATION_WORK_WAIT],
+        started_at - queued_at);
+}
+
+static void luv_instrumentation_prepare(uv_prepare_t *prepare)
+{
+    luv_instrumentation_t *instrumentation =
+        uv_handle_get_data((uv_handle_t*)prepare);
+    uint64_t now = uv_hrtime();
+
+    if (instrumentation->poll_started_at != 0) {
+        luv_histogram_record(
+            &instrumentation->histograms[LUV_INSTRUMENTATION_LAG],
+            now - instrumentation->poll_started_at - instrumentation->blocked);
+    }
+
+    instrumentation->poll_started_at = now;
+    instrumentation->callback_time_at_poll = instrumentation->callback_time;
+}
+
+static void luv_instrumentation_check(uv_check_t *check)
+{
+    luv_instrumentation_t *instrumentation =
+        uv_handle_get_data((uv_handle_t*)check);
+
+    if (instrumentation->poll_started_at == 0)
+        return;
+
+    uint64_t in_poll = uv_hrtime() - instrumentation->poll_started_at;
+    uint64_t in_callbacks =
+        instrumentation->callback_time -
+        instrumentation->callback_time_at_poll;
+
+    instrumentation->blocked =
+        in_poll > in_callbacks ? in_poll - in_callbacks : 0;
+    instrumentation->poll_time += instrumentation->blocked;
+    ++instrumentation->iterations;
+}
+
+static void luv_instrumentation_closed(uv_handle_t *handle)
+{
+    luv_instrumentation_t *instrumentation = uv_handle_get_data(handle);
+    if (--instrumentation->open_handles == 0)
+        free(instrumentation);
+}
+
+int luv_instrumentation_enable(uv_loop_t *loop)
+{
+    luv_loop_state_t *state = luv_loop_state(loop, 1);
+    if (state == NULL)
+        return UV_ENOMEM;
+    if (state->instrumentation != NULL)
+        return 0;
+
+    luv_instrumentation_t *instrumentation =
+        calloc(1, sizeof(luv_instrumentation_t));
+    if (instrumentation == NULL)
+        return UV_ENOMEM;
+
+    uv_prepare_init(loop, &instrumentation->prepare);
+    uv_check_init(loop, &instrumentation->check);
+    uv_handle_set_data(
+        (uv_handle_t*)&instrumentation->prepare, instrumentation);
+    uv_handle_set_data((uv_handle_t*)&instrumentation->check, instrumentation);
+    instrumentation->open_handles = 2;
+
+    uv_prepare_start(&instrumentation->prepare, luv_instrumentation_prepare);
+    uv_check_start(&instrumentation->check, luv_instrumentation_check);
+    uv_unref((uv_handle_t*)&instrumentation->prepare);
+    uv_unref((uv_handle_t*)&instrumentation->check);
+
+    state->instrumentation = instrumentation;
+
+    return 0;
+}
+
+void luv_instrumentation_disable(uv_loop_t *loop)
+{
+    luv_instrumentation_t *instrumentation = luv_loop_instrumentation(loop);
+    if (instrumentation == NULL)
+        return;
+
+    luv_loop_state(loop, 0)->instrumentation = NULL;
+    uv_close(
+        (uv_handle_t*)&instrumentation->prepare, luv_instrumentation_closed);
+    uv_close(
+        (uv_handle_t*)&instrumentation->check, luv_instrumentation_closed);
+}
+
+int luv_instrumentation_read(
+    uv_loop_t *loop, uint64_t *totals, uint64_t *histograms, int reset)
+{
+    luv_instrumentation_t *instrumentation = luv_loop_instrumentation(loop);
+    if (instrumentation == NULL)
+        return UV_EINVAL;
+
+    totals[0] = instrumentation->iterations;
+    totals[1] = instrumentation->poll_time;
+    totals[2] = instrumentation->callback_time;
+
+    for (int index = 0; index < LUV_INSTRUMENTATION_HISTOGRAMS; ++index) {
+        luv_histogram_t *histogram = &instrumentation->histograms[index];
+        uint64_t *out = histograms + index * LUV_INSTRUMENTATION_HISTOGRAM_SIZE;
+        out[0] = histogram->count;
+        out[1] = histogram->total;
+        out[2] = histogram->min;
+        out[3] = histogram->max;
+        memcpy(out + 4, histogram->buckets, sizeof(histogram->buckets));
+    }
+
+    if (reset) {
+        instrumentation->iterations = 0;
+        instrumentation->poll_time = 0;
+        // Keeps the difference taken by luv_instrumentation_check correct if
+        // the reset happens during poll. The subtraction may wrap around.
+        instrumentation->callback_time_at_poll -=
+            instrumentation->callback_time;
+        instrumentation->callback_time = 0;
+        memset(
+            instrumentation->histograms, 0,
+            sizeof(instrumentation->histograms));
+    }
+
+    return 0;
+}
+
+
+
+// Tracing.
+//
+// While tracing is on, each timed callback is also recorded as an event in a
+// ring buffer belonging to the thread that called it. Each thread writes only
+// to its own ring, which it allocates the first time it records an event, so
+// threads don't contend with each other. The mutex of each ring is taken by
+// its own thread to record, and by luv_trace_read to copy events out. Rings
+// outlive their threads, so that events from finished threads can still be
+// read. When a ring is full, the oldest events are overwritten.
+//
+// Each ring has a read cursor, below which events have been cleared. Reading
+// with clear advances the cursor only past the events actually copied, so
+// events that didn't fit, or were recorded after the caller counted them, are
+// kept for the next read.
+
+typedef struct {
+    void *object;
+    uint64_t start;
+    uint64_t end;
+    uint64_t lock_wait;
+    int kind;
+} luv_trace_event_t;
+
+typedef struct luv_trace_ring_s {
+    struct luv_trace_ring_s *next;
+    uv_mutex_t mutex;
+    unsigned int thread;
+    uint64_t lock_wait;
+    size_t capacity;
+    size_t written;
+    size_t read;
+    luv_trace_event_t events[];
+} luv_trace_ring_t;
+
+static int luv_tracing = 0;
+static size_t luv_trace_capacity = 0;
+static uv_once_t luv_trace_once = UV_ONCE_INIT;
+static uv_key_t luv_trace_key;
+static int luv_trace_initialized = 0;
+static uv_mutex_t luv_trace_rings_mutex;
+static luv_trace_ring_t *luv_trace_rings = NULL;
+static unsigned int luv_trace_threads = 0;
+
+static int luv_tracing_enabled(void)
+{
+    return __atomic_load_n(&luv_tracing, __ATOMIC_ACQUIRE);
+}
+
+static void luv_trace_initialize(void)
+{
+    if (uv_key_create(&luv_trace_key) != 0)
+        return;
+    if (uv_mutex_init(&luv_trace_rings_mutex) != 0) {
+        uv_key_delete(&luv_trace_key);
+        return;
+    }
+    luv_trace_initialized = 1;
+}
+
+static luv_trace_ring_t* luv_trace_ring(void)
+{
+    luv_trace_ring_t *ring = uv_key_get(&luv_trace_key);
+    if (ring != NULL)
+        return ring;
+
+    size_t capacity = __atomic_load_n(&luv_trace_capacity, __ATOMIC_RELAXED);
+    ring =
+        malloc(sizeof(luv_trace_ring_t) + capacity * sizeof(luv_trace_event_t));
+    if (ring == NULL)
+        return NULL;
+    if (uv_mutex_init(&ring->mutex) != 0) {
+        free(ring);
+        return NULL;
+    }
+    ring->lock_wait = 0;
+    ring->capacity = capacity;
+    ring->written = 0;
+    ring->read = 0;
+
+    uv_mutex_lock(&luv_trace_rings_mutex);
+    ring->thread = ++luv_trace_threads;
+    ring->next = luv_trace_rings;
+    luv_trace_rings = ring;
+    uv_mutex_unlock(&luv_trace_rings_mutex);
+
+    uv_key_set(&luv_trace_key, ring);
+    return ring;
+}
+
+static void luv_acquire_runtime_system(void)
+{
+    if (!luv_tracing_enabled()) {
+        caml_acquire_runtime_system();
+        return;
+    }
+
+    uint64_t start = uv_hrtime();
+    caml_acquire_runtime_system();
+    luv_trace_ring_t *ring = luv_trace_ring();
+    if (ring != NULL)
+        ring->lock_wait = uv_hrtime() - start;
+}
+
+static void luv_trace_record(
+    int kind, void *object, uint64_t start, uint64_t end)
+{
+    luv_trace_ring_t *ring = luv_trace_ring();
+    if (ring == NULL)
+        return;
+
+    uv_mutex_lock(&ring->mutex);
+    luv_trace_event_t *event = &ring->events[ring->written % ring->capacity];
+    event->object = object;
+    event->start = start;
+    event->end = end;
+    event->lock_wait = ring->lock_wait;
+    event->kind = kind;
+    ++ring->written;
+    uv_mutex_unlock(&ring->mutex);
+
+    ring->lock_wait = 0;
+}
+
+int luv_trace_start(size_t capacity)
+{
+    if (capacity == 0)
+        return UV_EINVAL;
+
+    uv_once(&luv_trace_once, luv_trace_initialize);
+    if (!luv_trace_initialized)
+        return UV_ENOMEM;
+
+    // Rings that already exist keep their capacity.
+    __atomic_store_n(&luv_trace_capacity, capacity, __ATOMIC_RELAXED);
+    __atomic_store_n(&luv_tracing, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void luv_trace_stop(void)
+{
+    __atomic_store_n(&luv_tracing, 0, __ATOMIC_RELAXED);
+}
+
+// Index of the oldest event in the ring that has been neither overwritten nor
+// cleared.
+static size_t luv_trace_first(luv_trace_ring_t *ring)
+{
+    size_t first =
+        ring->written > ring->capacity ? ring->written - ring->capacity : 0;
+    return first > ring->read ? first : ring->read;
+}
+
+size_t luv_trace_count(void)
+{
+    if (!luv_trace_initialized)
+        return 0;
+
+    size_t count = 0;
+    uv_mutex_lock(&luv_trace_rings_mutex);
+    for (luv_trace_ring_t *ring = luv_trace_rings; ring; ring = ring->next) {
+        uv_mutex_lock(&ring->mutex);
+        count += ring->written - luv_trace_first(ring);
+        uv_mutex_unlock(&ring->mutex);
+    }
+    uv_mutex_unlock(&luv_trace_rings_mutex);
+
+    return count;
+}
+
+size_t luv_trace_read(uint64_t *events, size_t limit, int clear)
+{
+    if (!luv_trace_initialized)
+        return 0;
+
+    size_t copied = 0;
+    uv_mutex_lock(&luv_trace_rings_mutex);
+    for (luv_trace_ring_t *ring = luv_trace_rings; ring; ring = ring->next) {
+        uv_mutex_lock(&ring->mutex);
+
+        size_t index = luv_trace_first(ring);
+        for (; index < ring->written && copied < limit; ++index, ++copied) {
+
+            luv_trace_event_t *event = &ring->events[index % ring->capacity];
+            uint64_t *out = events + copied * LUV_TRACE_EVENT_SIZE;
+            out[0] = ring->thread;
+            out[1] = (uint64_t)event->kind;
+            out[2] = (uint64_t)(uintptr_t)event->object;
+            out[3] = event->start;
+            out[4] = event->end;
+            out[5] = event->lock_wait;
+        }
+
+        if (clear)
+            ring->read = index;
+
+        uv_mutex_unlock(&ring->mutex);
+    }
+    uv_mutex_unlock(&luv_trace_rings_mutex);
+
+    return copied;
+}
+
+
+
+// Sharded servers.
+//
+// Since libuv 1.49, uv_tcp_bind sets SO_REUSEPORT when passed UV_TCP_REUSEPORT,
+// so that a listener on each of several loops can bind the same address, and
+// the kernel spreads incoming connections between them. With older libuv,
+// luv_tcp_bind does the same on Linux, the one system on which plain
+// SO_REUSEPORT balances connections. It opens the socket itself, if the handle
+// doesn't have one yet, so that it can set the option before binding.
+//
+// A connection is handed off to another loop by duplicating its socket. The
+// original handle is then closed on its own loop, and the duplicate is opened
+// in a new handle on the other loop.
+
+int luv_tcp_bind(
+    uv_tcp_t *tcp, const struct sockaddr *address, unsigned int flags)
+{
+#if UV_VERSION_MAJOR == 1 && UV_VERSION_MINOR < 49
+    if (flags & UV_TCP_REUSEPORT) {
+#if !defined(__linux__) || !defined(SO_REUSEPORT)
+        return UV_ENOTSUP;
+#else
+        uv_os_fd_t fd;
+        if (uv_fileno((uv_handle_t*)tcp, &fd) == UV_EBADF) {
+            fd = socket(address->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd == -1)
+                return -errno;
+            int result = uv_tcp_open(tcp, fd);
+            if (result < 0) {
+                close(fd);
+                return result;
+            }
+        }
+
+        int enable = 1;
+        if (setsockopt(
+                fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1) {
+            return -errno;
+        }
+
+        flags &= ~UV_TCP_REUSEPORT;
+#endif
+    }
+#endif
+
+    return uv_tcp_bind(tcp, address, flags);
+}
+
+int luv_tcp_duplicate_socket(uv_tcp_t *tcp, uv_os_sock_t *socket)
+{
+#ifdef _WIN32
+    return UV_ENOTSUP;
+#else
+    uv_os_fd_t fd;
+    int result = uv_fileno((uv_handle_t*)tcp, &fd);
+    if (result < 0)
+        return result;
+
+    result = dup(fd);
+    if (result == -1)
+        return -errno;
+
+    *socket = result;
+    return 0;
+#endif
+}
+
+void luv_close_socket(uv_os_sock_t socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+
+
+// Batched accepts.
+//
+// libuv calls the connection callback of a listener once for each connection
+// it accepts, and expects the callback to accept it into a new handle. With
+// luv_tcp_listen_batch, the connection callback instead accepts the connection
+// into the next of the client handles preallocated by OCaml, and then drains
+// the rest of the listener's accept queue with accept(2), opening each
+// connection in another preallocated handle. The OCaml callback is then called
+// once with the whole batch. On Windows, each connection is delivered as a
+// batch of one.
+//
+// The client handle pointers and their statuses are arrays allocated by OCaml,
+// which keeps them alive until the listener is closed, and replaces each
+// delivered handle before the next batch.
+
+typedef struct {
+    luv_attachment_t attachment;
+    uv_tcp_t **clients;
+    int *statuses;
+    size_t capacity;
+    size_t count;
+} luv_accept_batch_t;
+
+static void luv_deliver_accept_batch(
+    uv_stream_t *c_handle, luv_accept_batch_t *batch, int status)
+{
+    luv_acquire_runtime_system();
+
+    value callback;
+    GET_HANDLE_CALLBACK(LUV_CONNECTION_CALLBACK);
+
+    batch->attachment.in_callback = 1;
+    TIMED_HANDLE_CALLBACK(
+        caml_callback2(
+            callback, Val_int(status), Val_int((int)batch->count)));
+    batch->attachment.in_callback = 0;
+
+    if (batch->attachment.detached)
+        free(batch);
+    else
+        batch->count = 0;
+
+    caml_release_runtime_system();
+}
+
+#ifndef _WIN32
+// Returns an accepted socket, or a negative error code. UV_EAGAIN means that
+// the accept queue is empty.
+static int luv_accept_socket(int listener)
+{
+    for (;;) {
+#ifdef __linux__
+        int connection =
+            accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int connection = accept(listener, NULL, NULL);
+        if (connection != -1)
+            fcntl(connection, F_SETFD, FD_CLOEXEC);
+#endif
+        if (connection != -1)
+            return connection;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return UV_EAGAIN;
+        if (errno != EINTR && errno != ECONNABORTED)
+            return -errno;
+    }
+}
+#endif
+
+static void luv_accept_batch_trampoline(uv_stream_t *c_handle, int status)
+{
+    luv_accept_batch_t *batch =
+        (luv_accept_batch_t*)luv_find_attachment((uv_handle_t*)c_handle);
+    if (batch == NULL)
+        return;
+
+    if (status < 0) {
+        luv_deliver_accept_batch(c_handle, batch, status);
+        return;
+    }
+
+    uv_tcp_t *client = batch->clients[batch->count];
+    status = uv_tcp_init(c_handle->loop, client);
+    if (status < 0) {
+        luv_deliver_accept_batch(c_handle, batch, status);
+        return;
+    }
+    batch->statuses[batch->count++] =
+        uv_accept(c_handle, (uv_stream_t*)client);
+
+#ifndef _WIN32
+    uv_os_fd_t listener;
+    if (uv_fileno((uv_handle_t*)c_handle, &listener) == 0) {
+        while (batch->count < batch->capacity) {
+            int connection = luv_accept_socket(listener);
+            if (connection < 0)
+                break;
+
+            client = batch->clients[batch->count];
+            if (uv_tcp_init(c_handle->loop, client) < 0) {
+                close(connection);
+                break;
+            }
+
+            int result = uv_tcp_open(client, connection);
+            if (result < 0)
+                close(connection);
+            batch->statuses[batch->count++] = result;
+        }
+    }
+#endif
+
+    luv_deliver_accept_batch(c_handle, batch, 0);
+}
+
+int luv_tcp_listen_batch(
+    uv_tcp_t *server, int backlog, uv_tcp_t **clients, int *statuses,
+    size_t capacity)
+{
+    luv_accept_batch_t *batch = malloc(sizeof(luv_accept_batch_t));
+    if (batch == NULL)
+        return UV_ENOMEM;
+
+    batch->attachment.release = NULL;
+    batch->clients = clients;
+    batch->statuses = statuses;
+    batch->capacity = capacity;
+    batch->count = 0;
+
+    // The batch is attached first, because attaching can fail, and a successful
+    // uv_listen can't be undone, while attaching can.
+    int result = luv_attach((uv_handle_t*)server, &batch->attachment);
+    if (result < 0) {
+        free(batch);
+        return result;
+    }
+
+    result =
+        uv_listen((uv_stream_t*)server, backlog, luv_accept_batch_trampoline);
+    if (result < 0) {
+        luv_attach((uv_handle_t*)server, NULL);
+        return result;
+    }
+
+    return 0;
+}
+
+
+
+
+
+// Warning-suppressing wrappers.
+
+char* luv_version_string(void)
+{
+    return (char*)uv_version_string();
+}
+
+char* luv_req_type_name(uv_req_type type)
+{
+    return (char*)uv_req_type_name(type);
+}
+
+char* luv_fs_get_path(const uv_fs_t *req)
+{
+    return (char*)uv_fs_get_path(req);
+}
+
+char* luv_dlerror(const uv_lib_t *lib)
+{
+    return (char*)uv_dlerror(lib);
+}
+
+char* luv_instrumentation_kind_name(int kind)
+{
+    if (kind < UV_HANDLE_TYPE_MAX)
+        return (char*)uv_handle_type_name((uv_handle_type)kind);
+    if (kind < LUV_INSTRUMENTATION_LAG)
+        return
+            (char*)uv_req_type_name((uv_req_type)(kind - UV_HANDLE_TYPE_MAX));
+    return NULL;
+}
+
+int luv_fs_event_start(
+    uv_fs_event_t *handle, luv_fs_event_cb cb, const char *path,
+    unsigned int flags)
+{
+    return uv_fs_event_start(handle, (uv_fs_event_cb)cb, path, flags);
+}
+
+int luv_fs_poll_start(
+    uv_fs_poll_t *handle, luv_fs_poll_cb poll_cb, const char *path,
+    unsigned int interval)
+{
+    return uv_fs_poll_start(handle, (uv_fs_poll_cb)poll_cb, path, interval);
+}
+
+int luv_read_start(
+    uv_stream_t *stream, uv_alloc_cb alloc_cb, luv_read_cb read_cb)
+{
+    return uv_read_start(stream, alloc_cb, (uv_read_cb)read_cb);
+}
+
+int luv_udp_recv_start(
+    uv_udp_t *handle, uv_alloc_cb alloc_cb, luv_udp_recv_cb recv_cb)
+{
+    return uv_udp_recv_start(handle, alloc_cb, (uv_udp_recv_cb)recv_cb);
+}
+
+int luv_os_uname(char *buffer)
+{
+    return uv_os_uname((uv_utsname_t*)buffer);
+}
+
+
+
+// String conversion functions.
+
+size_t luv_utf16_length_as_wtf8(const char *utf16, ssize_t utf16_len)
+{
+    return uv_utf16_length_as_wtf8((const uint16_t*)utf16, utf16_len);
+}
+
+int luv_utf16_to_wtf8(
+    const char *utf16, ssize_t utf16_len, char **wtf8_ptr,
+    size_t *wtf8_len_ptr)
+{
+    return
+        uv_utf16_to_wtf8(
+            (const uint16_t*)utf16, utf16_len, wtf8_ptr, wtf8_len_ptr);
+}
+
+
+
+// Other helpers.
+
+char* luv_version_suffix(void)
+{
+    return UV_VERSION_SUFFIX;
+}
+
+int luv_spawn(
+    uv_loop_t *loop,
+    uv_process_t *handle,
+    uv_exit_cb exit_cb,
+    const char *file,
+    char **args,
+    int arg_count,
+    char **env,
+    int env_count,
+    int set_env,
+    const char *cwd,
+    int do_cwd,
+    int flags,
+    int stdio_count,
+    uv_stdio_container_t *stdio,
+    int uid,
+    int gid)
+{
+    args[arg_count] = NULL;
+
+    if (set_env)
+        env[env_count] = NULL;
+    else
+        env = NULL;
+
+    if (do_cwd == 0)
+        cwd = NULL;
+
+    uv_process_options_t options;
+    options.exit_cb = exit_cb;
+    options.file = file;
+    options.args = args;
+    options.env = env;
+    options.cwd = cwd;
+    options.flags = flags;
+    options.stdio_count = stdio_count;
+    options.stdio = stdio;
+    options.uid = uid;
+    options.gid = gid;
+
+    caml_release_runtime_system();
+    int result = uv_spawn(loop, handle, &options);
+    caml_acquire_runtime_system();
+
+    return result;
+}
+
+int luv_is_invalid_handle_value(uv_os_fd_t handle)
+{
+    if (handle == (uv_os_fd_t)-1)
+        return 1;
+    else
+        return 0;
+}
+
+int luv_is_invalid_socket_value(uv_os_sock_t socket)
+{
+    if (socket == -1)
+        return 1;
+    else
+        return 0;
+}
+
+int luv_sa_family_to_int(sa_family_t family)
+{
+    return family;
+}
+
+int luv_dup(int fd)
+{
+#ifdef _WIN32
+    return UV_ENOTSUP;
+#else
+    int result = dup(fd);
+    if (result == -1)
+        return -errno;
+    return result;
+#endif
 }
@@ -123,20 +123,228 @@ enum {
     LUV_UDP_REFERENCE_COUNT
 };
 
-// Thread pool requests store one extra callback over normal requests.
+// Thread pool requests store one extra callback over normal requests, and the
+// times at which they were queued and started, as OCaml ints, for loop
+// instrumentation.
 enum {
     LUV_WORK_FUNCTION = LUV_MINIMUM_REFERENCE_COUNT,
+    LUV_WORK_QUEUED_AT,
+    LUV_WORK_STARTED_AT,
     LUV_WORK_REFERENCE_COUNT
 };
 
 
 
+// Loops. luv_loop_close is uv_loop_close, but also frees the C state that Luv
+// keeps for the loop.
+int luv_loop_close(uv_loop_t *loop);
+
+
+
+// Framed reads. luv_read_frames_start starts reading a stream, but calls the
+// OCaml read callback only once per complete frame. The callback is stored in
+// the LUV_GENERIC_CALLBACK slot, and is called with an error code and a frame
+// option.
+enum {
+    LUV_FRAMING_LENGTH_PREFIXED,
+    LUV_FRAMING_DELIMITED
+};
+
+int luv_read_frames_start(
+    uv_stream_t *stream, int framing, unsigned int parameter,
+    size_t max_frame_size);
+
+
+
+// Batched UDP receive. luv_udp_recv_batch_start reads datagrams into a single
+// buffer, made of capacity slots of LUV_UDP_BATCH_DATAGRAM_SIZE bytes each. For
+// each batch, it fills in LUV_UDP_BATCH_INFO_FIELDS integers per datagram in
+// info, and a struct sockaddr_storage per datagram in peers, then calls the
+// OCaml callback in LUV_GENERIC_CALLBACK with an error code and the number of
+// datagrams in the batch.
+#define LUV_UDP_BATCH_DATAGRAM_SIZE (64 * 1024)
+
+enum {
+    LUV_UDP_BATCH_OFFSET,
+    LUV_UDP_BATCH_LENGTH,
+    LUV_UDP_BATCH_PARTIAL,
+    LUV_UDP_BATCH_INFO_FIELDS
+};
+
+int luv_udp_recv_batch_start(
+    uv_udp_t *handle, char *buffer, size_t capacity, int32_t *info,
+    char *peers);
+
+
+
+// Batched UDP send. Sends count datagrams with as few system calls as possible.
+// Datagram i consists of the next buffer_counts[i] buffers. Returns the number
+// of datagrams sent, or an error code if none were sent.
+int luv_udp_try_send_batch(
+    uv_udp_t *handle, unsigned int count, uv_buf_t *buffers,
+    unsigned int *buffer_counts, struct sockaddr **addresses);
+
+
+
+// Splice proxies. luv_proxy_start moves data between two stream sockets in both
+// directions in C, using splice(2) on Linux. callback is a GC root pointing to
+// an OCaml function, which is called once with an error code and the number of
+// bytes moved in each direction, and then released. Returns UV_ENOTSUP on other
+// systems.
+int luv_proxy_start(uv_stream_t *first, uv_stream_t *second, void *callback);
+
+
+
+// Writability waits. luv_writable_create watches a duplicate of the socket of
+// a stream, and stores the waiter in result. callback is a GC root pointing to
+// an OCaml function, which is called with a status each time a wait started by
+// luv_writable_wait completes, or with UV_ECANCELED if the stream is closed
+// during a wait. luv_writable_close stops the waiter, which is then freed in C.
+// The GC root remains owned by the caller.
+int luv_writable_create(uv_stream_t *stream, void *callback, void **result);
+int luv_writable_wait(void *waiter);
+void luv_writable_close(void *waiter);
+
+
+
+// Memory-mapped files. luv_mmap maps length bytes of fd starting at offset,
+// which need not be page-aligned. luv_munmap takes the same address and length.
+// Syncing and advice run on the thread pool: luv_mapping_request allocates the
+// argument for the work function returned by luv_get_mapping_work, and
+// luv_mapping_result returns its result and frees it.
+enum {
+    LUV_MAPPING_SYNC,
+    LUV_MAPPING_ADVISE
+};
+
+enum {
+    LUV_ADVICE_NORMAL,
+    LUV_ADVICE_RANDOM,
+    LUV_ADVICE_SEQUENTIAL,
+    LUV_ADVICE_WILLNEED,
+    LUV_ADVICE_DONTNEED
+};
+
+void* luv_mmap(
+    int fd, int64_t offset, size_t length, int writable, int *error);
+int luv_munmap(void *address, size_t length);
+void* luv_mapping_request(
+    void *address, size_t length, int operation, int parameter);
+intnat luv_get_mapping_work(void);
+int luv_mapping_result(void *request);
+
+
+
+// Batched thread pool work. gc_root points to a pair of an array of count OCaml
+// functions, each run in the thread pool, and an OCaml function, called once
+// with an error code after all of them have completed. The root is released by
+// the helper, unless it returns an error.
+int luv_queue_batch(uv_loop_t *loop, unsigned int count, void *gc_root);
+
+
+
+// C work pipelines. A pipeline runs a fixed chain of C stages, of type
+// int (*)(void*), on the thread pool, in one of a fixed number of slots
+// allocated up front. gc_root points to an OCaml function, called after each
+// run with the slot index, the index of the last stage run, and its result.
+// luv_pipeline_create returns NULL on failure. The root is not released by
+// luv_pipeline_destroy.
+void* luv_pipeline_create(
+    uv_loop_t *loop, intnat *stages, unsigned int stage_count,
+    unsigned int slot_count, void *gc_root);
+int luv_pipeline_run(void *pipeline, unsigned int slot, intnat argument);
+void luv_pipeline_destroy(void *pipeline);
+
+
+
+// Channels. luv_channel_push can be called from any thread. It queues gc_root,
+// and wakes up the loop through async if the loop is not already due to drain
+// the channel. luv_channel_take and luv_channel_pop must be called only from
+// the loop thread. luv_channel_take takes the roots queued so far.
+// luv_channel_pop returns the taken roots in the order they were pushed, and
+// NULL once they have all been popped. Roots are released by the caller.
+void* luv_channel_create(uv_async_t *async);
+int luv_channel_push(void *channel, void *gc_root);
+void luv_channel_take(void *channel);
+void* luv_channel_pop(void *channel);
+void luv_channel_destroy(void *channel);
+
+
+
+// Sharded servers. luv_tcp_bind is uv_tcp_bind, but also accepts
+// UV_TCP_REUSEPORT with libuv older than 1.49, on Linux.
+// luv_tcp_duplicate_socket duplicates the socket of a TCP handle, so that it
+// can be opened by a handle on another loop.
+int luv_tcp_bind(
+    uv_tcp_t *tcp, const struct sockaddr *address, unsigned int flags);
+int luv_tcp_duplicate_socket(uv_tcp_t *tcp, uv_os_sock_t *socket);
+void luv_close_socket(uv_os_sock_t socket);
+
+
+
+// Batched accepts. luv_tcp_listen_batch starts listening, and accepts each
+// burst of incoming connections into the next of capacity preallocated client
+// handles. For each batch, it sets statuses[i] to the result of accepting into
+// clients[i], then calls the OCaml callback in LUV_CONNECTION_CALLBACK with an
+// error code and the number of clients used.
+int luv_tcp_listen_batch(
+    uv_tcp_t *server, int backlog, uv_tcp_t **clients, int *statuses,
+    size_t capacity);
+
+
+
+// Loop instrumentation. There is one histogram of callback durations for each
+// handle type, indexed by uv_handle_type, followed by one for each request
+// type, indexed by UV_HANDLE_TYPE_MAX plus uv_req_type, and then the histograms
+// of loop lag and of thread pool queue wait. luv_instrumentation_read copies
+// out the iteration count, time blocked in poll, and time in callbacks, and
+// then each histogram as its count, total, minimum, maximum, and buckets, all
+// in nanoseconds.
+#define LUV_HISTOGRAM_SUB_BUCKETS 8
+#define LUV_HISTOGRAM_BUCKETS (62 * LUV_HISTOGRAM_SUB_BUCKETS)
+#define LUV_INSTRUMENTATION_HISTOGRAM_SIZE (4 + LUV_HISTOGRAM_BUCKETS)
+
+enum {
+    LUV_INSTRUMENTATION_LAG = UV_HANDLE_TYPE_MAX + UV_REQ_TYPE_MAX,
+    LUV_INSTRUMENTATION_WORK_WAIT,
+    LUV_INSTRUMENTATION_HISTOGRAMS
+};
+
+int luv_instrumentation_enable(uv_loop_t *loop);
+void luv_instrumentation_disable(uv_loop_t *loop);
+int luv_instrumentation_read(
+    uv_loop_t *loop, uint64_t *totals, uint64_t *histograms, int reset);
+
+
+
+// Tracing. While tracing is on, callbacks timed for instrumentation are also
+// recorded in per-thread ring buffers of the given capacity. luv_trace_read
+// copies up to limit events, oldest first within each thread, as
+// LUV_TRACE_EVENT_SIZE words each: thread number, kind (as for
+// instrumentation), handle or request address, start time, end time, and time
+// spent waiting for the runtime lock before the start. It returns the number
+// of events copied. With clear, the copied events are not returned again.
+#define LUV_TRACE_EVENT_SIZE 6
+
+int luv_trace_start(size_t capacity);
+void luv_trace_stop(void);
+size_t luv_trace_count(void);
+size_t luv_trace_read(uint64_t *events, size_t limit, int clear);
+
+
+
 // Helpers for setting up uv_queue_work requests that call a C function.
 int luv_add_c_function_and_argument(
     uv_work_t *c_request, intnat function, intnat argument);
 uv_after_work_cb luv_get_after_c_work_trampoline(void);
 uv_work_cb luv_get_c_work_trampoline(void);
 
+// Wraps uv_queue_work, recording the time at which the request was queued if
+// the loop is instrumented.
+int luv_queue_work(
+    uv_loop_t *loop, uv_work_t *c_request, uv_work_cb work_cb,
+    uv_after_work_cb after_work_cb);
+
 // Helper for calling uv_thread_create with the address of a C function.
 int luv_thread_create_c(
     uv_thread_t *tid,
@@ -161,6 +369,7 @@ char* luv_version_string(void);
 char* luv_req_type_name(uv_req_type type);
 char* luv_fs_get_path(const uv_fs_t *req);
 char* luv_dlerror(const uv_lib_t *lib);
+char* luv_instrumentation_kind_name(int kind);
 
 int luv_fs_event_start(
     uv_fs_event_t *handle, luv_fs_event_cb cb, const char *path,
@@ -235,6 +444,11 @@ int luv_is_invalid_socket_value(uv_os_sock_t socket);
 //   https://github.com/aantron/luv/pull/112
 int luv_sa_family_to_int(sa_family_t family);
 
+// Duplicates a file descriptor, for watching a socket with uv_poll_t while it
+// is also owned by a stream handle. Returns a libuv error code on failure, or
+// on Windows.
+int luv_dup(int fd);
+
 
 
 #endif // #ifndef LUV_HELPERS_H_
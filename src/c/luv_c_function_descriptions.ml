@@ -489,7 +489,7 @@ struct
         (ptr t @-> int @-> int @-> returning error_code)
 
     let close =
-      foreign "uv_loop_close"
+      foreign "luv_loop_close"
         (ptr t @-> returning error_code)
 
     let default =
@@ -751,6 +751,26 @@ struct
     let send =
       foreign "uv_async_send"
         (ptr t @-> returning error_code)
+
+    let channel_create =
+      foreign "luv_channel_create"
+        (ptr t @-> returning (ptr void))
+
+    let channel_push =
+      foreign "luv_channel_push"
+        (ptr void @-> ptr void @-> returning error_code)
+
+    let channel_take =
+      foreign "luv_channel_take"
+        (ptr void @-> returning void)
+
+    let channel_pop =
+      foreign "luv_channel_pop"
+        (ptr void @-> returning (ptr void))
+
+    let channel_destroy =
+      foreign "luv_channel_destroy"
+        (ptr void @-> returning void)
   end
 
   module Poll =
@@ -892,6 +912,26 @@ struct
       foreign "uv_read_stop"
         (ptr t @-> returning error_code)
 
+    let read_frames_start =
+      foreign "luv_read_frames_start"
+        (ptr t @-> int @-> uint @-> size_t @-> returning error_code)
+
+    let proxy_start =
+      foreign "luv_proxy_start"
+        (ptr t @-> ptr t @-> ptr void @-> returning error_code)
+
+    let writable_create =
+      foreign "luv_writable_create"
+        (ptr t @-> ptr void @-> ptr (ptr void) @-> returning error_code)
+
+    let writable_wait =
+      foreign "luv_writable_wait"
+        (ptr void @-> returning error_code)
+
+    let writable_close =
+      foreign "luv_writable_close"
+        (ptr void @-> returning void)
+
     let write2 =
       foreign "uv_write2"
         (ptr Types.Stream.Write_request.t @->
@@ -961,7 +1001,7 @@ struct
         (ptr t @-> bool @-> returning error_code)
 
     let bind =
-      foreign "uv_tcp_bind"
+      foreign "luv_tcp_bind"
         (ptr t @-> ptr Types.Sockaddr.t @-> int @-> returning error_code)
 
     let getsockname =
@@ -983,6 +1023,19 @@ struct
     let close_reset =
       foreign "uv_tcp_close_reset"
         (ptr t @-> Handle.close_trampoline @-> returning error_code)
+
+    let listen_batch =
+      foreign "luv_tcp_listen_batch"
+        (ptr t @-> int @-> ptr (ptr t) @-> ptr int @-> size_t @->
+          returning error_code)
+
+    let duplicate_socket =
+      foreign "luv_tcp_duplicate_socket"
+        (ptr t @-> ptr Types.Os_socket.t @-> returning error_code)
+
+    let close_socket =
+      foreign "luv_close_socket"
+        (Types.Os_socket.t @-> returning void)
   end
 
   module Pipe =
@@ -1166,6 +1219,12 @@ struct
         (ptr t @-> ptr Types.Buf.t @-> uint @-> ptr Types.Sockaddr.t @->
           returning error_code)
 
+    let try_send_batch =
+      foreign "luv_udp_try_send_batch"
+        (ptr t @-> uint @-> ptr Types.Buf.t @-> ptr uint @->
+          ptr (ptr Types.Sockaddr.t) @->
+          returning int)
+
     let recv_trampoline =
       static_funptr
         Ctypes.(
@@ -1189,6 +1248,11 @@ struct
       foreign "uv_udp_recv_stop"
         (ptr t @-> returning error_code)
 
+    let recv_batch_start =
+      foreign "luv_udp_recv_batch_start"
+        (ptr t @-> ptr char @-> size_t @-> ptr int32_t @-> ptr char @->
+          returning error_code)
+
     let using_recvmmsg =
       foreign "uv_udp_using_recvmmsg"
         (ptr t @-> returning bool)
@@ -1401,6 +1465,10 @@ struct
     let is_invalid_socket_value =
       foreign "luv_is_invalid_socket_value"
         (Types.Os_socket.t @-> returning bool)
+
+    let dup =
+      foreign "luv_dup"
+        (int @-> returning int)
   end
 
   module Bigstring =
@@ -1414,6 +1482,30 @@ struct
         (ptr char @-> ocaml_bytes @-> int @-> returning void)
   end
 
+  module File_mapping =
+  struct
+    let map =
+      foreign "luv_mmap"
+        (int @-> int64_t @-> size_t @-> int @-> ptr int @->
+          returning (ptr char))
+
+    let unmap =
+      foreign "luv_munmap"
+        (ptr char @-> size_t @-> returning error_code)
+
+    let request =
+      foreign "luv_mapping_request"
+        (ptr char @-> size_t @-> int @-> int @-> returning (ptr void))
+
+    let get_work =
+      foreign "luv_get_mapping_work"
+        (void @-> returning nativeint)
+
+    let result =
+      foreign "luv_mapping_result"
+        (ptr void @-> returning error_code)
+  end
+
   module Work =
   struct
     let t = Types.Work.t
@@ -1447,9 +1539,26 @@ struct
         (ptr t @-> nativeint @-> nativeint @-> returning bool)
 
     let queue =
-      foreign "uv_queue_work"
+      foreign "luv_queue_work"
         (ptr Loop.t @-> ptr t @-> work_trampoline @-> after_work_trampoline @->
           returning error_code)
+
+    let queue_batch =
+      foreign "luv_queue_batch"
+        (ptr Loop.t @-> uint @-> ptr void @-> returning error_code)
+
+    let pipeline_create =
+      foreign "luv_pipeline_create"
+        (ptr Loop.t @-> ptr nativeint @-> uint @-> uint @-> ptr void @->
+          returning (ptr void))
+
+    let pipeline_run =
+      foreign "luv_pipeline_run"
+        (ptr void @-> uint @-> nativeint @-> returning error_code)
+
+    let pipeline_destroy =
+      foreign "luv_pipeline_destroy"
+        (ptr void @-> returning void)
   end
 
   module Thread =
@@ -1920,6 +2029,39 @@ struct
     let info =
       foreign "uv_metrics_info"
         (ptr Types.Loop.t @-> ptr Types.Metrics.t @-> returning int)
+
+    let instrumentation_enable =
+      foreign "luv_instrumentation_enable"
+        (ptr Types.Loop.t @-> returning error_code)
+
+    let instrumentation_disable =
+      foreign "luv_instrumentation_disable"
+        (ptr Types.Loop.t @-> returning void)
+
+    let instrumentation_read =
+      foreign "luv_instrumentation_read"
+        (ptr Types.Loop.t @-> ptr uint64_t @-> ptr uint64_t @-> bool @->
+          returning error_code)
+
+    let instrumentation_kind_name =
+      foreign "luv_instrumentation_kind_name"
+        (int @-> returning string_opt)
+
+    let trace_start =
+      foreign "luv_trace_start"
+        (size_t @-> returning error_code)
+
+    let trace_stop =
+      foreign "luv_trace_stop"
+        (void @-> returning void)
+
+    let trace_count =
+      foreign "luv_trace_count"
+        (void @-> returning size_t)
+
+    let trace_read =
+      foreign "luv_trace_read"
+        (ptr uint64_t @-> size_t @-> bool @-> returning size_t)
   end
 
   module String_ =
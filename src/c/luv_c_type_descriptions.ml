@@ -134,6 +134,7 @@ struct
       let block_signal = constant "UV_LOOP_BLOCK_SIGNAL" int
       let sigprof = constant "SIGPROF" int
       let idle_time = constant "UV_METRICS_IDLE_TIME" int
+      let use_io_uring_sqpoll = constant "UV_LOOP_USE_IO_URING_SQPOLL" int
     end
 
     type t = [ `Loop ] structure
@@ -149,6 +150,13 @@ struct
     let events = field t "events" uint64_t
     let events_waiting = field t "events_waiting" uint64_t
     let () = seal t
+
+    let histogram_sub_buckets = constant "LUV_HISTOGRAM_SUB_BUCKETS" int
+    let histogram_size = constant "LUV_INSTRUMENTATION_HISTOGRAM_SIZE" int
+    let histogram_count = constant "LUV_INSTRUMENTATION_HISTOGRAMS" int
+    let lag = constant "LUV_INSTRUMENTATION_LAG" int
+    let work_wait = constant "LUV_INSTRUMENTATION_WORK_WAIT" int
+    let trace_event_size = constant "LUV_TRACE_EVENT_SIZE" int
   end
 
   module Buf =
@@ -286,6 +294,12 @@ struct
     let connection_callback_index = constant "LUV_CONNECTION_CALLBACK" int
     let allocate_callback_index = constant "LUV_ALLOCATE_CALLBACK" int
 
+    module Framing =
+    struct
+      let length_prefixed = constant "LUV_FRAMING_LENGTH_PREFIXED" int
+      let delimited = constant "LUV_FRAMING_DELIMITED" int
+    end
+
     let stream = t
 
     module Connect_request =
@@ -355,6 +369,7 @@ struct
   module TCP =
   struct
     let ipv6only = constant "UV_TCP_IPV6ONLY" int
+    let reuseport = constant "UV_TCP_REUSEPORT" int
 
     let t : ([ `TCP ] Stream.t) typ = typedef (structure "`TCP") "uv_tcp_t"
     let () = seal t
@@ -553,6 +568,21 @@ struct
       let dir = constant "UV_FS_SYMLINK_DIR" int
       let junction = constant "UV_FS_SYMLINK_JUNCTION" int
     end
+
+    module Mapping =
+    struct
+      let sync = constant "LUV_MAPPING_SYNC" int
+      let advise = constant "LUV_MAPPING_ADVISE" int
+
+      module Advice =
+      struct
+        let normal = constant "LUV_ADVICE_NORMAL" int
+        let random = constant "LUV_ADVICE_RANDOM" int
+        let sequential = constant "LUV_ADVICE_SEQUENTIAL" int
+        let willneed = constant "LUV_ADVICE_WILLNEED" int
+        let dontneed = constant "LUV_ADVICE_DONTNEED" int
+      end
+    end
   end
 
   module Pipe =
@@ -637,6 +667,15 @@ struct
       let recvmmsg = constant "UV_UDP_RECVMMSG" int
     end
 
+    module Batch =
+    struct
+      let datagram_size = constant "LUV_UDP_BATCH_DATAGRAM_SIZE" int
+      let offset = constant "LUV_UDP_BATCH_OFFSET" int
+      let length = constant "LUV_UDP_BATCH_LENGTH" int
+      let partial = constant "LUV_UDP_BATCH_PARTIAL" int
+      let info_fields = constant "LUV_UDP_BATCH_INFO_FIELDS" int
+    end
+
     module Membership =
     struct
       let leave_group = constant "UV_LEAVE_GROUP" int64_t
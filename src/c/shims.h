@@ -806,3 +806,11 @@
 
     #define UV_PROCESS_WINDOWS_FILE_PATH_EXACT_NAME 0
 #endif
+
+#if UV_VERSION_MAJOR == 1 && UV_VERSION_MINOR < 49
+    // Older libuv rejects unknown loop options with UV_ENOSYS.
+    #define UV_LOOP_USE_IO_URING_SQPOLL 2
+
+    // Emulated by luv_tcp_bind.
+    #define UV_TCP_REUSEPORT 2
+#endif
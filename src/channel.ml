@@ -0,0 +1,67 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(* Each value in flight is held by a GC root, which is pushed onto the C
+   channel by the sending thread, and released by the loop thread when it pops
+   the value. *)
+
+type 'a t = {
+  async : Async.t;
+  channel : unit Ctypes.ptr;
+}
+
+let rec receive_taken channel receive =
+  let gc_root = C.Functions.Async.channel_pop channel in
+  if not (Ctypes.is_null gc_root) then begin
+    let value = Ctypes.Root.get gc_root in
+    Ctypes.Root.release gc_root;
+    receive value;
+    receive_taken channel receive
+  end
+
+(* Only the messages sent before the drain starts are received. Messages sent
+   during the drain wake the loop up again, so that other handles get a turn in
+   between. *)
+let drain channel receive =
+  C.Functions.Async.channel_take channel;
+  receive_taken channel receive
+
+let init ?loop callback =
+  let channel = ref Ctypes.null in
+  let receive = Error.catch_exceptions callback in
+  match Async.init ?loop (fun _ -> drain !channel receive) with
+  | Error e ->
+    Error e
+  | Ok async ->
+    channel := C.Functions.Async.channel_create async;
+    if Ctypes.is_null !channel then begin
+      Handle.close async ignore;
+      Error `ENOMEM
+    end
+    else
+      Ok {async; channel = !channel}
+
+let send channel value =
+  let gc_root = Ctypes.Root.create value in
+  let result = C.Functions.Async.channel_push channel.channel gc_root in
+  if result < 0 then begin
+    (* A failed uv_async_send comes after a successful push, in which case the
+       root is already in the channel. *)
+    if result = C.Types.Error.enomem then
+      Ctypes.Root.release gc_root;
+    Error.result_from_c result
+  end
+  else
+    Ok ()
+
+let close channel callback =
+  Handle.close channel.async begin fun () ->
+    drain channel.channel ignore;
+    C.Functions.Async.channel_destroy channel.channel;
+    callback ()
+  end
+
+let async channel =
+  channel.async
@@ -0,0 +1,57 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(** Passing values from other threads to a loop.
+
+    {!Luv.Async.send} only wakes up a loop. To pass data along with the wakeup,
+    threads would otherwise have to put it in a queue guarded by a
+    {!Luv.Mutex.t}, and every sending thread would contend on that mutex.
+
+    A channel is instead a lock-free queue, implemented in C, with an
+    {!Luv.Async.t} attached. Any number of threads can send values into it
+    concurrently. The loop receives all values sent since its last wakeup in
+    one async callback, which calls the channel's callback once for each value,
+    in the order in which the values were sent:
+
+    {[
+      let channel =
+        Luv.Channel.init (fun event -> handle_event event) |> Result.get_ok in
+
+      ignore @@ Thread.create (fun () ->
+        Luv.Channel.send channel (read_event ()) |> ignore) ()
+    ]}
+
+    A thread that sends while the loop already has a wakeup pending does not
+    call {!Luv.Async.send} again, so a burst of values costs only one wakeup of
+    the loop. Values sent while the callback is being called for earlier values
+    are received on the next wakeup, so a busy sender does not keep the loop
+    from running other callbacks. *)
+
+type 'a t
+(** Channels carrying values of type ['a]. *)
+
+val init : ?loop:Loop.t -> ('a -> unit) -> ('a t, Error.t) result
+(** Creates a channel, whose callback is called by [?loop] with each value sent
+    into the channel.
+
+    Like an {!Luv.Async.t}, a channel keeps its loop alive until the channel is
+    closed with {!Luv.Channel.close}. *)
+
+val send : 'a t -> 'a -> (unit, Error.t) result
+(** Sends a value to the loop of the channel.
+
+    This function can be called from any thread, including the loop's own
+    thread, but not after {!Luv.Channel.close} has been called. *)
+
+val close : 'a t -> (unit -> unit) -> unit
+(** Closes the channel.
+
+    Values sent but not yet received when the channel is closed are dropped.
+    The callback is called once the channel is closed. *)
+
+val async : 'a t -> Async.t
+(** The async handle that wakes up the loop. It can be passed to functions in
+    {!Luv.Handle}, such as {!Luv.Handle.ref} and {!Luv.Handle.unref}, but
+    should not be closed directly. *)
@@ -0,0 +1,223 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(* Double-ended queues of jobs. Each worker domain pushes and pops jobs at the
+   back of its own deque, and steals from the front of the other workers'
+   deques when its own is empty. The deques are guarded by per-deque mutexes,
+   which are uncontended except while a worker is stealing. *)
+module Deque =
+struct
+  type 'a t = {
+    lock : Mutex.t;
+    mutable items : 'a option array;
+    mutable first : int;
+    mutable length : int;
+  }
+
+  let create () = {
+    lock = Mutex.create ();
+    items = Array.make 16 None;
+    first = 0;
+    length = 0;
+  }
+
+  let grow deque =
+    let capacity = Array.length deque.items in
+    let items = Array.make (2 * capacity) None in
+    for index = 0 to deque.length - 1 do
+      items.(index) <- deque.items.((deque.first + index) mod capacity)
+    done;
+    deque.items <- items;
+    deque.first <- 0
+
+  let push_back deque item =
+    Mutex.lock deque.lock;
+    if deque.length = Array.length deque.items then
+      grow deque;
+    let capacity = Array.length deque.items in
+    deque.items.((deque.first + deque.length) mod capacity) <- Some item;
+    deque.length <- deque.length + 1;
+    Mutex.unlock deque.lock
+
+  let take deque index =
+    let item = deque.items.(index) in
+    deque.items.(index) <- None;
+    deque.length <- deque.length - 1;
+    item
+
+  let pop_back deque =
+    Mutex.lock deque.lock;
+    let item =
+      if deque.length = 0 then
+        None
+      else
+        let capacity = Array.length deque.items in
+        take deque ((deque.first + deque.length - 1) mod capacity)
+    in
+    Mutex.unlock deque.lock;
+    item
+
+  let pop_front deque =
+    Mutex.lock deque.lock;
+    let item =
+      if deque.length = 0 then
+        None
+      else begin
+        let index = deque.first in
+        deque.first <- (deque.first + 1) mod Array.length deque.items;
+        take deque index
+      end
+    in
+    Mutex.unlock deque.lock;
+    item
+end
+
+type t = {
+  deques : (unit -> unit) Deque.t array;
+  mutable domains : unit Domain.t array;
+  async : Luv.Async.t;
+  lock : Mutex.t;
+  wake_up : Condition.t;
+  pending : int Atomic.t;
+  mutable stopping : bool;
+  completed : (unit -> unit) list Atomic.t;
+  outstanding : int Atomic.t;
+  next : int Atomic.t;
+}
+
+(* The index of the current domain's deque, if the current domain is one of the
+   pool's workers. *)
+let worker_key : (t * int) option Domain.DLS.key =
+  Domain.DLS.new_key (fun () -> None)
+
+let find_job pool index =
+  match Deque.pop_back pool.deques.(index) with
+  | Some _ as job ->
+    job
+  | None ->
+    let count = Array.length pool.deques in
+    let rec steal offset =
+      if offset >= count then
+        None
+      else
+        match Deque.pop_front pool.deques.((index + offset) mod count) with
+        | Some _ as job -> job
+        | None -> steal (offset + 1)
+    in
+    steal 1
+
+let rec work pool index =
+  match find_job pool index with
+  | Some job ->
+    Atomic.decr pool.pending;
+    job ();
+    work pool index
+  | None ->
+    Mutex.lock pool.lock;
+    while Atomic.get pool.pending = 0 && not pool.stopping do
+      Condition.wait pool.wake_up pool.lock
+    done;
+    let stop = Atomic.get pool.pending = 0 && pool.stopping in
+    Mutex.unlock pool.lock;
+    if not stop then
+      work pool index
+
+(* Completions are pushed onto a lock-free list by the workers, and run by the
+   loop in the callback of an async handle. libuv coalesces async sends, so a
+   burst of completions wakes the loop only once. *)
+let run_completions pool =
+  Atomic.exchange pool.completed []
+  |> List.rev
+  |> List.iter begin fun completion ->
+    if Atomic.fetch_and_add pool.outstanding (-1) = 1 then
+      Luv.Handle.unref pool.async;
+    Luv.Error.catch_exceptions completion ()
+  end
+
+let rec post pool completion =
+  let completed = Atomic.get pool.completed in
+  if Atomic.compare_and_set pool.completed completed (completion::completed)
+  then
+    ignore (Luv.Async.send pool.async)
+  else
+    post pool completion
+
+let create ?loop ?domains () =
+  let domains =
+    match domains with
+    | Some domains -> max 1 domains
+    | None -> max 1 (Domain.recommended_domain_count () - 1)
+  in
+  let pool = ref None in
+  match
+    Luv.Async.init ?loop (fun _ ->
+      match !pool with
+      | Some pool -> run_completions pool
+      | None -> ())
+  with
+  | Error _ as error ->
+    error
+  | Ok async ->
+    Luv.Handle.unref async;
+    let created = {
+      deques = Array.init domains (fun _ -> Deque.create ());
+      domains = [||];
+      async;
+      lock = Mutex.create ();
+      wake_up = Condition.create ();
+      pending = Atomic.make 0;
+      stopping = false;
+      completed = Atomic.make [];
+      outstanding = Atomic.make 0;
+      next = Atomic.make 0;
+    }
+    in
+    pool := Some created;
+    created.domains <-
+      Array.init domains (fun index ->
+        Domain.spawn (fun () ->
+          Domain.DLS.set worker_key (Some (created, index));
+          work created index));
+    Ok created
+
+let submit pool f callback =
+  let job () =
+    let result =
+      match f () with
+      | value -> Ok value
+      | exception exn -> Error exn
+    in
+    post pool (fun () -> callback result)
+  in
+
+  (* Jobs submitted by the loop take a reference on the async handle, so that
+     the loop doesn't exit while they are running. Jobs submitted by workers
+     are always nested in an outstanding job. *)
+  if Atomic.fetch_and_add pool.outstanding 1 = 0 then
+    Luv.Handle.ref pool.async;
+
+  let index =
+    match Domain.DLS.get worker_key with
+    | Some (worker_pool, index) when worker_pool == pool -> index
+    | _ -> Atomic.fetch_and_add pool.next 1 mod Array.length pool.deques
+  in
+  Atomic.incr pool.pending;
+  Deque.push_back pool.deques.(index) job;
+
+  Mutex.lock pool.lock;
+  Condition.signal pool.wake_up;
+  Mutex.unlock pool.lock
+
+let domains pool =
+  Array.length pool.deques
+
+let shutdown pool =
+  Mutex.lock pool.lock;
+  pool.stopping <- true;
+  Condition.broadcast pool.wake_up;
+  Mutex.unlock pool.lock;
+  Array.iter Domain.join pool.domains;
+  run_completions pool;
+  Luv.Handle.close pool.async ignore
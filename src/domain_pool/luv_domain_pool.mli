@@ -0,0 +1,52 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(** Domain pools, for running CPU-bound OCaml code in parallel.
+
+    Functions run by {!Luv.Thread_pool.queue_work} share the OCaml runtime lock,
+    so only one of them runs OCaml code at a time. On OCaml 5, a domain pool
+    instead runs jobs on separate domains, which execute OCaml code in
+    parallel.
+
+    Each domain has its own deque of jobs. Jobs submitted by the loop are
+    spread over the deques round-robin. Jobs submitted by a running job go to
+    the back of its own domain's deque. Domains take work from the back of
+    their own deque, and steal from the front of other domains' deques when
+    theirs is empty.
+
+    Results are passed back to the loop through a {!Luv.Async} handle, and
+    completion callbacks are called by the loop. The handle keeps the loop
+    alive only while jobs are outstanding.
+
+    This library is available only on OCaml 5.0.0 and later. *)
+
+type t
+(** Domain pools. *)
+
+val create :
+  ?loop:Luv.Loop.t -> ?domains:int -> unit -> (t, Luv.Error.t) result
+(** Spawns the pool's domains.
+
+    The default number of domains is one less than
+    [Domain.recommended_domain_count ()], leaving a core for the loop, but at
+    least one. *)
+
+val submit : t -> (unit -> 'a) -> (('a, exn) result -> unit) -> unit
+(** [Luv_domain_pool.submit pool f callback] runs [f] on one of the pool's
+    domains, and then calls [callback] on the loop with its result, or the
+    exception it raised.
+
+    [f] must not call Luv functions other than {!Luv_domain_pool.submit}.
+    [submit] must be called either from the loop's thread, or from a job
+    running in the same pool. *)
+
+val domains : t -> int
+(** Number of domains in the pool. *)
+
+val shutdown : t -> unit
+(** Waits for all submitted jobs to complete, calls their callbacks, stops the
+    pool's domains, and closes its async handle. Blocks the calling thread, and
+    so the loop, until the jobs complete. Jobs must not be submitted to a pool
+    that has been shut down. *)
@@ -184,6 +184,7 @@ val set_on_unhandled_exception : (exn -> unit) -> unit
 
 (* Internal functions; do not use. *)
 
+val from_c : int -> t
 val result_from_c : int -> (_, t) result
 val to_result : 'a -> int -> ('a, t) result
 val to_result_f : (unit -> 'a) -> int -> ('a, t) result
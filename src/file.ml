@@ -799,6 +799,282 @@ struct
     end)
 end
 
+module Bulk =
+struct
+  type file = t
+
+  (* Each slot owns a request and a chunk-sized buffer, which are reused for
+     every chunk the slot transfers. The request's callback is installed with
+     set_reference, so that completing a request doesn't release it. *)
+  type slot = {
+    request : Request_.t;
+    buffer : Buffer.t;
+    iovecs : C.Types.Buf.t Ctypes.CArray.t;
+  }
+
+  type t = {
+    loop : Loop.t;
+    chunk_size : int;
+    slots : slot array;
+    mutable busy : bool;
+    mutable closed : bool;
+  }
+
+  let alignment = 4096
+
+  let create ?loop ?(chunk_size = 1024 * 1024) ?(depth = 4) () =
+    let chunk_size =
+      (max chunk_size 1 + alignment - 1) / alignment * alignment in
+    let make_slot _ =
+      let buffer = Buffer.create chunk_size in
+      {
+        request = Request_.make ();
+        buffer;
+        iovecs = Helpers.Buf.bigstrings_to_iovecs [buffer] 1;
+      }
+    in
+    {
+      loop = Loop.or_default loop;
+      chunk_size;
+      slots = Array.init (max depth 1) make_slot;
+      busy = false;
+      closed = false;
+    }
+
+  let submit bulk slot c_function file ~file_offset buffer callback =
+    Helpers.Buf.fill_iovecs slot.iovecs [buffer];
+    Request.set_reference slot.request begin fun () ->
+      let result = Request_.byte_count slot.request in
+      Request_.cleanup slot.request;
+      callback result
+    end;
+    let immediate_result =
+      c_function
+        bulk.loop
+        slot.request
+        file
+        (Ctypes.CArray.start slot.iovecs)
+        Unsigned.UInt.one
+        file_offset
+        Async.trampoline
+    in
+    if immediate_result < 0 then begin
+      Request_.cleanup slot.request;
+      callback (Error.result_from_c immediate_result)
+    end
+
+  (* Reads or writes all of buffer, continuing after short transfers. *)
+  let rec transfer_all bulk slot c_function file ~file_offset buffer callback =
+    submit bulk slot c_function file ~file_offset buffer begin function
+      | Error error ->
+        callback (Error error)
+      | Ok count ->
+        let count = Unsigned.Size_t.to_int count in
+        let length = Buffer.size buffer in
+        if count = 0 then
+          callback (Error `EOF)
+        else if count >= length then
+          callback (Ok ())
+        else
+          transfer_all
+            bulk
+            slot
+            c_function
+            file
+            ~file_offset:(Int64.add file_offset (Int64.of_int count))
+            (Buffer.sub buffer ~offset:count ~length:(length - count))
+            callback
+    end
+
+  let release_slots bulk =
+    Array.iter (fun slot -> Request.release slot.request) bulk.slots
+
+  (* Splits the range into chunks whose boundaries are multiples of the chunk
+     size, and keeps one chunk in flight in each slot until the range is done
+     or a chunk fails. *)
+  let run bulk ~offset ~length step callback =
+    let callback = Error.catch_exceptions callback in
+    if bulk.closed then
+      callback (Error `EINVAL)
+    else if bulk.busy then
+      callback (Error `EBUSY)
+    else if Int64.compare length 0L <= 0 then
+      callback (Ok ())
+    else begin
+      bulk.busy <- true;
+
+      let range_end = Int64.add offset length in
+      let chunk_size = Int64.of_int bulk.chunk_size in
+      let next = ref offset in
+      let in_flight = ref 0 in
+      let failure = ref None in
+      let finished = ref false in
+
+      let rec issue slot =
+        if !failure <> None || Int64.compare !next range_end >= 0 then begin
+          if !in_flight = 0 && not !finished then begin
+            finished := true;
+            bulk.busy <- false;
+            if bulk.closed then
+              release_slots bulk;
+            match !failure with
+            | None -> callback (Ok ())
+            | Some error -> callback (Error error)
+          end
+        end
+        else begin
+          let chunk_offset = !next in
+          let boundary =
+            Int64.(mul (add (div chunk_offset chunk_size) 1L) chunk_size) in
+          let chunk_end =
+            if Int64.compare boundary range_end < 0 then boundary
+            else range_end
+          in
+          next := chunk_end;
+          incr in_flight;
+          let chunk_length = Int64.(to_int (sub chunk_end chunk_offset)) in
+          step slot chunk_offset chunk_length begin fun result ->
+            decr in_flight;
+            begin match result with
+            | Error error when !failure = None -> failure := Some error
+            | _ -> ()
+            end;
+            issue slot
+          end
+        end
+      in
+      Array.iter issue bulk.slots
+    end
+
+  let read bulk file ~offset ~length consume callback =
+    let consume = Error.catch_exceptions (fun (offset, buffer) ->
+      consume offset buffer) in
+    run bulk ~offset ~length begin fun slot chunk_offset chunk_length k ->
+      let buffer = Buffer.sub slot.buffer ~offset:0 ~length:chunk_length in
+      transfer_all
+        bulk slot C.Blocking.File.read file ~file_offset:chunk_offset buffer
+        begin function
+          | Error _ as error -> k error
+          | Ok () -> consume (chunk_offset, buffer); k (Ok ())
+        end
+    end callback
+
+  let write bulk file ~offset ~length produce callback =
+    let produce = Error.catch_exceptions (fun (offset, buffer) ->
+      produce offset buffer) in
+    run bulk ~offset ~length begin fun slot chunk_offset chunk_length k ->
+      let buffer = Buffer.sub slot.buffer ~offset:0 ~length:chunk_length in
+      produce (chunk_offset, buffer);
+      transfer_all
+        bulk slot C.Blocking.File.write file ~file_offset:chunk_offset buffer k
+    end callback
+
+  let copy bulk file ~offset ~to_ ~to_offset ~length callback =
+    let delta = Int64.sub to_offset offset in
+    run bulk ~offset ~length begin fun slot chunk_offset chunk_length k ->
+      let buffer = Buffer.sub slot.buffer ~offset:0 ~length:chunk_length in
+      transfer_all
+        bulk slot C.Blocking.File.read file ~file_offset:chunk_offset buffer
+        begin function
+          | Error _ as error ->
+            k error
+          | Ok () ->
+            transfer_all
+              bulk
+              slot
+              C.Blocking.File.write
+              to_
+              ~file_offset:(Int64.add chunk_offset delta)
+              buffer
+              k
+        end
+    end callback
+
+  let close bulk =
+    if not bulk.closed then begin
+      bulk.closed <- true;
+      if not bulk.busy then
+        release_slots bulk
+    end
+end
+
+type mapping_mode = [
+  | `READ_ONLY
+  | `READ_WRITE
+]
+
+type advice = [
+  | `NORMAL
+  | `RANDOM
+  | `SEQUENTIAL
+  | `WILLNEED
+  | `DONTNEED
+]
+
+let map ?(mode = `READ_ONLY) file ~offset ~length =
+  let error = Ctypes.allocate Ctypes.int 0 in
+  let writable =
+    match mode with
+    | `READ_ONLY -> 0
+    | `READ_WRITE -> 1
+  in
+  let address =
+    C.Functions.File_mapping.map
+      file offset (Unsigned.Size_t.of_int length) writable error
+  in
+  if Ctypes.is_null address then
+    Error.result_from_c Ctypes.(!@ error)
+  else
+    Ok Ctypes.(bigarray_of_ptr array1 length Bigarray.char address)
+
+let unmap buffer =
+  C.Functions.File_mapping.unmap
+    Ctypes.(bigarray_start array1 buffer)
+    (Unsigned.Size_t.of_int (Buffer.size buffer))
+  |> Error.to_result ()
+
+let mapping_work =
+  C.Functions.File_mapping.get_work ()
+
+let mapping_operation ?loop buffer operation parameter callback =
+  let callback = Error.catch_exceptions callback in
+  let request =
+    C.Functions.File_mapping.request
+      Ctypes.(bigarray_start array1 buffer)
+      (Unsigned.Size_t.of_int (Buffer.size buffer))
+      operation
+      parameter
+  in
+  if Ctypes.is_null request then
+    callback (Error `ENOMEM)
+  else
+    Thread_pool.queue_c_work
+        ?loop ~argument:(Ctypes.raw_address_of_ptr request) mapping_work
+        begin fun result ->
+      let status = C.Functions.File_mapping.result request in
+      ignore (Compatibility.Sys.opaque_identity buffer);
+      match result with
+      | Error _ as error -> callback error
+      | Ok () -> callback (Error.to_result () status)
+    end
+
+let msync ?loop ?(invalidate = false) buffer callback =
+  let invalidate = if invalidate then 1 else 0 in
+  mapping_operation
+    ?loop buffer C.Types.File.Mapping.sync invalidate callback
+
+let madvise ?loop buffer advice callback =
+  let advice =
+    let open C.Types.File.Mapping.Advice in
+    match advice with
+    | `NORMAL -> normal
+    | `RANDOM -> random
+    | `SEQUENTIAL -> sequential
+    | `WILLNEED -> willneed
+    | `DONTNEED -> dontneed
+  in
+  mapping_operation ?loop buffer C.Types.File.Mapping.advise advice callback
+
 module Request = Request_
 
 let get_osfhandle file =
@@ -817,3 +1093,14 @@ let to_int file =
 
 let from_int fd =
   fd
+
+let use_io_uring ?(if_not_already_set = false) enabled =
+  let already_set =
+    match Env.getenv "UV_USE_IO_URING" with
+    | Ok _ -> true
+    | Error _ -> false
+  in
+  if already_set && if_not_already_set then
+    ()
+  else
+    ignore (Env.setenv "UV_USE_IO_URING" ~value:(if enabled then "1" else "0"))
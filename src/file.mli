@@ -1124,6 +1124,162 @@ end
 
 
 
+(** {1 Bulk transfers} *)
+
+(** Chunked transfers of large file ranges.
+
+    A [Bulk.t] splits a range into chunks, and keeps several of them in flight
+    on the thread pool at once. Chunk boundaries fall on multiples of the chunk
+    size, counted from the beginning of the file. Each in-flight chunk uses
+    one of a fixed set of requests and buffers, which are reused for the whole
+    lifetime of the [Bulk.t].
+
+    {[
+      let bulk = Luv.File.Bulk.create ~depth:8 () in
+      Luv.File.Bulk.copy bulk source ~offset:0L
+        ~to_:destination ~to_offset:0L ~length begin fun result ->
+        Luv.File.Bulk.close bulk;
+        ...
+      end
+    ]}
+
+    Only one transfer can be in progress on a [Bulk.t] at a time. *)
+module Bulk :
+sig
+  type file = t
+
+  type t
+  (** Bulk transfer engines. *)
+
+  val create : ?loop:Loop.t -> ?chunk_size:int -> ?depth:int -> unit -> t
+  (** Allocates the requests and buffers of a transfer engine.
+
+      [?chunk_size] is rounded up to a multiple of 4096. The default is 1 MiB.
+      [?depth] is the number of chunks kept in flight. The default is 4. The
+      engine holds [depth * chunk_size] bytes of buffers. *)
+
+  val read :
+    t -> file -> offset:int64 -> length:int64 ->
+    (int64 -> Buffer.t -> unit) ->
+    ((unit, Error.t) result -> unit) ->
+      unit
+  (** [Luv.File.Bulk.read bulk file ~offset ~length consume callback] reads
+      [length] bytes of [file], starting at [offset].
+
+      [consume] is called with the file offset and contents of each chunk, as
+      it arrives. Chunks can arrive out of order. The buffer is reused once
+      [consume] returns.
+
+      If the file ends before the range does, the result is [Error `EOF]. On
+      the first error, no more chunks are started, and [callback] is called once
+      the chunks already in flight have completed. *)
+
+  val write :
+    t -> file -> offset:int64 -> length:int64 ->
+    (int64 -> Buffer.t -> unit) ->
+    ((unit, Error.t) result -> unit) ->
+      unit
+  (** Like {!Luv.File.Bulk.read}, but writes the range. The function argument
+      is called to fill each chunk's buffer, with the file offset at which the
+      chunk will be written. *)
+
+  val copy :
+    t -> file -> offset:int64 -> to_:file -> to_offset:int64 ->
+    length:int64 ->
+    ((unit, Error.t) result -> unit) ->
+      unit
+  (** Copies [length] bytes from the first file, starting at [offset], to
+      [to_], starting at [to_offset]. Each chunk is written as soon as it has
+      been read. *)
+
+  val close : t -> unit
+  (** Releases the engine's requests, once any transfer in progress has
+      completed. Transfers started after [close] fail with [`EINVAL]. *)
+end
+
+
+
+(** {1 Memory mapping} *)
+
+type mapping_mode = [
+  | `READ_ONLY
+  | `READ_WRITE
+]
+
+val map :
+  ?mode:mapping_mode -> t -> offset:int64 -> length:int ->
+    (Buffer.t, Error.t) result
+(** Maps [length] bytes of a file, starting at [offset], into memory, and
+    returns them as a buffer.
+
+    The mapping is shared: with [~mode:`READ_WRITE], writes to the buffer are
+    written to the file, and are visible to other processes mapping the same
+    file. The default mode is [`READ_ONLY]. Writing to a read-only mapping
+    crashes the process. The file must have been opened with a compatible
+    {!Luv.File.Open_flag.t}. [offset] need not be page-aligned.
+
+    The buffer can be passed directly to functions such as
+    {!Luv.Stream.write} and {!Luv.UDP.send}, which then send the file's
+    contents without copying them. Reading the buffer may block on disk I/O,
+    if the pages are not yet in memory. See {!Luv.File.madvise}.
+
+    The mapping is not released when the buffer is garbage-collected. Call
+    {!Luv.File.unmap}.
+
+    Binds {{:http://man7.org/linux/man-pages/man2/mmap.2.html} [mmap(2)]}.
+    Not supported on Windows, where the result is [Error `ENOTSUP]. *)
+
+val unmap : Buffer.t -> (unit, Error.t) result
+(** Releases a mapping created by {!Luv.File.map}.
+
+    The argument must be the buffer returned by {!Luv.File.map}, not a view
+    into it. The buffer, and all views into it, must not be used afterwards,
+    including by writes still in progress.
+
+    Binds {{:http://man7.org/linux/man-pages/man2/munmap.2.html}
+    [munmap(2)]}. *)
+
+val msync :
+  ?loop:Loop.t ->
+  ?invalidate:bool ->
+  Buffer.t ->
+  ((unit, Error.t) result -> unit) ->
+    unit
+(** Flushes changes made to a mapped region to the file, on the thread pool.
+
+    The buffer can be any view into a mapping. [~invalidate:true] also
+    invalidates other mappings of the same file, so that they see the written
+    data.
+
+    Binds {{:http://man7.org/linux/man-pages/man2/msync.2.html} [msync(2)]}
+    with [MS_SYNC]. *)
+
+type advice = [
+  | `NORMAL
+  | `RANDOM
+  | `SEQUENTIAL
+  | `WILLNEED
+  | `DONTNEED
+]
+
+val madvise :
+  ?loop:Loop.t ->
+  Buffer.t ->
+  advice ->
+  ((unit, Error.t) result -> unit) ->
+    unit
+(** Advises the kernel on how a mapped region will be accessed, on the thread
+    pool.
+
+    For example, [`WILLNEED] starts reading the region into memory ahead of
+    time, so that later reads of the buffer, for example by {!Luv.Stream.write},
+    don't block the loop.
+
+    Binds {{:http://man7.org/linux/man-pages/man2/madvise.2.html}
+    [madvise(2)]}. *)
+
+
+
 (** {1 Conversions} *)
 
 val get_osfhandle : t -> (Os_fd.Fd.t, Error.t) result
@@ -1162,6 +1318,27 @@ val to_int : t -> int
     with {!Luv.Process}, the API of which assumes that files are represented by
     integers. *)
 
+val use_io_uring : ?if_not_already_set:bool -> bool -> unit
+(** Sets [UV_USE_IO_URING], which controls whether libuv performs file
+    operations through io_uring on Linux, rather than by handing them off to
+    the thread pool.
+
+    With io_uring, each asynchronous read, write, fsync, open, close, and stat
+    is queued in the loop's submission ring, and the operations queued during
+    one iteration of the loop are submitted together by a single system call.
+    No thread pool worker is involved, so throughput is not limited by
+    {!Luv.Thread_pool.set_size}. Operations that libuv doesn't support over
+    io_uring, and all synchronous operations, still use the thread pool or run
+    on the calling thread.
+
+    libuv reads the variable once, when the first loop is initialized, so this
+    function should be called as soon during process startup as possible. It
+    has no effect on systems other than Linux, and before libuv 1.45.0, which
+    doesn't support io_uring. libuv 1.45.0 through 1.48.0 use io_uring by
+    default, and since libuv 1.49.0 it must be enabled. A single loop can
+    instead use a dedicated io_uring instance with
+    {!Luv.Loop.Option.use_io_uring_sqpoll}. *)
+
 (**/**)
 
 val from_int : int -> t
@@ -13,6 +13,13 @@ include Helpers.Retained
 let is_closing handle =
   C.Functions.Handle.is_closing (coerce handle)
 
+(* The GC root of a closed handle may already have been released. *)
+let pool handle =
+  if is_closing handle then
+    None
+  else
+    pool handle
+
 let close_trampoline =
   C.Functions.Handle.get_close_trampoline ()
 
@@ -124,8 +124,12 @@ val fileno :
 (* Internal functions; do not use. *)
 
 val allocate :
-  ?reference_count:int -> 'kind C.Types.Handle.t Ctypes.typ -> 'kind t
+  ?reference_count:int -> ?pool:Object_pool.t ->
+  'kind C.Types.Handle.t Ctypes.typ ->
+    'kind t
+val retain : ?reference_count:int -> _ t -> unit
 val release : _ t -> unit
+val pool : _ t -> Object_pool.t option
 val set_reference : ?index:int -> _ t -> _ -> unit
 val coerce :
   _ C.Types.Handle.t Ctypes.ptr -> [ `Base ] C.Types.Handle.t Ctypes.ptr
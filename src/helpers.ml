@@ -19,20 +19,69 @@ struct
   let coerce : _ t -> [ `Base ] t =
     Obj.magic
 
-  let allocate ?(reference_count = Object.default_reference_count) kind =
-    let references = Array.make reference_count ignore in
+  (* The reference array has one more slot than the C side uses. The last slot
+     holds the object's Object_pool free list, if the object was allocated from
+     a pool, or None. *)
+  let references c_object : Obj.t array =
+    Ctypes.Root.get (Object.get_data (coerce c_object))
 
-    let c_object = Ctypes.addr (Ctypes.make kind) in
+  let free_list_of references : Object_pool.free_list option =
+    Obj.obj references.(Array.length references - 1)
+
+  let retain_in
+      ?(reference_count = Object.default_reference_count) free_list c_object =
+
+    let references = Array.make (reference_count + 1) ignore in
     references.(C.Types.Handle.self_reference_index) <- Obj.magic c_object;
+    references.(reference_count) <- Obj.magic free_list;
 
     let gc_root = Ctypes.Root.create references in
-    Object.set_data (coerce c_object) gc_root;
+    Object.set_data (coerce c_object) gc_root
 
-    c_object
+  let retain ?reference_count c_object =
+    retain_in ?reference_count None c_object
 
-  let release c_object =
+  let release_root c_object =
     Ctypes.Root.release (Object.get_data (coerce c_object))
 
+  let release_free_object c_object =
+    release_root (Obj.obj c_object)
+
+  let allocate ?reference_count ?pool kind =
+    let fresh free_list =
+      let c_object = Ctypes.addr (Ctypes.make kind) in
+      retain_in ?reference_count free_list c_object;
+      c_object
+    in
+    match pool with
+    | None ->
+      fresh None
+    | Some pool ->
+      let free_list =
+        Object_pool.free_list pool kind ~release:release_free_object in
+      match Object_pool.take free_list with
+      | Some c_object -> c_object
+      | None -> fresh (Some free_list)
+
+  (* A pooled object keeps its GC root while it is free, but its callbacks are
+     dropped, so that whatever they captured can be collected. *)
+  let release c_object =
+    let references = references c_object in
+    match free_list_of references with
+    | None ->
+      release_root c_object
+    | Some free_list ->
+      let first = C.Types.Handle.self_reference_index + 1 in
+      Array.fill
+        references first (Array.length references - 1 - first) (Obj.repr ignore);
+      if not (Object_pool.put free_list c_object) then
+        release_root c_object
+
+  let pool c_object =
+    match free_list_of (references c_object) with
+    | None -> None
+    | Some free_list -> Some (Object_pool.owner free_list)
+
   let set_reference
       ?(index = C.Types.Handle.generic_callback_index) c_object value =
 
@@ -43,15 +92,18 @@ end
 
 module Buf =
 struct
-  let bigstrings_to_iovecs bigstrings count =
-    let iovecs = Ctypes.CArray.make C.Types.Buf.t count in
+  let fill_iovecs iovecs bigstrings =
     bigstrings |> List.iteri begin fun index bigstring ->
       let iovec = Ctypes.CArray.get iovecs index in
       let base = Ctypes.(bigarray_start array1) bigstring in
       let length = Bigarray.Array1.dim bigstring in
       Ctypes.setf iovec C.Types.Buf.base base;
       Ctypes.setf iovec C.Types.Buf.len (Unsigned.Size_t.of_int length)
-    end;
+    end
+
+  let bigstrings_to_iovecs bigstrings count =
+    let iovecs = Ctypes.CArray.make C.Types.Buf.t count in
+    fill_iovecs iovecs bigstrings;
     iovecs
 end
 
@@ -19,8 +19,12 @@ module Retained (Object : WITH_DATA_FIELD) :
 sig
   type 'kind t = ('kind Object.t) Ctypes.ptr
 
-  val allocate : ?reference_count:int -> ('kind Object.t) Ctypes.typ -> 'kind t
+  val allocate :
+    ?reference_count:int -> ?pool:Object_pool.t -> ('kind Object.t) Ctypes.typ ->
+      'kind t
+  val retain : ?reference_count:int -> _ t -> unit
   val release : _ t -> unit
+  val pool : _ t -> Object_pool.t option
   val set_reference : ?index:int -> _ t -> _ -> unit
   val coerce : _ t -> [ `Base ] t
 end
@@ -28,6 +32,7 @@ end
 module Buf :
 sig
   val bigstrings_to_iovecs : Buffer.t list -> int -> C.Types.Buf.t Ctypes.carray
+  val fill_iovecs : C.Types.Buf.t Ctypes.carray -> Buffer.t list -> unit
 end
 
 module Bit_field :
@@ -87,6 +87,14 @@ sig
   val sigprof : int
 
   val idle_time : unit t
+
+  val use_io_uring_sqpoll : unit t
+  (** Makes the loop perform file operations through an io_uring instance
+      with a kernel submission polling thread, instead of through the thread
+      pool. Must be set before the first file operation on the loop.
+
+      Requires libuv 1.49.0, and Linux. With earlier libuv, configuring this
+      option fails with [`ENOSYS]. See also {!Luv.File.use_io_uring}. *)
 end
 
 val configure : t -> 'value Option.t -> 'value -> (unit, Error.t) result
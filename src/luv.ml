@@ -25,10 +25,12 @@ module Loop = Loop
 module Handle = Handle
 module Request = Request
 module Timer = Timer
+module Timer_wheel = Timer_wheel
 module Prepare = Prepare
 module Check = Check
 module Idle = Idle
 module Async = Async
+module Channel = Channel
 module Poll = Poll
 module Signal = Signal
 module Process = Process
@@ -42,6 +44,7 @@ module FS_poll = FS_poll
 module File = File
 module Thread_pool = Thread_pool
 module DNS = DNS
+module Resolver = Resolver
 module DLL = DLL
 module Thread = Thread
 module TLS = TLS
@@ -51,7 +54,10 @@ module Rwlock = Rwlock
 module Semaphore = Semaphore
 module Condition = Condition
 module Barrier = Barrier
+module Sharded_server = Sharded_server
 module Buffer = Buffer
+module Buffer_pool = Buffer_pool
+module Object_pool = Object_pool
 module Os_fd = Os_fd
 module Sockaddr = Sockaddr
 module Resource = Resource
@@ -64,6 +70,7 @@ module Env = Env
 module Time = Time
 module Random = Random
 module Metrics = Metrics
+module Trace = Trace
 module String = String_
 module Require = Require
 module Unix = Luv_unix
@@ -22,3 +22,100 @@ let info loop =
      events = Ctypes.getf c_metrics M.events;
      events_waiting = Ctypes.getf c_metrics M.events_waiting;
    }
+
+type histogram = {
+  count : int;
+  total : int;
+  min : int;
+  max : int;
+  buckets : (int * int) list;
+}
+
+type instrumentation = {
+  callbacks : (string * histogram) list;
+  iterations : int;
+  poll_time : int;
+  callback_time : int;
+  lag : histogram;
+  work_wait : histogram;
+}
+
+let enable_instrumentation loop =
+  C.Functions.Metrics.instrumentation_enable loop
+  |> Error.to_result ()
+
+let disable_instrumentation =
+  C.Functions.Metrics.instrumentation_disable
+
+(* Inverse of luv_histogram_index in src/c/helpers.c: the largest value that
+   falls into each bucket. *)
+let bucket_upper_bound index =
+  let sub_buckets = C.Types.Metrics.histogram_sub_buckets in
+  if index < sub_buckets then
+    index
+  else
+    let shift = index / sub_buckets - 1 in
+    ((sub_buckets + index mod sub_buckets + 1) lsl shift) - 1
+
+let read_histogram array offset =
+  let get index =
+    Unsigned.UInt64.to_int (Ctypes.CArray.get array (offset + index)) in
+  let buckets = ref [] in
+  for index = C.Types.Metrics.histogram_size - 5 downto 0 do
+    let count = get (4 + index) in
+    if count > 0 then
+      buckets := (bucket_upper_bound index, count)::!buckets
+  done;
+  {
+    count = get 0;
+    total = get 1;
+    min = get 2;
+    max = get 3;
+    buckets = !buckets;
+  }
+
+let instrumentation ?(reset = false) loop =
+  let module M = C.Types.Metrics in
+  let totals = Ctypes.CArray.make Ctypes.uint64_t 3 in
+  let histograms =
+    Ctypes.CArray.make Ctypes.uint64_t (M.histogram_count * M.histogram_size)
+  in
+  C.Functions.Metrics.instrumentation_read
+    loop (Ctypes.CArray.start totals) (Ctypes.CArray.start histograms) reset
+  |> Error.to_result_f @@ fun () ->
+
+  let histogram kind = read_histogram histograms (kind * M.histogram_size) in
+  let total index = Unsigned.UInt64.to_int (Ctypes.CArray.get totals index) in
+
+  let callbacks = ref [] in
+  for kind = M.lag - 1 downto 0 do
+    let histogram = histogram kind in
+    if histogram.count > 0 then
+      match C.Functions.Metrics.instrumentation_kind_name kind with
+      | Some name -> callbacks := (name, histogram)::!callbacks
+      | None -> ()
+  done;
+
+  {
+    callbacks = !callbacks;
+    iterations = total 0;
+    poll_time = total 1;
+    callback_time = total 2;
+    lag = histogram M.lag;
+    work_wait = histogram M.work_wait;
+  }
+
+let percentile histogram fraction =
+  let rank =
+    int_of_float (ceil (fraction *. float_of_int histogram.count)) in
+  let rec find seen = function
+    | [] ->
+      histogram.max
+    | (upper_bound, count)::rest ->
+      let seen = seen + count in
+      if seen >= rank then
+        max histogram.min (min upper_bound histogram.max)
+      else
+        find seen rest
+  in
+  find 0 histogram.buckets
@@ -0,0 +1,73 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(* A pool holds one free list for each kind of C struct, found by the physical
+   identity of the struct's Ctypes type. Free objects are kept as they were
+   when released: their GC root and reference array stay allocated, and are
+   reused along with the struct. The last slot of the reference array of a
+   pooled object points to its free list. See Helpers.Retained. *)
+
+type t = {
+  capacity : int;
+  mutable free_lists : (Obj.t * free_list) list;
+}
+
+and free_list = {
+  pool : t;
+  release : Obj.t -> unit;
+  mutable objects : Obj.t list;
+  mutable count : int;
+}
+
+let default_capacity = 1024
+
+let create ?(capacity = default_capacity) () =
+  {
+    capacity = max 0 capacity;
+    free_lists = [];
+  }
+
+let free_list pool kind ~release =
+  let kind = Obj.repr kind in
+  match List.assq kind pool.free_lists with
+  | free_list ->
+    free_list
+  | exception Not_found ->
+    let free_list = {pool; release; objects = []; count = 0} in
+    pool.free_lists <- (kind, free_list)::pool.free_lists;
+    free_list
+
+let take free_list =
+  match free_list.objects with
+  | [] ->
+    None
+  | c_object::rest ->
+    free_list.objects <- rest;
+    free_list.count <- free_list.count - 1;
+    Some (Obj.obj c_object)
+
+let put free_list c_object =
+  if free_list.count >= free_list.pool.capacity then
+    false
+  else begin
+    free_list.objects <- (Obj.repr c_object)::free_list.objects;
+    free_list.count <- free_list.count + 1;
+    true
+  end
+
+let owner free_list =
+  free_list.pool
+
+let available pool =
+  List.fold_left
+    (fun total (_, free_list) -> total + free_list.count) 0 pool.free_lists
+
+let clear pool =
+  pool.free_lists |> List.iter begin fun (_, free_list) ->
+    let objects = free_list.objects in
+    free_list.objects <- [];
+    free_list.count <- 0;
+    List.iter free_list.release objects
+  end
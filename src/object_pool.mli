@@ -0,0 +1,70 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(** Recycling of handles and requests.
+
+    Each {!Luv.TCP.t}, {!Luv.Pipe.t}, {!Luv.UDP.t}, and {!Luv.Timer.t}, and each
+    request made on such a handle, is by default a fresh C struct, together with
+    an OCaml array of references to its callbacks and a GC root for that array.
+    All three are dropped when the handle is closed, or the request completes.
+    A server handling many short-lived connections therefore allocates, and
+    the GC collects, several such objects per connection.
+
+    An object pool instead keeps closed handles and completed requests, with
+    their arrays and GC roots, and hands them out again:
+
+    {[
+      let pool = Luv.Object_pool.create () in
+
+      Luv.Stream.listen server (fun _ ->
+        let client = Luv.TCP.init ~object_pool:pool () |> Result.get_ok in
+        Luv.Stream.accept ~server ~client |> ignore;
+        ...)
+    ]}
+
+    A handle is taken from the pool when passed [~object_pool] at
+    initialization, and returned to it once it is closed, after its close
+    callback. Write, connect, and shutdown requests on a pooled stream, and send
+    requests on a pooled UDP socket, are taken from and returned to the same
+    pool automatically.
+
+    Because the same C struct is reused, a handle must not be used at all after
+    it is closed: by then, it may already have been handed out again, and be in
+    use as another handle.
+
+    Pools are not thread-safe. Each pool should be used only by the thread
+    running the loop of the handles allocated from it. *)
+
+type t
+(** Object pools. *)
+
+val create : ?capacity:int -> unit -> t
+(** Creates an empty pool.
+
+    [?capacity] is the largest number of free objects of each kind the pool
+    keeps. Objects released while the pool is full are dropped as usual. The
+    default is 1024. *)
+
+val available : t -> int
+(** Number of free objects held by the pool, across all kinds. *)
+
+val clear : t -> unit
+(** Drops all free objects held by the pool.
+
+    Handles and requests still in use remain associated with the pool, and are
+    returned to it when they are released. *)
+
+
+
+(**/**)
+
+(* Internal functions; do not use. *)
+
+type free_list
+
+val free_list : t -> _ Ctypes.typ -> release:(Obj.t -> unit) -> free_list
+val take : free_list -> 'a option
+val put : free_list -> 'a -> bool
+val owner : free_list -> t
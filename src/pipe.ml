@@ -17,8 +17,8 @@ struct
     | `WRITABLE -> writable
 end
 
-let init ?loop ?(for_handle_passing = false) () =
-  let pipe = Stream.allocate C.Types.Pipe.t in
+let init ?loop ?(for_handle_passing = false) ?object_pool () =
+  let pipe = Stream.allocate ?object_pool C.Types.Pipe.t in
   C.Functions.Pipe.init (Loop.or_default loop) pipe for_handle_passing
   |> Error.to_result pipe
 
@@ -56,7 +56,7 @@ let bind ?(no_truncate = false) pipe name =
   |> Error.to_result ()
 
 let connect ?(no_truncate = false) pipe name_or_path callback =
-  let request = Stream.Connect_request.make () in
+  let request = Stream.Connect_request.make ?object_pool:(Handle.pool pipe) () in
   let callback result =
     Error.catch_exceptions callback (Error.to_result () result)
   in
@@ -22,14 +22,21 @@ type t = [ `Pipe ] Stream.t
     {!Luv.Stream.read_start}, {!Luv.Stream.write}. *)
 
 val init :
-  ?loop:Loop.t -> ?for_handle_passing:bool -> unit -> (t, Error.t) result
+  ?loop:Loop.t ->
+  ?for_handle_passing:bool ->
+  ?object_pool:Object_pool.t ->
+  unit ->
+    (t, Error.t) result
 (** Allocates and initializes a pipe.
 
     Binds {{:http://docs.libuv.org/en/v1.x/pipe.html#c.uv_pipe_init}
     [uv_pipe_init]}.
 
     The pipe is not yet connected to anything at this point. See
-    {!Luv.Pipe.bind}, {!Luv.Stream.listen}, and {!Luv.Pipe.connect}. *)
+    {!Luv.Pipe.bind}, {!Luv.Stream.listen}, and {!Luv.Pipe.connect}.
+
+    If [?object_pool] is given, the pipe is taken from it, and returned to it
+    when closed. See {!Luv.Object_pool}. *)
 
 val open_ : t -> File.t -> (unit, Error.t) result
 (** Wraps an existing file descriptor in a libuv pipe.
@@ -43,7 +43,9 @@ val cancel :
 (* Internal functions; do not use. *)
 
 val allocate :
-  ?reference_count:int -> 'kind C.Types.Request.t Ctypes.typ -> 'kind t
+  ?reference_count:int -> ?pool:Object_pool.t ->
+  'kind C.Types.Request.t Ctypes.typ ->
+    'kind t
 val set_callback : _ t -> (_ -> unit) -> unit
 val set_reference : ?index:int -> _ t -> _ -> unit
 val release : _ t -> unit
@@ -0,0 +1,665 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(* Splits on a separator character. String.split_on_char is not available in
+   OCaml 4.03. *)
+let split_on separator string =
+  let rec split start index acc =
+    if index = String.length string then
+      List.rev ((String.sub string start (index - start))::acc)
+    else if string.[index] = separator then
+      split (index + 1) (index + 1)
+        ((String.sub string start (index - start))::acc)
+    else
+      split start (index + 1) acc
+  in
+  split 0 0 []
+
+(* The words of a line of /etc/resolv.conf or /etc/hosts, up to any comment. *)
+let words line =
+  let line =
+    match String.index line '#' with
+    | exception Not_found -> line
+    | index -> String.sub line 0 index
+  in
+  let line = String.map (function '\t' | '\r' -> ' ' | c -> c) line in
+  List.filter (fun word -> word <> "") (split_on ' ' line)
+
+let lines text =
+  split_on '\n' text
+
+let read_file path =
+  match open_in_bin path with
+  | exception Sys_error _ ->
+    None
+  | channel ->
+    match really_input_string channel (in_channel_length channel) with
+    | exception (Sys_error _ | End_of_file) ->
+      close_in_noerr channel;
+      None
+    | text ->
+      close_in_noerr channel;
+      Some text
+
+let strip_root name =
+  let length = String.length name in
+  if length > 0 && name.[length - 1] = '.' then
+    String.sub name 0 (length - 1)
+  else
+    name
+
+let normalize name =
+  String.lowercase_ascii (strip_root name)
+
+
+
+module Config =
+struct
+  type t = {
+    nameservers : Sockaddr.t list;
+    search : string list;
+    ndots : int;
+    timeout : int;
+    attempts : int;
+  }
+
+  let nameserver address =
+    match Sockaddr.ipv4 address 53 with
+    | Ok address ->
+      Some address
+    | Error _ ->
+      match Sockaddr.ipv6 address 53 with
+      | Ok address -> Some address
+      | Error _ -> None
+
+  let default () =
+    let nameservers =
+      match nameserver "127.0.0.1" with
+      | Some address -> [address]
+      | None -> []
+    in
+    {nameservers; search = []; ndots = 1; timeout = 5000; attempts = 2}
+
+  let apply_option config word =
+    let value prefix =
+      let length = String.length prefix in
+      let rest = String.length word - length in
+      if rest > 0 && String.sub word 0 length = prefix then
+        match int_of_string (String.sub word length rest) with
+        | exception Failure _ -> None
+        | value -> Some (max 0 value)
+      else
+        None
+    in
+    match value "ndots:", value "timeout:", value "attempts:" with
+    | Some ndots, _, _ -> {config with ndots = min ndots 15}
+    | _, Some timeout, _ -> {config with timeout = max 1 timeout * 1000}
+    | _, _, Some attempts -> {config with attempts = max 1 (min attempts 5)}
+    | _ -> config
+
+  let parse text =
+    let default = default () in
+    let config, nameservers =
+      List.fold_left begin fun (config, nameservers) line ->
+        match words line with
+        | "nameserver"::address::_ ->
+          begin match nameserver address with
+          | Some address -> config, address::nameservers
+          | None -> config, nameservers
+          end
+        | "domain"::domain::_ ->
+          {config with search = [strip_root domain]}, nameservers
+        | "search"::domains ->
+          {config with search = List.map strip_root domains}, nameservers
+        | "options"::options ->
+          List.fold_left apply_option config options, nameservers
+        | _ ->
+          config, nameservers
+      end
+        (default, []) (lines text)
+    in
+    match nameservers with
+    | [] -> config
+    | _ -> {config with nameservers = List.rev nameservers}
+
+  let load ?(path = "/etc/resolv.conf") () =
+    match read_file path with
+    | None -> default ()
+    | Some text -> parse text
+end
+
+module Hosts =
+struct
+  type t = (string * [ `A | `AAAA ], string) Hashtbl.t
+
+  let parse text =
+    let hosts = Hashtbl.create 16 in
+    lines text |> List.iter begin fun line ->
+      match words line with
+      | address::names ->
+        let family =
+          match Sockaddr.ipv4 address 0, Sockaddr.ipv6 address 0 with
+          | Ok _, _ -> Some `A
+          | _, Ok _ -> Some `AAAA
+          | _ -> None
+        in
+        begin match family with
+        | Some family ->
+          names |> List.iter (fun name ->
+            Hashtbl.add hosts (normalize name, family) address)
+        | None ->
+          ()
+        end
+      | [] ->
+        ()
+    end;
+    hosts
+
+  let load ?(path = "/etc/hosts") () =
+    match read_file path with
+    | None -> parse ""
+    | Some text -> parse text
+
+  let find hosts name family =
+    List.rev (Hashtbl.find_all hosts (normalize name, family))
+end
+
+module Srv =
+struct
+  type t = {
+    priority : int;
+    weight : int;
+    port : int;
+    target : string;
+  }
+end
+
+
+
+(* Encoding of queries, and decoding of responses. See RFC 1035, section 4. *)
+module Wire =
+struct
+  let type_a = 1
+  let type_cname = 5
+  let type_aaaa = 28
+  let type_srv = 33
+
+  let rcode_no_error = 0
+  let rcode_name_error = 3
+
+  exception Malformed
+
+  let set_uint16 bytes offset value =
+    Bytes.set bytes offset (Char.chr ((value lsr 8) land 0xff));
+    Bytes.set bytes (offset + 1) (Char.chr (value land 0xff))
+
+  let uint8 message offset =
+    if offset < 0 || offset >= String.length message then
+      raise Malformed
+    else
+      Char.code (String.unsafe_get message offset)
+
+  let uint16 message offset =
+    ((uint8 message offset) lsl 8) lor (uint8 message (offset + 1))
+
+  let encode_query id name qtype =
+    let labels = split_on '.' name in
+    let invalid label = label = "" || String.length label > 63 in
+    let name_length =
+      List.fold_left
+        (fun length label -> length + 1 + String.length label) 1 labels
+    in
+    if List.exists invalid labels || name_length > 255 then
+      None
+    else begin
+      let query = Bytes.make (12 + name_length + 4) '\000' in
+      set_uint16 query 0 id;
+      (* Recursion desired. *)
+      set_uint16 query 2 0x0100;
+      set_uint16 query 4 1;
+      let offset =
+        List.fold_left begin fun offset label ->
+          let length = String.length label in
+          Bytes.set query offset (Char.chr length);
+          String.blit label 0 query (offset + 1) length;
+          offset + 1 + length
+        end
+          12 labels
+      in
+      set_uint16 query (offset + 1) qtype;
+      set_uint16 query (offset + 3) 1;
+      Some (Bytes.unsafe_to_string query)
+    end
+
+  (* Returns the name, and the offset just past it in its original position.
+     Follows compression pointers, but only a bounded number of them, so that
+     pointer loops can't hang the loop. *)
+  let read_name message offset =
+    let labels = ref [] in
+    let rec read offset jumps end_ =
+      let length = uint8 message offset in
+      if length = 0 then
+        match end_ with
+        | Some end_ -> end_
+        | None -> offset + 1
+      else if length land 0xc0 = 0xc0 then begin
+        if jumps >= 64 then
+          raise Malformed;
+        let target =
+          ((length land 0x3f) lsl 8) lor (uint8 message (offset + 1)) in
+        let end_ =
+          match end_ with
+          | Some _ -> end_
+          | None -> Some (offset + 2)
+        in
+        read target (jumps + 1) end_
+      end
+      else if length land 0xc0 <> 0 then
+        raise Malformed
+      else begin
+        if offset + length >= String.length message then
+          raise Malformed;
+        labels := (String.sub message (offset + 1) length)::!labels;
+        read (offset + 1 + length) jumps end_
+      end
+    in
+    let end_ = read offset 0 None in
+    String.lowercase_ascii (String.concat "." (List.rev !labels)), end_
+
+  type record = {
+    name : string;
+    rtype : int;
+    rdata : int;
+    rdlength : int;
+  }
+
+  type response = {
+    id : int;
+    truncated : bool;
+    rcode : int;
+    question : (string * int) list;
+    answers : record list;
+    message : string;
+  }
+
+  let decode message =
+    let decode () =
+      let id = uint16 message 0 in
+      let flags = uint16 message 2 in
+      if flags land 0x8000 = 0 then
+        raise Malformed;
+      let truncated = flags land 0x0200 <> 0 in
+      let rec questions offset count acc =
+        if count = 0 then
+          offset, List.rev acc
+        else
+          let name, offset = read_name message offset in
+          let qtype = uint16 message offset in
+          questions (offset + 4) (count - 1) ((name, qtype)::acc)
+      in
+      let offset, question = questions 12 (uint16 message 4) [] in
+      let rec answers offset count acc =
+        if count = 0 then
+          List.rev acc
+        else
+          let name, offset = read_name message offset in
+          let rtype = uint16 message offset in
+          let rdlength = uint16 message (offset + 8) in
+          let rdata = offset + 10 in
+          if rdata + rdlength > String.length message then
+            raise Malformed;
+          answers
+            (rdata + rdlength) (count - 1) ({name; rtype; rdata; rdlength}::acc)
+      in
+      (* A truncated response is only a signal to retry over TCP, and its
+         answer section may be cut off anywhere. *)
+      let answers =
+        if truncated then [] else answers offset (uint16 message 6) [] in
+      {id; truncated; rcode = flags land 0x000f; question; answers; message}
+    in
+    match decode () with
+    | response -> Some response
+    | exception Malformed -> None
+
+  (* The records of the given type for the given name, following CNAME records
+     in the answer section. *)
+  let records response name rtype =
+    let rec follow name hops =
+      let matching record = record.name = name && record.rtype = rtype in
+      match List.filter matching response.answers with
+      | [] when hops < 8 ->
+        let is_alias record = record.name = name && record.rtype = type_cname in
+        begin match List.find is_alias response.answers with
+        | exception Not_found -> []
+        | alias ->
+          let target, _ = read_name response.message alias.rdata in
+          follow target (hops + 1)
+        end
+      | records ->
+        records
+    in
+    follow name 0
+
+  let ipv4 response record =
+    if record.rdlength <> 4 then
+      raise Malformed;
+    let byte index = uint8 response.message (record.rdata + index) in
+    Printf.sprintf "%i.%i.%i.%i" (byte 0) (byte 1) (byte 2) (byte 3)
+
+  let ipv6 response record =
+    if record.rdlength <> 16 then
+      raise Malformed;
+    let group index = uint16 response.message (record.rdata + index * 2) in
+    String.concat ":"
+      (List.map (fun index -> Printf.sprintf "%x" (group index))
+        [0; 1; 2; 3; 4; 5; 6; 7])
+
+  let srv response record =
+    if record.rdlength < 7 then
+      raise Malformed;
+    let field index = uint16 response.message (record.rdata + index * 2) in
+    {
+      Srv.priority = field 0;
+      weight = field 1;
+      port = field 2;
+      target = fst (read_name response.message (record.rdata + 6));
+    }
+end
+
+
+
+type t = {
+  loop : Loop.t;
+  config : Config.t;
+  hosts : Hosts.t;
+  mutable next_id : int;
+}
+
+let create ?loop ?config ?hosts () =
+  let config =
+    match config with
+    | Some config -> config
+    | None -> Config.load ()
+  in
+  let hosts =
+    match hosts with
+    | Some hosts -> hosts
+    | None -> Hosts.load ()
+  in
+  {loop = Loop.or_default loop; config; hosts; next_id = 0}
+
+(* Query IDs are random, so that off-path attackers have to guess them, along
+   with the source port, which the kernel chooses at random for each query. *)
+let query_id resolver =
+  let bytes = Buffer.create 2 in
+  match Random.Sync.random bytes with
+  | Ok () ->
+    let byte index = Char.code (Buffer.get bytes index) in
+    ((byte 0) lsl 8) lor (byte 1)
+  | Error _ ->
+    resolver.next_id <- (resolver.next_id + 1) land 0xffff;
+    resolver.next_id
+
+(* Runs the exchange with one server. The exchange calls its argument at most
+   once, with a response or error. Afterwards, or when the resolver's timeout
+   passes, the exchange's handles are closed, and callback is called with the
+   result. *)
+let with_timeout resolver exchange callback =
+  match Timer.init ~loop:resolver.loop () with
+  | Error e ->
+    callback (Error e)
+  | Ok timer ->
+    let finished = ref false in
+    let cleanup = ref ignore in
+    let finish result =
+      if not !finished then begin
+        finished := true;
+        !cleanup ();
+        Handle.close timer ignore;
+        callback result
+      end
+    in
+    begin match
+      Timer.start timer resolver.config.timeout (fun () ->
+        finish (Error `ETIMEDOUT))
+    with
+    | Error e -> finish (Error e)
+    | Ok () ->
+      let close = exchange finish in
+      if !finished then close () else cleanup := close
+    end
+
+let exchange_udp resolver server query accept finish =
+  match UDP.init ~loop:resolver.loop () with
+  | Error e ->
+    finish (Error e);
+    ignore
+  | Ok udp ->
+    begin match UDP.Connected.connect udp server with
+    | Error e ->
+      finish (Error e)
+    | Ok () ->
+      UDP.recv_start udp begin function
+        | Error e ->
+          finish (Error e)
+        | Ok (_, None, _) ->
+          ()
+        | Ok (buffer, Some _, _) ->
+          (* Datagrams that are not responses to this query are ignored, and
+             the exchange keeps waiting for the right one. *)
+          match Wire.decode (Buffer.to_string buffer) with
+          | Some response when accept response -> finish (Ok response)
+          | _ -> ()
+      end;
+      UDP.Connected.send udp [Buffer.from_string query] begin function
+        | Error e -> finish (Error e)
+        | Ok () -> ()
+      end
+    end;
+    fun () -> Handle.close udp ignore
+
+(* Over TCP, messages are prefixed with their length. See RFC 1035, section
+   4.2.2. *)
+let exchange_tcp resolver server query accept finish =
+  match TCP.init ~loop:resolver.loop () with
+  | Error e ->
+    finish (Error e);
+    ignore
+  | Ok tcp ->
+    TCP.connect tcp server begin function
+      | Error e ->
+        finish (Error e)
+      | Ok () ->
+        let prefix = Bytes.create 2 in
+        Wire.set_uint16 prefix 0 (String.length query);
+        let request = Bytes.unsafe_to_string prefix ^ query in
+        Stream.write tcp [Buffer.from_string request] begin fun result _ ->
+          match result with
+          | Error e -> finish (Error e)
+          | Ok () -> ()
+        end;
+        let chunks = ref [] in
+        Stream.read_start tcp begin function
+          | Error `EOF ->
+            finish (Error `EPROTO)
+          | Error e ->
+            finish (Error e)
+          | Ok buffer ->
+            chunks := (Buffer.to_string buffer)::!chunks;
+            let received = String.concat "" (List.rev !chunks) in
+            let received_length = String.length received in
+            if received_length >= 2 then begin
+              let length = Wire.uint16 received 0 in
+              if received_length >= 2 + length then
+                match Wire.decode (String.sub received 2 length) with
+                | Some response when accept response -> finish (Ok response)
+                | _ -> finish (Error `EPROTO)
+              else
+                chunks := [received]
+            end
+        end
+    end;
+    fun () -> Handle.close tcp ignore
+
+let usable response =
+  response.Wire.rcode = Wire.rcode_no_error ||
+  response.Wire.rcode = Wire.rcode_name_error
+
+(* Sends one query to each server in turn, for the configured number of
+   rounds, until one gives an answer or says that the name does not exist. A
+   truncated UDP response is retried over TCP with the same server. *)
+let query resolver name qtype callback =
+  let id = query_id resolver in
+  match Wire.encode_query id name qtype with
+  | None ->
+    callback (Error `EINVAL)
+  | Some query ->
+    let question = [String.lowercase_ascii name, qtype] in
+    let accept response =
+      response.Wire.id = id && response.Wire.question = question in
+    let servers = resolver.config.nameservers in
+    let rec try_servers round remaining last_error =
+      match remaining with
+      | [] ->
+        begin match servers with
+        | _::_ when round + 1 < resolver.config.attempts ->
+          try_servers (round + 1) servers last_error
+        | _ ->
+          callback (Error last_error)
+        end
+      | server::rest ->
+        let next error = try_servers round rest error in
+        let exchange = exchange_udp resolver server query accept in
+        with_timeout resolver exchange begin function
+          | Error e ->
+            next e
+          | Ok response when response.Wire.truncated ->
+            let exchange = exchange_tcp resolver server query accept in
+            with_timeout resolver exchange begin function
+              | Error e -> next e
+              | Ok response when usable response -> callback (Ok response)
+              | Ok _ -> next `EAI_FAIL
+            end
+          | Ok response when usable response ->
+            callback (Ok response)
+          | Ok _ ->
+            next `EAI_FAIL
+        end
+    in
+    try_servers 0 servers `EAI_FAIL
+
+(* The names to query for a name, with the search domains applied as in
+   resolv.conf(5). *)
+let candidates config name =
+  let length = String.length name in
+  if length > 0 && name.[length - 1] = '.' then
+    [strip_root name]
+  else begin
+    let dots = List.length (split_on '.' name) - 1 in
+    let searched =
+      List.map (fun domain -> name ^ "." ^ domain) config.Config.search in
+    if dots >= config.Config.ndots then
+      name::searched
+    else
+      searched @ [name]
+  end
+
+let lookup resolver name qtype convert callback =
+  let rec try_names = function
+    | [] ->
+      callback (Error `EAI_NONAME)
+    | name::rest ->
+      query resolver name qtype begin function
+        | Error e ->
+          callback (Error e)
+        | Ok response ->
+          let convert_all () =
+            let name = String.lowercase_ascii name in
+            List.map (convert response) (Wire.records response name qtype)
+          in
+          match convert_all () with
+          | exception Wire.Malformed ->
+            callback (Error `EPROTO)
+          | [] ->
+            begin match rest with
+            | [] ->
+              if response.Wire.rcode = Wire.rcode_name_error then
+                callback (Error `EAI_NONAME)
+              else
+                callback (Error `EAI_NODATA)
+            | _ ->
+              try_names rest
+            end
+          | values ->
+            callback (Ok values)
+      end
+  in
+  try_names (candidates resolver.config name)
+
+let addresses_of_family resolver ?(port = 0) family name callback =
+  let callback = Error.catch_exceptions callback in
+  let to_sockaddr, qtype, convert =
+    match family with
+    | `A -> Sockaddr.ipv4, Wire.type_a, Wire.ipv4
+    | `AAAA -> Sockaddr.ipv6, Wire.type_aaaa, Wire.ipv6
+  in
+  let to_sockaddrs addresses =
+    List.fold_right begin fun address sockaddrs ->
+      match to_sockaddr address port with
+      | Ok sockaddr -> sockaddr::sockaddrs
+      | Error _ -> sockaddrs
+    end
+      addresses []
+  in
+  (* A literal address of either family is answered without a query, even if
+     it is of the other family, in which case it has no addresses of this one. *)
+  match Sockaddr.ipv4 name port, Sockaddr.ipv6 name port with
+  | Ok address, _ when family = `A ->
+    callback (Ok [address])
+  | _, Ok address when family = `AAAA ->
+    callback (Ok [address])
+  | Ok _, _ | _, Ok _ ->
+    callback (Error `EAI_NODATA)
+  | Error _, Error _ ->
+    match Hosts.find resolver.hosts name family with
+    | _::_ as addresses ->
+      callback (Ok (to_sockaddrs addresses))
+    | [] ->
+      lookup resolver name qtype convert begin function
+        | Error _ as error -> callback error
+        | Ok addresses -> callback (Ok (to_sockaddrs addresses))
+      end
+
+let a resolver ?port name callback =
+  addresses_of_family resolver ?port `A name callback
+
+let aaaa resolver ?port name callback =
+  addresses_of_family resolver ?port `AAAA name callback
+
+let addresses resolver ?port name callback =
+  let callback = Error.catch_exceptions callback in
+  let ipv6 = ref None in
+  let ipv4 = ref None in
+  let combine () =
+    match !ipv6, !ipv4 with
+    | Some (Ok ipv6), Some (Ok ipv4) -> callback (Ok (ipv6 @ ipv4))
+    | Some (Ok ipv6), Some (Error _) -> callback (Ok ipv6)
+    | Some (Error _), Some (Ok ipv4) -> callback (Ok ipv4)
+    | Some (Error _), Some (Error _ as error) -> callback error
+    | _ -> ()
+  in
+  aaaa resolver ?port name (fun result -> ipv6 := Some result; combine ());
+  a resolver ?port name (fun result -> ipv4 := Some result; combine ())
+
+let srv resolver name callback =
+  let callback = Error.catch_exceptions callback in
+  lookup resolver name Wire.type_srv Wire.srv begin function
+    | Error _ as error ->
+      callback error
+    | Ok records ->
+      let by_priority record record' =
+        compare record.Srv.priority record'.Srv.priority in
+      callback (Ok (List.stable_sort by_priority records))
+  end
@@ -0,0 +1,162 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(** DNS client running on the loop.
+
+    {!Luv.DNS.getaddrinfo} calls the system resolver on a thread of the libuv
+    thread pool, which stays occupied for the whole lookup. A few slow lookups
+    can occupy the entire pool, delaying other work queued on it, such as
+    {!Luv.File} operations.
+
+    This module is instead a small DNS client, which sends queries with
+    {!Luv.UDP} and {!Luv.TCP}, and waits for responses on the loop, without
+    using any threads:
+
+    {[
+      let resolver = Luv.Resolver.create () in
+
+      Luv.Resolver.addresses resolver ~port:443 "example.com" (function
+        | Error e -> prerr_endline (Luv.Error.strerror e)
+        | Ok addresses -> connect addresses)
+    ]}
+
+    The resolver reads its configuration from [/etc/resolv.conf], and consults
+    [/etc/hosts] before querying the name servers. It supports A, AAAA, and SRV
+    records. It follows CNAME records given in answers, applies search domains
+    as described in {{:http://man7.org/linux/man-pages/man5/resolv.conf.5.html}
+    [resolv.conf(5)]}, and retries truncated responses over TCP. It does not
+    use other sources, such as NSS modules or mDNS, that the system resolver
+    may be configured to use.
+
+    A resolver can be used only from the thread running its loop. *)
+
+(** Resolver configuration. *)
+module Config :
+sig
+  type t = {
+    nameservers : Sockaddr.t list;
+      (** Servers to query, in order. *)
+    search : string list;
+      (** Domains to append to names with fewer than [ndots] dots. *)
+    ndots : int;
+    timeout : int;
+      (** Time to wait for each response, in milliseconds. *)
+    attempts : int;
+      (** Number of rounds of queries through all the servers. *)
+  }
+
+  val parse : string -> t
+  (** Parses the contents of a
+      {{:http://man7.org/linux/man-pages/man5/resolv.conf.5.html}
+      [resolv.conf(5)]} file.
+
+      The [nameserver], [domain], and [search] directives, and the [ndots],
+      [timeout], and [attempts] options, are understood. Everything else is
+      ignored. As in the system resolver, if there are no [nameserver]
+      directives, the server at [127.0.0.1] is used. *)
+
+  val load : ?path:string -> unit -> t
+  (** Reads and parses [?path], which is [/etc/resolv.conf] by default. If the
+      file cannot be read, returns the defaults.
+
+      The file is read synchronously. *)
+end
+
+(** Host name tables. *)
+module Hosts :
+sig
+  type t
+  (** Tables of names and addresses. *)
+
+  val parse : string -> t
+  (** Parses the contents of a
+      {{:http://man7.org/linux/man-pages/man5/hosts.5.html} [hosts(5)]} file.
+      Names are matched without regard to case. *)
+
+  val load : ?path:string -> unit -> t
+  (** Reads and parses [?path], which is [/etc/hosts] by default. If the file
+      cannot be read, returns an empty table.
+
+      The file is read synchronously. *)
+end
+
+(** SRV records. See {{:https://tools.ietf.org/html/rfc2782} RFC 2782}. *)
+module Srv :
+sig
+  type t = {
+    priority : int;
+    weight : int;
+    port : int;
+    target : string;
+  }
+end
+
+type t
+(** Resolvers. *)
+
+val create :
+  ?loop:Loop.t -> ?config:Config.t -> ?hosts:Hosts.t -> unit -> t
+(** Creates a resolver, which sends queries from [?loop].
+
+    If [?config] is not given, it is read with {!Luv.Resolver.Config.load}.
+    If [?hosts] is not given, it is read with {!Luv.Resolver.Hosts.load}. *)
+
+val a :
+  t ->
+  ?port:int ->
+  string ->
+  ((Sockaddr.t list, Error.t) result -> unit) ->
+    unit
+(** Looks up the IPv4 addresses of a name.
+
+    The addresses are returned as {!Luv.Sockaddr.t}, with port [?port], which
+    is 0 by default.
+
+    If the name is itself an IP address, or is listed in the hosts table, the
+    callback is called immediately, before this function returns. An IPv6
+    address results in [Error `EAI_NODATA]. Otherwise, the callback is called
+    from the loop, once the lookup completes.
+
+    The name servers are queried with each candidate name given by the search
+    domains in turn. If a name server reports that a name does not exist,
+    or does not have addresses of the requested family, the next candidate is
+    tried. If there are no more candidates, the result is [Error `EAI_NONAME]
+    or [Error `EAI_NODATA], respectively.
+
+    If no name server responds, the result is [Error `ETIMEDOUT]. If name
+    servers respond only with failures, the result is [Error `EAI_FAIL]. *)
+
+val aaaa :
+  t ->
+  ?port:int ->
+  string ->
+  ((Sockaddr.t list, Error.t) result -> unit) ->
+    unit
+(** Like {!Luv.Resolver.a}, but looks up IPv6 addresses. An IPv4 address
+    results in [Error `EAI_NODATA]. *)
+
+val addresses :
+  t ->
+  ?port:int ->
+  string ->
+  ((Sockaddr.t list, Error.t) result -> unit) ->
+    unit
+(** Looks up both the IPv6 and IPv4 addresses of a name, concurrently.
+
+    The result lists the IPv6 addresses first. If only one of the lookups
+    fails, the result has only the addresses from the other. If both fail, the
+    result is the error from the IPv4 lookup.
+
+    If the name is itself an IP address of either family, the callback is
+    called immediately with that address, without querying the name
+    servers. *)
+
+val srv :
+  t -> string -> ((Srv.t list, Error.t) result -> unit) -> unit
+(** Looks up the SRV records of a name, such as [_sip._udp.example.com].
+
+    The records are sorted by priority. Records with the same priority are in
+    the order in which the name server returned them. Choosing among them by
+    weight is left to the caller. *)
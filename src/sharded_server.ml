@@ -0,0 +1,240 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(* Each shard is a loop with a listener and a channel of closures to run on the
+   loop. All of them are set up by the thread calling start, before the shard
+   threads exist, so that setup errors can be returned directly. Stopping a
+   shard closes its listener and unrefs its channel, so that its loop exits once
+   its remaining connections are closed. join then tears down each loop on the
+   joining thread, only after all shard threads have exited, so that no shard
+   can send into a channel that is already closed. *)
+
+type shard = {
+  index : int;
+  loop : Loop.t;
+  listener : TCP.t;
+  channel : (unit -> unit) Channel.t;
+  mutable thread : Thread.t option;
+}
+
+type t = {
+  shards : shard array;
+  address : Sockaddr.t;
+}
+
+let run_loop ?mode loop =
+  ignore (Loop.run ~loop ?mode () : bool)
+
+let accept shard callback =
+  match TCP.init ~loop:shard.loop () with
+  | Error _ ->
+    ()
+  | Ok client ->
+    match Stream.accept ~server:shard.listener ~client with
+    | Error _ -> Handle.close client ignore
+    | Ok () -> callback shard client
+
+let create_shard ?backlog ?ipv6only index address callback =
+  match Loop.init () with
+  | Error e ->
+    Error e
+  | Ok loop ->
+    let abandon closers error =
+      List.iter (fun close -> close ()) closers;
+      run_loop loop;
+      ignore (Loop.close loop);
+      Error error
+    in
+    match Channel.init ~loop (fun f -> f ()) with
+    | Error e ->
+      abandon [] e
+    | Ok channel ->
+      let closers = [fun () -> Channel.close channel ignore] in
+      match TCP.init ~loop () with
+      | Error e ->
+        abandon closers e
+      | Ok listener ->
+        let closers = (fun () -> Handle.close listener ignore)::closers in
+        match TCP.bind ?ipv6only ~reuseport:true listener address with
+        | Error e ->
+          abandon closers e
+        | Ok () ->
+          let shard = {index; loop; listener; channel; thread = None} in
+          let immediate = ref true in
+          let failed = ref None in
+          Stream.listen ?backlog listener begin function
+            | Ok () -> accept shard callback
+            | Error e -> if !immediate then failed := Some e
+          end;
+          immediate := false;
+          match !failed with
+          | Some e -> abandon closers e
+          | None -> Ok shard
+
+let run_on shard f =
+  Channel.send shard.channel f
+
+let stop server =
+  server.shards |> Array.iter begin fun shard ->
+    run_on shard (fun () ->
+      Handle.close shard.listener ignore;
+      Handle.unref (Channel.async shard.channel))
+    |> ignore
+  end
+
+(* Closures sent to a shard after its loop has exited are still pending in its
+   channel. They are run here, before the channel is closed, so that they can
+   release what they hold. *)
+let teardown shard =
+  begin match shard.thread with
+  | None -> run_loop shard.loop
+  | Some _ -> ()
+  end;
+  Handle.ref (Channel.async shard.channel);
+  run_loop ~mode:`NOWAIT shard.loop;
+  Channel.close shard.channel ignore;
+  run_loop shard.loop;
+  Loop.close shard.loop
+
+let join server =
+  let first_error = ref (Ok ()) in
+  let record result =
+    match !first_error, result with
+    | Ok (), Error _ -> first_error := result
+    | _ -> ()
+  in
+  server.shards |> Array.iter begin fun shard ->
+    match shard.thread with
+    | None -> ()
+    | Some thread -> record (Thread.join thread)
+  end;
+  Array.iter (fun shard -> record (teardown shard)) server.shards;
+  !first_error
+
+(* Returns the size of CPU masks, and the CPUs that the calling thread may run
+   on. *)
+let allowed_cpus () =
+  match Thread.getaffinity (Thread.self ()) with
+  | Error e ->
+    Error e
+  | Ok mask ->
+    let cpus = ref [] in
+    for cpu = Bytes.length mask - 1 downto 0 do
+      if Bytes.get mask cpu <> '\000' then
+        cpus := cpu::!cpus
+    done;
+    Ok (Bytes.length mask, Array.of_list !cpus)
+
+let set_affinity thread mask_size cpu =
+  let mask = Bytes.make mask_size '\000' in
+  Bytes.set mask cpu '\001';
+  match Thread.setaffinity thread mask with
+  | Error e -> Error e
+  | Ok _ -> Ok ()
+
+let rec create_shards ?backlog ?ipv6only count address callback created =
+  let index = List.length created in
+  if index = count then
+    Ok (created, address)
+  else
+    match create_shard ?backlog ?ipv6only index address callback with
+    | Error e ->
+      Error (e, created)
+    | Ok shard ->
+      (* The first listener may have been bound to an ephemeral port. The
+         others must be bound to the same one. *)
+      let address =
+        if index = 0 then TCP.getsockname shard.listener else Ok address in
+      match address with
+      | Error e ->
+        Error (e, shard::created)
+      | Ok address ->
+        create_shards
+          ?backlog ?ipv6only count address callback (shard::created)
+
+let start
+    ?(shards = System_info.available_parallelism ()) ?(pin = false) ?backlog
+    ?ipv6only address callback =
+
+  let cpus = if pin then allowed_cpus () else Ok (0, [||]) in
+  match cpus with
+  | Error e ->
+    Error e
+  | Ok (mask_size, cpus) ->
+    let count = max 1 shards in
+    let discard created error =
+      let server = {shards = Array.of_list (List.rev created); address} in
+      stop server;
+      ignore (join server);
+      Error error
+    in
+    match create_shards ?backlog ?ipv6only count address callback [] with
+    | Error (e, created) ->
+      discard created e
+    | Ok (created, address) ->
+      let server = {shards = Array.of_list (List.rev created); address} in
+      let rec start_threads index =
+        if index = count then
+          Ok server
+        else
+          let shard = server.shards.(index) in
+          match Thread.create (fun () -> run_loop shard.loop) with
+          | Error e ->
+            discard created e
+          | Ok thread ->
+            shard.thread <- Some thread;
+            let pinned =
+              if Array.length cpus = 0 then
+                Ok ()
+              else
+                set_affinity
+                  thread mask_size cpus.(index mod Array.length cpus)
+            in
+            match pinned with
+            | Error e -> discard created e
+            | Ok () -> start_threads (index + 1)
+      in
+      start_threads 0
+
+let shards server =
+  Array.to_list server.shards
+
+let address server =
+  server.address
+
+let index shard =
+  shard.index
+
+let loop shard =
+  shard.loop
+
+let hand_off tcp shard callback =
+  let socket = Ctypes.allocate_n C.Types.Os_socket.t ~count:1 in
+  let result = C.Functions.TCP.duplicate_socket tcp socket in
+  if result < 0 then
+    Error.result_from_c result
+  else begin
+    let socket = Ctypes.(!@) socket in
+    let open_ () =
+      match TCP.init ~loop:shard.loop () with
+      | Error e ->
+        C.Functions.TCP.close_socket socket;
+        callback (Error e)
+      | Ok tcp ->
+        match TCP.open_ tcp socket with
+        | Error e ->
+          C.Functions.TCP.close_socket socket;
+          Handle.close tcp (fun () -> callback (Error e))
+        | Ok () ->
+          callback (Ok tcp)
+    in
+    match run_on shard open_ with
+    | Error e ->
+      C.Functions.TCP.close_socket socket;
+      Error e
+    | Ok () ->
+      Handle.close tcp ignore;
+      Ok ()
+  end
@@ -0,0 +1,140 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(** TCP servers with one loop per thread.
+
+    A loop runs on one thread, so a server with one listener on one loop can
+    use only one core. A sharded server instead runs several loops, each on its
+    own {!Luv.Thread.t}. Each loop, together with its thread, is a {e shard}.
+    Each shard has its own listener, bound to the same address with
+    [~reuseport:true] (see {!Luv.TCP.bind}), and the kernel spreads incoming
+    connections between the listeners:
+
+    {[
+      let server =
+        Luv.Sharded_server.start address (fun shard client ->
+          Luv.Stream.read_start client (function
+            | Error _ -> Luv.Handle.close client ignore
+            | Ok buffer -> handle_data shard client buffer))
+        |> Result.get_ok
+      in
+
+      (* Later, on any thread: *)
+      Luv.Sharded_server.stop server;
+      Luv.Sharded_server.join server |> ignore
+    ]}
+
+    Each connection is accepted by, and belongs to, the loop of the shard whose
+    listener received it. The callback passed to {!Luv.Sharded_server.start} is
+    called on that shard's thread. Handles and other objects of one shard must
+    be used only from that shard's thread. To run code on another shard, use
+    {!Luv.Sharded_server.run_on}, and to move a connection to another shard,
+    use {!Luv.Sharded_server.hand_off}.
+
+    All shard threads run in one OCaml runtime, so only one of them runs OCaml
+    code at a time. On OCaml 5, they all run in the domain that called
+    {!Luv.Sharded_server.start}, and share its runtime lock. What runs in
+    parallel is the work done without the lock: polling, accepting, reading,
+    and writing in libuv and the kernel, and {!Luv.Stream.send_file} and
+    {!Luv.Stream.proxy} transfers. A sharded server therefore spreads a server
+    that is bound by system calls over several cores, but doesn't speed up one
+    that is bound by its OCaml callbacks. On OCaml 5, such callbacks can hand
+    CPU-bound work to a [Luv_domain_pool.t] of the shard's loop, from the
+    [luv.domain_pool] library, which runs it on separate domains.
+
+    Sharded servers are supported by libuv 1.49.0 and later on the systems on
+    which [SO_REUSEPORT] spreads connections between sockets, and on Linux with
+    older libuv. Elsewhere, {!Luv.Sharded_server.start} fails with
+    [`ENOTSUP]. *)
+
+type t
+(** Sharded servers. *)
+
+type shard
+(** Shards, each a loop running on its own thread. *)
+
+val start :
+  ?shards:int ->
+  ?pin:bool ->
+  ?backlog:int ->
+  ?ipv6only:bool ->
+  Sockaddr.t ->
+  (shard -> TCP.t -> unit) ->
+    (t, Error.t) result
+(** Starts a server listening on the given address.
+
+    [?shards] is the number of shards. The default is
+    {!Luv.System_info.available_parallelism}.
+
+    If [~pin:true] is passed, each shard thread is pinned, with
+    {!Luv.Thread.setaffinity}, to one of the CPUs that the calling thread is
+    allowed to run on, going round-robin through them.
+
+    [?backlog] and [?ipv6only] are passed to the listener of each shard. See
+    {!Luv.Stream.listen} and {!Luv.TCP.bind}. If the address has port 0, all
+    shards listen on the port chosen for the first one. See
+    {!Luv.Sharded_server.address}.
+
+    All loops and listeners are set up before this function returns, and any
+    error in doing so is returned, after releasing everything already set up.
+    After that, the callback is called, on the accepting shard's thread, with
+    each incoming connection, already accepted into a {!Luv.TCP.t} on the
+    shard's loop. Errors in accepting individual connections are ignored. *)
+
+val stop : t -> unit
+(** Stops accepting connections.
+
+    Each shard closes its listener. Its loop then exits once it has no more
+    active handles or requests, typically after its remaining connections have
+    been closed.
+
+    This function does not wait for that. It can be called from any thread. *)
+
+val join : t -> (unit, Error.t) result
+(** Waits for the threads of all shards to exit, after
+    {!Luv.Sharded_server.stop}, and then releases their loops.
+
+    Closures passed to {!Luv.Sharded_server.run_on} or
+    {!Luv.Sharded_server.hand_off} that reach a shard after its loop has
+    exited are run on the thread calling [join], before the shard's loop is
+    closed. Neither function may be called for the server once [join] has
+    been called. *)
+
+val run_on : shard -> (unit -> unit) -> (unit, Error.t) result
+(** Runs a function on the thread of the given shard. Can be called from any
+    thread.
+
+    Calls with the same shard and from the same thread run in the order in
+    which they were made. See {!Luv.Channel}. *)
+
+val hand_off :
+  TCP.t -> shard -> ((TCP.t, Error.t) result -> unit) -> (unit, Error.t) result
+(** [Luv.Sharded_server.hand_off tcp shard callback] moves a connection to
+    [shard].
+
+    Must be called on the thread of the loop of [tcp]. The socket of [tcp] is
+    duplicated, and [tcp] is closed. On the thread of [shard], the duplicate is
+    opened in a new {!Luv.TCP.t} on the shard's loop, which is passed to
+    [callback].
+
+    Data already read from [tcp] is not carried over, and writes that have not
+    yet completed may be lost, so connections should be handed off before
+    reading from them, or while reading is stopped and no writes are pending.
+    Options set on the socket, such as {!Luv.TCP.nodelay}, are kept.
+
+    Not supported on Windows. *)
+
+val shards : t -> shard list
+(** The shards of the server, in order of their indexes. *)
+
+val address : t -> Sockaddr.t
+(** The address all shards listen on. If {!Luv.Sharded_server.start} was
+    called with port 0, this has the port that was chosen. *)
+
+val index : shard -> int
+(** The index of the shard, from 0 to the number of shards minus one. *)
+
+val loop : shard -> Loop.t
+(** The loop of the shard. *)
@@ -5,8 +5,11 @@
 
 type 'kind t = [ `Stream of 'kind ] Handle.t
 
-let allocate kind =
-  Handle.allocate ~reference_count:C.Types.Stream.reference_count kind
+let allocate ?object_pool kind =
+  Handle.allocate ?pool:object_pool ~reference_count:C.Types.Stream.reference_count kind
+
+let retain stream =
+  Handle.retain ~reference_count:C.Types.Stream.reference_count stream
 
 let coerce : type kind. kind t -> [ `Base ] t =
   Obj.magic
@@ -18,7 +21,10 @@ let shutdown stream callback =
   let wrapped_callback result =
     Error.catch_exceptions callback (Error.to_result () result)
   in
-  let request = Request.allocate C.Types.Stream.Shutdown_request.t in
+  let request =
+    Request.allocate
+      ?pool:(Handle.pool stream) C.Types.Stream.Shutdown_request.t
+  in
   Request.set_callback request wrapped_callback;
   let immediate_result =
     C.Functions.Stream.shutdown request (coerce stream) shutdown_trampoline in
@@ -58,7 +64,13 @@ let alloc_trampoline =
 let read_trampoline =
   C.Functions.Stream.get_read_trampoline ()
 
-let read_start ?(allocate = Buffer.create) stream callback =
+let read_start ?(allocate = Buffer.create) ?pool stream callback =
+  let allocate, discard =
+    match pool with
+    | None -> allocate, ignore
+    | Some pool -> Buffer_pool.allocate pool, Buffer_pool.release pool
+  in
+
   let last_allocated_buffer = ref None in
 
   let wrapped_callback = Error.catch_exceptions callback in
@@ -81,6 +93,10 @@ let read_start ?(allocate = Buffer.create) stream callback =
         Ok buffer
       end
       else begin
+        begin match !last_allocated_buffer with
+        | Some buffer -> discard buffer
+        | None -> ()
+        end;
         last_allocated_buffer := None;
         Error.result_from_c nread_or_error
       end
@@ -103,6 +119,47 @@ let read_start ?(allocate = Buffer.create) stream callback =
   if immediate_result < 0 then
     callback (Error.result_from_c immediate_result)
 
+type framing = [
+  | `Length_prefixed of int
+  | `Delimited of char
+]
+
+let read_frames ?(max_frame_size = 65536) stream framing callback =
+  let framing, parameter, max_frame_size =
+    match framing with
+    | `Length_prefixed prefix_length ->
+      if prefix_length <> 1 && prefix_length <> 2 && prefix_length <> 4 then
+        invalid_arg "Luv.Stream.read_frames: prefix length must be 1, 2, or 4";
+      let largest_encodable =
+        if prefix_length = 4 then max_frame_size
+        else (1 lsl (8 * prefix_length)) - 1
+      in
+      C.Types.Stream.Framing.length_prefixed,
+      prefix_length,
+      min max_frame_size largest_encodable
+    | `Delimited delimiter ->
+      C.Types.Stream.Framing.delimited, Char.code delimiter, max_frame_size
+  in
+  if max_frame_size < 0 then
+    invalid_arg "Luv.Stream.read_frames: negative maximum frame size";
+
+  let wrapped_callback = Error.catch_exceptions callback in
+  Handle.set_reference stream begin fun error_code frame ->
+    match frame with
+    | Some frame -> wrapped_callback (Ok frame)
+    | None -> wrapped_callback (Error.result_from_c error_code)
+  end;
+
+  let immediate_result =
+    C.Functions.Stream.read_frames_start
+      (coerce stream)
+      framing
+      (Unsigned.UInt.of_int parameter)
+      (Unsigned.Size_t.of_int max_frame_size)
+  in
+  if immediate_result < 0 then
+    callback (Error.result_from_c immediate_result)
+
 let read_stop stream =
   C.Functions.Stream.read_stop (coerce stream)
   |> Error.to_result ()
@@ -115,7 +172,9 @@ let write_general ?send_handle stream buffers callback =
   let bytes = Buffer.total_size buffers in
   let iovecs = Helpers.Buf.bigstrings_to_iovecs buffers count in
 
-  let request = Request.allocate C.Types.Stream.Write_request.t in
+  let request =
+    Request.allocate ?pool:(Handle.pool stream) C.Types.Stream.Write_request.t
+  in
 
   let wrapped_callback result =
     let module Sys = Compatibility.Sys in
@@ -151,8 +210,121 @@ let write_general ?send_handle stream buffers callback =
     callback (Error.result_from_c immediate_result) 0
   end
 
-let write stream buffers callback =
-  write_general ?send_handle:None stream buffers callback
+module Write_request =
+struct
+  type stream = [ `Base ] t
+
+  type t = {
+    request : [ `Write ] Request.t;
+    iovecs : C.Types.Buf.t Ctypes.carray;
+    capacity : int;
+    mutable stream : stream;
+    mutable buffers : Buffer.t list;
+    mutable bytes : int;
+    mutable callback : (unit, Error.t) result -> int -> unit;
+    mutable in_use : bool;
+    mutable released : bool;
+  }
+
+  let no_callback _ _ =
+    ()
+
+  (* The request's OCaml callback is set once, with set_reference rather than
+     Request.set_callback, so that it survives completion of each write. The GC
+     root of the request is released only by release. *)
+  let complete request result =
+    let bytes_unwritten =
+      C.Functions.Stream.get_write_queue_size request.stream
+      |> Unsigned.Size_t.to_int
+    in
+    let callback = request.callback in
+    let bytes = request.bytes in
+    request.buffers <- [];
+    request.callback <- no_callback;
+    request.in_use <- false;
+    if request.released then
+      Request.release request.request;
+    Error.catch_exceptions
+      (callback (Error.to_result () result)) (bytes - bytes_unwritten)
+
+  let make ?(capacity = 16) () =
+    let capacity = max 1 capacity in
+    let request =
+      {
+        request = Request.allocate C.Types.Stream.Write_request.t;
+        iovecs = Ctypes.CArray.make C.Types.Buf.t capacity;
+        capacity;
+        stream = Ctypes.from_voidp C.Types.Stream.t Ctypes.null;
+        buffers = [];
+        bytes = 0;
+        callback = no_callback;
+        in_use = false;
+        released = false;
+      }
+    in
+    Request.set_reference request.request (complete request);
+    request
+
+  let release request =
+    if not request.released then begin
+      request.released <- true;
+      if not request.in_use then
+        Request.release request.request
+    end
+
+  let in_use request =
+    request.in_use
+
+  let write request stream buffers callback =
+    let count = List.length buffers in
+    if request.released then
+      invalid_arg "Luv.Stream.write: request already released"
+    else if request.in_use then
+      callback (Error `EBUSY) 0
+    else begin
+      (* Writes of more buffers than the request has room for still work, but
+         need a temporary iovec array. *)
+      let iovecs =
+        if count <= request.capacity then begin
+          Helpers.Buf.fill_iovecs request.iovecs buffers;
+          request.iovecs
+        end
+        else
+          Helpers.Buf.bigstrings_to_iovecs buffers count
+      in
+
+      request.in_use <- true;
+      request.stream <- coerce stream;
+      request.buffers <- buffers;
+      request.bytes <- Buffer.total_size buffers;
+      request.callback <- callback;
+
+      let immediate_result =
+        C.Functions.Stream.write2
+          request.request
+          (coerce stream)
+          (Ctypes.CArray.start iovecs)
+          (Unsigned.UInt.of_int count)
+          (Ctypes.from_voidp C.Types.Stream.t Ctypes.null)
+          write_trampoline
+      in
+
+      let module Sys = Compatibility.Sys in
+      ignore (Sys.opaque_identity iovecs);
+
+      if immediate_result < 0 then begin
+        request.buffers <- [];
+        request.callback <- no_callback;
+        request.in_use <- false;
+        callback (Error.result_from_c immediate_result) 0
+      end
+    end
+end
+
+let write ?request stream buffers callback =
+  match request with
+  | None -> write_general ?send_handle:None stream buffers callback
+  | Some request -> Write_request.write request stream buffers callback
 
 let write2 pipe buffers ~send_handle callback =
   write_general ~send_handle pipe buffers callback
@@ -203,12 +375,257 @@ let set_blocking stream blocking =
   C.Functions.Stream.set_blocking (coerce stream) blocking
   |> Error.to_result ()
 
+module Writer =
+struct
+  type stream = [ `Base ] t
+
+  type t = {
+    stream : stream;
+    max_bytes : int;
+    request : Write_request.t;
+    prepare : Prepare.t;
+    check : Check.t;
+    mutable buffers : Buffer.t list;
+    mutable writes : (int * ((unit, Error.t) result -> int -> unit)) list;
+    mutable pending_bytes : int;
+    mutable hooks_started : bool;
+    mutable closed : bool;
+  }
+
+  (* Each coalesced write gets as many of the bytes written as fit in its own
+     buffers. Writes that were entirely written succeeded, even if the combined
+     write eventually failed. *)
+  let rec resolve writes result bytes_written =
+    match writes with
+    | [] ->
+      ()
+    | (size, callback)::rest ->
+      let written = min size bytes_written in
+      let own_result = if written = size then Ok () else result in
+      Error.catch_exceptions (callback own_result) written;
+      resolve rest result (bytes_written - written)
+
+  let stop_hooks writer =
+    if writer.hooks_started then begin
+      writer.hooks_started <- false;
+      ignore (Prepare.stop writer.prepare);
+      ignore (Check.stop writer.check)
+    end
+
+  let flush writer =
+    stop_hooks writer;
+    match writer.writes with
+    | [] ->
+      ()
+    | _ ->
+      let buffers = List.rev writer.buffers in
+      let writes = List.rev writer.writes in
+      writer.buffers <- [];
+      writer.writes <- [];
+      writer.pending_bytes <- 0;
+
+      let callback result bytes_written =
+        resolve writes result bytes_written in
+      if Handle.is_closing writer.stream then
+        resolve writes (Error `ECANCELED) 0
+      else if Write_request.in_use writer.request then
+        write_general writer.stream buffers callback
+      else
+        Write_request.write writer.request writer.stream buffers callback
+
+  let start_hooks writer =
+    if not writer.hooks_started then begin
+      writer.hooks_started <- true;
+      ignore (Prepare.start writer.prepare (fun () -> flush writer));
+      ignore (Check.start writer.check (fun () -> flush writer))
+    end
+
+  let create ?(max_bytes = 65536) stream =
+    let loop = Handle.get_loop stream in
+    match Prepare.init ~loop () with
+    | Error _ as error ->
+      error
+    | Ok prepare ->
+      match Check.init ~loop () with
+      | Error _ as error ->
+        Handle.close prepare ignore;
+        error
+      | Ok check ->
+        Ok {
+          stream = coerce stream;
+          max_bytes;
+          request = Write_request.make ~capacity:64 ();
+          prepare;
+          check;
+          buffers = [];
+          writes = [];
+          pending_bytes = 0;
+          hooks_started = false;
+          closed = false;
+        }
+
+  let write writer buffers callback =
+    if writer.closed then
+      callback (Error `EINVAL) 0
+    else begin
+      let size = Buffer.total_size buffers in
+      writer.buffers <- List.rev_append buffers writer.buffers;
+      writer.writes <- (size, callback)::writer.writes;
+      writer.pending_bytes <- writer.pending_bytes + size;
+      if writer.pending_bytes >= writer.max_bytes then
+        flush writer
+      else
+        start_hooks writer
+    end
+
+  let pending_bytes writer =
+    writer.pending_bytes
+
+  let close writer =
+    if not writer.closed then begin
+      flush writer;
+      writer.closed <- true;
+      Write_request.release writer.request;
+      Handle.close writer.prepare ignore;
+      Handle.close writer.check ignore
+    end
+end
+
+(* File.sendfile is called on the stream's own socket, which libuv has put into
+   non-blocking mode. When the socket's send buffer is full, sendfile fails
+   with EAGAIN, and the transfer waits for the socket to become writable. It
+   does so through a poll handle on a duplicate of the socket, because libuv
+   does not allow a second handle to watch the same descriptor. The poll handle
+   is managed in C, which closes it and the duplicate if the stream is closed
+   during the wait. *)
+let max_send_file_chunk = 1 lsl 30
+
+let send_file ?progress stream file ~offset ~length callback =
+  let loop = Handle.get_loop stream in
+  let bytes_sent = ref 0 in
+  let waiter = ref None in
+  let resume = ref ignore in
+
+  let finish result =
+    begin match !waiter with
+    | None ->
+      ()
+    | Some (c_waiter, gc_root) ->
+      waiter := None;
+      C.Functions.Stream.writable_close c_waiter;
+      Ctypes.Root.release gc_root
+    end;
+    Error.catch_exceptions (callback result) !bytes_sent
+  in
+
+  let report () =
+    match progress with
+    | None -> ()
+    | Some progress -> Error.catch_exceptions progress !bytes_sent
+  in
+
+  let watcher () =
+    match !waiter with
+    | Some (c_waiter, _) ->
+      Ok c_waiter
+    | None ->
+      let gc_root =
+        Ctypes.Root.create (Error.catch_exceptions (fun status ->
+          !resume status))
+      in
+      let c_waiter = Ctypes.(allocate (ptr void) null) in
+      let result =
+        C.Functions.Stream.writable_create (coerce stream) gc_root c_waiter in
+      if result < 0 then begin
+        Ctypes.Root.release gc_root;
+        Error.result_from_c result
+      end
+      else begin
+        let c_waiter = Ctypes.(!@ c_waiter) in
+        waiter := Some (c_waiter, gc_root);
+        Ok c_waiter
+      end
+  in
+
+  let rec send_chunk socket offset remaining =
+    if remaining <= 0 then
+      finish (Ok ())
+    else if Handle.is_closing stream then
+      finish (Error `ECANCELED)
+    else begin
+      let chunk = Unsigned.Size_t.of_int (min remaining max_send_file_chunk) in
+      File.sendfile ~loop file ~to_:socket ~offset chunk begin function
+        | Ok sent ->
+          let sent = Unsigned.Size_t.to_int sent in
+          if sent = 0 then
+            finish (Error `EOF)
+          else begin
+            bytes_sent := !bytes_sent + sent;
+            report ();
+            send_chunk
+              socket (Int64.add offset (Int64.of_int sent)) (remaining - sent)
+          end
+        | Error `EAGAIN ->
+          wait_writable socket offset remaining
+        | Error error ->
+          finish (Error error)
+      end
+    end
+
+  and wait_writable socket offset remaining =
+    match watcher () with
+    | Error error ->
+      finish (Error error)
+    | Ok c_waiter ->
+      resume := begin fun status ->
+        match Error.to_result () status with
+        | Error error -> finish (Error error)
+        | Ok () -> send_chunk socket offset remaining
+      end;
+      let result = C.Functions.Stream.writable_wait c_waiter in
+      if result < 0 then
+        finish (Error.result_from_c result)
+  in
+
+  if Sys.win32 then
+    Error.catch_exceptions (callback (Error `ENOTSUP)) 0
+  else
+    match Handle.fileno stream with
+    | Error error ->
+      Error.catch_exceptions (callback (Error error)) 0
+    | Ok fd ->
+      match File.open_osfhandle fd with
+      | Error error ->
+        Error.catch_exceptions (callback (Error error)) 0
+      | Ok socket ->
+        (* The callback of an empty write is called only once all writes
+           queued before it have been written, so the file data follows
+           them on the socket. *)
+        write_general stream [Buffer.create 0] begin fun result _ ->
+          match result with
+          | Error error -> finish (Error error)
+          | Ok () -> send_chunk socket offset length
+        end
+
+let proxy stream stream' callback =
+  let callback status forward backward =
+    Error.catch_exceptions (fun () ->
+      callback (Error.to_result () status) ~forward ~backward) ()
+  in
+  let gc_root = Ctypes.Root.create callback in
+  let immediate_result =
+    C.Functions.Stream.proxy_start (coerce stream) (coerce stream') gc_root in
+  if immediate_result < 0 then begin
+    Ctypes.Root.release gc_root;
+    callback immediate_result 0 0
+  end
+
 module Connect_request =
 struct
   type t = [ `Connect ] Request.t
 
-  let make () =
-    Request.allocate C.Types.Stream.Connect_request.t
+  let make ?object_pool () =
+    Request.allocate ?pool:object_pool C.Types.Stream.Connect_request.t
 
   let trampoline =
     C.Functions.Stream.Connect_request.get_trampoline ()
@@ -54,6 +54,7 @@ val accept : server:'kind t -> client:'kind t -> (unit, Error.t) result
 
 val read_start :
   ?allocate:(int -> Buffer.t) ->
+  ?pool:Buffer_pool.t ->
   _ t ->
   ((Buffer.t, Error.t) result -> unit) ->
     unit
@@ -76,6 +77,11 @@ val read_start :
     existing buffer, but not at its beginning, use {!Luv.Buffer.sub} to create a
     view into the buffer.
 
+    If [?pool] is given, buffers are taken from it instead, and [?allocate] is
+    ignored. Buffers that end up receiving no data are returned to the pool
+    automatically. Each buffer passed to the callback in [Ok buffer] should be
+    returned with {!Luv.Buffer_pool.release} once its data is no longer needed.
+
     The end of the stream (typically, when the remote peer closes or shuts down
     the connection) is indicated by [Error `EOF] being passed to the callback.
     Note that this behavior is different from {!Luv.File.read}.
@@ -91,14 +97,98 @@ val read_start :
     To read only once, call {!Luv.Stream.read_stop} immediately, in the main
     callback. Otherwise, the main callback will be called repeatedly. *)
 
+type framing = [
+  | `Length_prefixed of int
+  | `Delimited of char
+]
+(** Ways of splitting a stream into frames, for {!Luv.Stream.read_frames}.
+
+    - [`Length_prefixed n]: each frame is preceded by its length, as an [n]-byte
+      big-endian unsigned integer. [n] must be 1, 2, or 4. The length does not
+      include the prefix itself.
+    - [`Delimited c]: each frame is terminated by the byte [c]. *)
+
+val read_frames :
+  ?max_frame_size:int ->
+  _ t ->
+  framing ->
+  ((Buffer.t, Error.t) result -> unit) ->
+    unit
+(** Like {!Luv.Stream.read_start}, but calls its callback once per complete
+    frame, rather than once per chunk of data read.
+
+    Buffering and splitting into frames are done in C, and OCaml code is not
+    called at all until at least one frame is complete. For traffic consisting
+    of many small messages, this is considerably cheaper than reading with
+    {!Luv.Stream.read_start} and splitting frames in OCaml, which takes the
+    OCaml runtime lock and calls an OCaml callback twice for each read.
+
+    Each buffer passed to the callback in [Ok buffer] is a fresh buffer holding
+    the payload of one frame, without its length prefix or delimiter.
+
+    [?max_frame_size] is the largest payload that will be accepted, and defaults
+    to 65536 bytes. The C-side buffer is allocated at this size. If a frame
+    exceeds it, reading stops, and the callback is called with
+    [Error `ENOBUFS].
+
+    The end of the stream is indicated by [Error `EOF], as for
+    {!Luv.Stream.read_start}. Any incomplete frame received before the end of
+    the stream is discarded. Data buffered but not yet delivered is also
+    discarded when reading is stopped with {!Luv.Stream.read_stop}.
+
+    Reading should be stopped before switching between
+    {!Luv.Stream.read_start} and [Luv.Stream.read_frames] on the same stream.
+
+    Raises [Invalid_argument] if the prefix length of [`Length_prefixed] is not
+    1, 2, or 4. *)
+
 val read_stop : _ t -> (unit, Error.t) result
 (** Stops reading.
 
     Binds {{:http://docs.libuv.org/en/v1.x/stream.html#c.uv_read_stop}
     [uv_read_stop]}. *)
 
+(** Reusable write requests.
+
+    By default, each call to {!Luv.Stream.write} allocates a fresh
+    [uv_write_t], registers it as a GC root, and allocates a fresh array of
+    [uv_buf_t] for the buffers being written. A program that writes at a high
+    rate can instead create a write request once, and pass it to each
+    {!Luv.Stream.write} as [~request].
+
+    A request can be used for only one write at a time. It becomes available
+    again right before the callback of its current write is called, so the
+    callback can immediately start the next write with the same request. *)
+module Write_request :
+sig
+  type t
+  (** Reusable write requests. *)
+
+  val make : ?capacity:int -> unit -> t
+  (** Allocates a write request, with room for [?capacity] buffers per write.
+      The default capacity is 16.
+
+      Writes of more buffers than the capacity still work, but allocate a
+      temporary array for the buffers.
+
+      The request must eventually be released with
+      {!Luv.Stream.Write_request.release}. *)
+
+  val release : t -> unit
+  (** Releases the request. If a write is in progress, the request is released
+      when the write completes. Passing a released request to
+      {!Luv.Stream.write} raises [Invalid_argument]. *)
+
+  val in_use : t -> bool
+  (** Evaluates to [true] while the request is being used by a write. *)
+end
+
 val write :
-  _ t -> Buffer.t list -> ((unit, Error.t) result -> int -> unit) -> unit
+  ?request:Write_request.t ->
+  _ t ->
+  Buffer.t list ->
+  ((unit, Error.t) result -> int -> unit) ->
+    unit
 (** Writes the given buffer to the stream.
 
     Binds {{:http://docs.libuv.org/en/v1.x/stream.html#c.uv_write} [uv_write]}.
@@ -111,7 +201,11 @@ val write :
     written. libuv has an internal queue of writes, in part to implement retry.
     This means that writes can be partial at the libuv (and Luv) API level, so
     it is possible to receive both an [Error] result, and for some data to have
-    been successfully written. *)
+    been successfully written.
+
+    If [?request] is given, it is used instead of allocating a new request. If
+    it is still in use by another write, the callback is called immediately
+    with [Error `EBUSY]. *)
 
 val write2 :
   [< `Pipe ] t -> Buffer.t list -> send_handle:[< `TCP | `Pipe ] t ->
@@ -162,6 +256,114 @@ val set_blocking : _ t -> bool -> (unit, Error.t) result
     Binds {{:http://docs.libuv.org/en/v1.x/stream.html#c.uv_stream_set_blocking}
     [uv_stream_set_blocking]}. *)
 
+(** Write coalescing.
+
+    Each call to {!Luv.Stream.write} allocates its own write request and
+    typically results in its own [writev(2)] system call. A program that emits
+    many small writes during one iteration of the loop, such as an HTTP server
+    writing headers and body fragments separately, can instead write through a
+    [Writer.t]. It collects the writes made during each iteration of the loop,
+    and issues them as one {!Luv.Stream.write}, right before the loop next
+    polls for I/O.
+
+    {[
+      let writer = Luv.Stream.Writer.create tcp |> Result.get_ok in
+      Luv.Stream.Writer.write writer [headers] ignore;
+      Luv.Stream.Writer.write writer [body] (fun _result _bytes -> ...)
+    ]}
+
+    Writes made directly to the stream with {!Luv.Stream.write} are not
+    ordered with writes pending in a writer. Call {!Luv.Stream.Writer.flush}
+    first, if ordering matters. *)
+module Writer :
+sig
+  type t
+  (** Write coalescers. *)
+
+  val create :
+    ?max_bytes:int -> [ `Stream of _ ] Handle.t -> (t, Error.t) result
+  (** Creates a writer for the given stream.
+
+      The writer uses a {!Luv.Prepare} and a {!Luv.Check} handle on the
+      stream's loop to flush pending writes at the end of each loop iteration.
+      They are released by {!Luv.Stream.Writer.close}.
+
+      Pending writes are also flushed immediately once they total at least
+      [?max_bytes] bytes. The default is 65536. *)
+
+  val write :
+    t -> Buffer.t list -> ((unit, Error.t) result -> int -> unit) -> unit
+  (** Like {!Luv.Stream.write}, but the buffers are only queued in the writer,
+      to be written together with the other writes made during the current
+      iteration of the loop.
+
+      The buffers must not be modified until the callback is called. Each
+      callback is called with the number of bytes written from its own
+      buffers. *)
+
+  val flush : t -> unit
+  (** Writes all pending buffers to the stream immediately. *)
+
+  val pending_bytes : t -> int
+  (** Total size of the buffers not yet written to the stream. *)
+
+  val close : t -> unit
+  (** Flushes pending writes, and releases the handles used by the writer.
+      Should be called no later than when the stream is closed. Writes to a
+      closed writer fail with [`EINVAL].
+
+      If the stream is closed while writes are pending, their callbacks are
+      called with [Error `ECANCELED]. *)
+end
+
+val send_file :
+  ?progress:(int -> unit) ->
+  [< `TCP | `Pipe ] t ->
+  File.t ->
+  offset:int64 ->
+  length:int ->
+  ((unit, Error.t) result -> int -> unit) ->
+    unit
+(** Sends [length] bytes of [file], starting at [offset], over the stream,
+    without copying them through OCaml buffers.
+
+    The data is transferred with {!Luv.File.sendfile}, in as many calls as
+    necessary. It is sent after all data already queued with
+    {!Luv.Stream.write}. Writes made before the callback is called are not
+    ordered with the file data.
+
+    [?progress] is called with the total number of bytes sent so far, after
+    each chunk. The callback is called with the result and the total number of
+    bytes sent. If [file] ends before [length] bytes are sent, the result is
+    [Error `EOF]. If the stream is closed during the transfer, the result is
+    [Error `ECANCELED].
+
+    Not supported on Windows, where the result is [Error `ENOTSUP]. *)
+
+val proxy :
+  [< `TCP | `Pipe ] t ->
+  [< `TCP | `Pipe ] t ->
+  ((unit, Error.t) result -> forward:int -> backward:int -> unit) ->
+    unit
+(** [Luv.Stream.proxy stream stream' callback] forwards all data arriving on
+    each stream to the other one, until both directions have ended.
+
+    The data is moved by C code with
+    {{:http://man7.org/linux/man-pages/man2/splice.2.html} [splice(2)]}
+    through kernel pipes, so it is never copied into OCaml buffers, and OCaml
+    code is not called until the proxy finishes. Reading stops on both streams
+    when the proxy starts, and the streams should not be read or written while
+    it runs. When one stream reaches end of file, the other one is shut down
+    for writing once all data has been forwarded to it.
+
+    The callback is called once, with [Ok ()] if both directions ended, or the
+    first error. [Error `ECANCELED] means that one of the streams was closed.
+    [~forward] is the number of bytes moved from [stream] to [stream'], and
+    [~backward] the number moved in the other direction. The streams are not
+    closed by the proxy.
+
+    Supported only on Linux. Elsewhere, the result is [Error `ENOTSUP]. *)
+
 (**/**)
 
 (* Internal interfaces; do not use. *)
@@ -169,11 +371,14 @@ val set_blocking : _ t -> bool -> (unit, Error.t) result
 module Connect_request :
 sig
   type t = [ `Connect ] Request.t
-  val make : unit -> t
+  val make : ?object_pool:Object_pool.t -> unit -> t
   val trampoline :
     (C.Types.Stream.Connect_request.t Ctypes.ptr -> int -> unit)
       Ctypes.static_funptr
 end
 
-val allocate : ('kind C.Types.Stream.t) Ctypes.typ -> 'kind t
+val allocate :
+  ?object_pool:Object_pool.t -> ('kind C.Types.Stream.t) Ctypes.typ -> 'kind t
+val retain : _ t -> unit
 val coerce : _ t -> [ `Base ] t
+val somaxconn : int
@@ -12,13 +12,192 @@ struct
       ~reference_count:C.Types.Work.reference_count C.Types.Work.t
 end
 
+module Queue =
+struct
+  module Fifo = Queue
+
+  (* Each loop that has queues with work in them has a scheduler. The queues
+     of a scheduler are those with pending or running work, highest priority
+     first. Work from the queues is started only while fewer items than there
+     are threads in the pool are running, so the queues of a loop together
+     never occupy more than the whole pool, and the free threads go to the
+     highest-priority queue with pending work.
+
+     A queue that runs out of work leaves its scheduler, and a scheduler with
+     no queues left is dropped, so idle queues are not kept reachable. The
+     table of schedulers is shared by all threads, and so is locked, but each
+     scheduler is used only by the thread running its loop. *)
+  type t = {
+    name : string;
+    size : int;
+    priority : int;
+    loop : Loop.t;
+    pending : ((unit -> unit) -> unit) Fifo.t;
+    mutable running : int;
+    mutable scheduler : scheduler option;
+  }
+
+  and scheduler = {
+    key : nativeint;
+    mutable queues : t list;
+    mutable running_total : int;
+  }
+
+  let schedulers : (nativeint, scheduler) Hashtbl.t = Hashtbl.create 4
+
+  let schedulers_lock =
+    match Mutex.init () with
+    | Ok mutex -> mutex
+    | Error e -> failwith ("Luv.Thread_pool.Queue: " ^ Error.strerror e)
+
+  let with_schedulers f =
+    Mutex.lock schedulers_lock;
+    match f () with
+    | result ->
+      Mutex.unlock schedulers_lock;
+      result
+    | exception exn ->
+      Mutex.unlock schedulers_lock;
+      raise exn
+
+  let pool_size = lazy begin
+    match Env.getenv "UV_THREADPOOL_SIZE" with
+    | Error _ ->
+      4
+    | Ok size ->
+      match int_of_string size with
+      | exception Failure _ -> 4
+      | size -> max 1 (min 1024 size)
+  end
+
+  let create ?loop ?(priority = 0) ?(size = 1) name =
+    {
+      name;
+      size = max 1 size;
+      priority;
+      loop = Loop.or_default loop;
+      pending = Fifo.create ();
+      running = 0;
+      scheduler = None;
+    }
+
+  let join queue =
+    match queue.scheduler with
+    | Some scheduler ->
+      scheduler
+    | None ->
+      let key = Ctypes.(raw_address_of_ptr (to_voidp queue.loop)) in
+      let scheduler =
+        with_schedulers begin fun () ->
+          match Hashtbl.find schedulers key with
+          | scheduler ->
+            scheduler
+          | exception Not_found ->
+            let scheduler = {key; queues = []; running_total = 0} in
+            Hashtbl.replace schedulers key scheduler;
+            scheduler
+        end
+      in
+      scheduler.queues <-
+        List.stable_sort
+          (fun queue queue' -> compare queue'.priority queue.priority)
+          (scheduler.queues @ [queue]);
+      queue.scheduler <- Some scheduler;
+      scheduler
+
+  let leave_if_idle scheduler queue =
+    if queue.running = 0 && Fifo.is_empty queue.pending then begin
+      queue.scheduler <- None;
+      scheduler.queues <-
+        List.filter (fun queue' -> queue' != queue) scheduler.queues;
+      match scheduler.queues with
+      | _::_ ->
+        ()
+      | [] ->
+        with_schedulers begin fun () ->
+          match Hashtbl.find schedulers scheduler.key with
+          | scheduler' when scheduler' == scheduler ->
+            Hashtbl.remove schedulers scheduler.key
+          | _ | exception Not_found ->
+            ()
+        end
+    end
+
+  let startable queue =
+    queue.running < queue.size && not (Fifo.is_empty queue.pending)
+
+  let rec dispatch scheduler =
+    if scheduler.running_total < Lazy.force pool_size then
+      match List.find startable scheduler.queues with
+      | exception Not_found ->
+        ()
+      | queue ->
+        let work = Fifo.pop queue.pending in
+        queue.running <- queue.running + 1;
+        scheduler.running_total <- scheduler.running_total + 1;
+
+        let finished = ref false in
+        let finish () =
+          if not !finished then begin
+            finished := true;
+            queue.running <- queue.running - 1;
+            scheduler.running_total <- scheduler.running_total - 1;
+            dispatch scheduler;
+            leave_if_idle scheduler queue
+          end
+        in
+        begin
+          try work finish
+          with exn ->
+            Error.unhandled_exception exn;
+            finish ()
+        end;
+
+        dispatch scheduler
+
+  let submit queue work =
+    Fifo.push work queue.pending;
+    dispatch (join queue)
+
+  let name queue =
+    queue.name
+
+  let loop queue =
+    queue.loop
+
+  let pending queue =
+    Fifo.length queue.pending
+
+  let running queue =
+    queue.running
+end
+
+(* Work submitted through a queue runs on the queue's loop, unless another loop
+   is given. *)
+let queue_loop loop queue =
+  match loop, queue with
+  | None, Some queue -> Some (Queue.loop queue)
+  | _ -> loop
+
+(* Runs start immediately, or once the queue has a free thread. *)
+let in_queue queue callback start =
+  match queue with
+  | None ->
+    start callback
+  | Some queue ->
+    Queue.submit queue begin fun finished ->
+      start (fun result -> finished (); callback result)
+    end
+
 let work_trampoline =
   C.Functions.Work.get_work_trampoline ()
 
 let after_work_trampoline =
   C.Functions.Work.get_after_work_trampoline ()
 
-let queue_work ?loop ?(request = Request_.make ()) f callback =
+let queue_work ?loop ?(request = Request_.make ()) ?queue f callback =
+  let loop = queue_loop loop queue in
+  in_queue queue callback @@ fun callback ->
   let f = Error.catch_exceptions f in
   let wrapped_callback result =
     Error.catch_exceptions callback (Error.to_result () result)
@@ -45,10 +224,14 @@ let after_c_work_trampoline =
 let queue_c_work
     ?loop
     ?(request = Request_.make ())
+    ?queue
     ?(argument = Nativeint.zero)
     f
     callback =
 
+  let loop = queue_loop loop queue in
+  in_queue queue callback @@ fun callback ->
+
   let wrapped_callback result =
     Error.catch_exceptions callback (Error.to_result () result)
   in
@@ -76,6 +259,175 @@ let queue_c_work
     end
   end
 
+let queue_batch ?loop ?queue jobs callback =
+  let loop = queue_loop loop queue in
+  in_queue queue callback @@ fun callback ->
+  let count = Array.length jobs in
+  let results = Array.make count None in
+  let wrapped_jobs =
+    jobs |> Array.mapi begin fun index job () ->
+      let result =
+        match job () with
+        | value -> Ok value
+        | exception exn -> Error exn
+      in
+      results.(index) <- Some result
+    end
+  in
+  let completed status =
+    match Error.to_result () status with
+    | Error _ as error ->
+      Error.catch_exceptions callback error
+    | Ok () ->
+      results
+      |> Array.map (function Some result -> result | None -> assert false)
+      |> fun results -> Error.catch_exceptions callback (Ok results)
+  in
+
+  if count = 0 then
+    callback (Ok [||])
+  else begin
+    let gc_root = Ctypes.Root.create (wrapped_jobs, completed) in
+    let immediate_result =
+      C.Functions.Work.queue_batch
+        (Loop.or_default loop) (Unsigned.UInt.of_int count) gc_root
+    in
+    if immediate_result < 0 then begin
+      Ctypes.Root.release gc_root;
+      callback (Error.result_from_c immediate_result)
+    end
+  end
+
+module Pipeline =
+struct
+  type callback = (int, int * Error.t) result -> unit
+
+  type t = {
+    mutable pipeline : unit Ctypes.ptr option;
+    mutable gc_root : unit Ctypes.ptr;
+    slots : int;
+    callbacks : callback array;
+    free : int Stack.t;
+    pending : (nativeint * callback) Queue.Fifo.t;
+    mutable closing : bool;
+  }
+
+  (* The C pipeline is destroyed once it is closing and no run is in progress
+     or waiting for a slot. *)
+  let maybe_destroy t =
+    match t.pipeline with
+    | Some pipeline
+        when t.closing
+          && Stack.length t.free = t.slots
+          && Queue.Fifo.is_empty t.pending ->
+      t.pipeline <- None;
+      C.Functions.Work.pipeline_destroy pipeline;
+      Ctypes.Root.release t.gc_root
+    | _ ->
+      ()
+
+  let start t pipeline slot argument callback =
+    t.callbacks.(slot) <- callback;
+    let immediate_result =
+      C.Functions.Work.pipeline_run
+        pipeline (Unsigned.UInt.of_int slot) argument
+    in
+    if immediate_result < 0 then begin
+      t.callbacks.(slot) <- ignore;
+      Stack.push slot t.free;
+      Error.catch_exceptions callback
+        (Error (0, Error.from_c immediate_result))
+    end
+
+  let rec start_pending t =
+    match t.pipeline with
+    | Some pipeline
+        when not (Stack.is_empty t.free)
+          && not (Queue.Fifo.is_empty t.pending) ->
+      let argument, callback = Queue.Fifo.pop t.pending in
+      start t pipeline (Stack.pop t.free) argument callback;
+      start_pending t
+    | _ ->
+      ()
+
+  let completed t slot stage result =
+    let callback = t.callbacks.(slot) in
+    t.callbacks.(slot) <- ignore;
+    Stack.push slot t.free;
+    start_pending t;
+    let result =
+      if result < 0 then Error (stage, Error.from_c result) else Ok result in
+    Error.catch_exceptions callback result;
+    maybe_destroy t
+
+  let create ?loop ?slots stages =
+    let slots =
+      match slots with
+      | Some slots -> max 1 slots
+      | None -> Lazy.force Queue.pool_size
+    in
+    if stages = [] then
+      invalid_arg "Luv.Thread_pool.Pipeline.create: no stages";
+
+    let free = Stack.create () in
+    for slot = slots - 1 downto 0 do
+      Stack.push slot free
+    done;
+    let t = {
+      pipeline = None;
+      gc_root = Ctypes.null;
+      slots;
+      callbacks = Array.make slots ignore;
+      free;
+      pending = Queue.Fifo.create ();
+      closing = false;
+    }
+    in
+
+    let gc_root = Ctypes.Root.create (completed t) in
+    let stages = Ctypes.CArray.of_list Ctypes.nativeint stages in
+    let pipeline =
+      C.Functions.Work.pipeline_create
+        (Loop.or_default loop)
+        (Ctypes.CArray.start stages)
+        (Unsigned.UInt.of_int (Ctypes.CArray.length stages))
+        (Unsigned.UInt.of_int slots)
+        gc_root
+    in
+    if Ctypes.is_null pipeline then begin
+      Ctypes.Root.release gc_root;
+      Error `ENOMEM
+    end
+    else begin
+      t.pipeline <- Some pipeline;
+      t.gc_root <- gc_root;
+      Ok t
+    end
+
+  let run t ?(argument = Nativeint.zero) callback =
+    match t.pipeline with
+    | Some pipeline when not t.closing ->
+      if Stack.is_empty t.free then
+        Queue.Fifo.push (argument, callback) t.pending
+      else
+        start t pipeline (Stack.pop t.free) argument callback
+    | _ ->
+      Error.catch_exceptions callback (Error (0, `ECANCELED))
+
+  let close t =
+    t.closing <- true;
+    maybe_destroy t
+
+  let slots t =
+    t.slots
+
+  let running t =
+    t.slots - Stack.length t.free
+
+  let pending t =
+    Queue.Fifo.length t.pending
+end
+
 module Request = Request_
 
 let set_size ?(if_not_already_set = false) thread_count =
@@ -18,9 +18,76 @@ sig
   val make : unit -> t
 end
 
+(** Work queues.
+
+    libuv runs all thread pool work, including filesystem operations and DNS
+    queries, in the order it was submitted, on a single pool of threads. A
+    burst of slow work can therefore delay latency-sensitive work queued
+    behind it.
+
+    Work queues limit how many threads each kind of work may occupy at once.
+    Work submitted to a queue waits in the queue, rather than in libuv's
+    pool, until the queue is running fewer than [size] items. In addition, the
+    queues of one loop together never run more items than there are threads
+    in the pool. When a thread frees up, it goes to the queue of that loop with
+    the highest priority that has pending work.
+
+    {[
+      let fs = Luv.Thread_pool.Queue.create ~size:2 "fs" in
+      let dns = Luv.Thread_pool.Queue.create ~priority:1 ~size:2 "dns" in
+
+      Luv.Thread_pool.Queue.submit fs (fun finished ->
+        Luv.File.fsync file (fun result -> finished (); ...));
+
+      Luv.Thread_pool.Queue.submit dns (fun finished ->
+        Luv.DNS.getaddrinfo ~node () (fun result -> finished (); ...))
+    ]}
+
+    Work submitted to libuv directly, without a queue, is not limited.
+
+    Each queue belongs to a loop, and must be used only from the thread running
+    that loop. Queues of different loops are scheduled independently. A queue
+    is referenced by its loop's scheduler only while it has pending or running
+    work, so a queue that is no longer used can be garbage-collected. *)
+module Queue :
+sig
+  type t
+  (** Work queues. *)
+
+  val create : ?loop:Loop.t -> ?priority:int -> ?size:int -> string -> t
+  (** Creates a queue with the given name, belonging to [?loop].
+
+      [?size] is the number of items from the queue that may run at once. The
+      default is 1. Queues with higher [?priority] get free threads first. The
+      default priority is 0. *)
+
+  val submit : t -> ((unit -> unit) -> unit) -> unit
+  (** [Luv.Thread_pool.Queue.submit queue start] calls [start] once the queue
+      may run another item. [start] is passed a function, which it must call
+      when the item has completed, typically at the start of the completion
+      callback of the operation it started. That function can be called more
+      than once.
+
+      Any Luv function that runs on the thread pool, such as most of
+      {!Luv.File} and {!Luv.DNS}, can be run in a queue this way. *)
+
+  val name : t -> string
+  (** Returns the name the queue was created with. *)
+
+  val loop : t -> Loop.t
+  (** Returns the loop the queue belongs to. *)
+
+  val pending : t -> int
+  (** Number of items waiting in the queue. *)
+
+  val running : t -> int
+  (** Number of items from the queue currently running. *)
+end
+
 val queue_work :
   ?loop:Loop.t ->
   ?request:Request.t ->
+  ?queue:Queue.t ->
   (unit -> unit) ->
   ((unit, Error.t) result -> unit) ->
     unit
@@ -32,11 +99,16 @@ val queue_work :
     In [Luv.Thread_pool.queue_work f after], [f] is the function that will be
     called in the thread pool. [after] will be called by the libuv loop (that
     is, typically, in the main thread) after [f] completes, or immediately, in
-    case there is an error scheduling [f]. *)
+    case there is an error scheduling [f].
+
+    If [?queue] is given, [f] is submitted to libuv only once the queue has a
+    free thread, and [?loop] defaults to the queue's loop. See
+    {!Luv.Thread_pool.Queue}. *)
 
 val queue_c_work :
   ?loop:Loop.t ->
   ?request:Request.t ->
+  ?queue:Queue.t ->
   ?argument:nativeint ->
   nativeint ->
   ((unit, Error.t) result -> unit) ->
@@ -48,7 +120,106 @@ val queue_c_work :
     [uv_queue_work]}.
 
     The C function is specified by its address. It should have signature
-    [(*)(void*)]. The default value is [?argument] is [NULL] (0). *)
+    [(*)(void*)]. The default value is [?argument] is [NULL] (0).
+
+    [?queue] is as in {!Luv.Thread_pool.queue_work}. *)
+
+val queue_batch :
+  ?loop:Loop.t ->
+  ?queue:Queue.t ->
+  (unit -> 'a) array ->
+  ((('a, exn) result array, Error.t) result -> unit) ->
+    unit
+(** Runs each function in the array in the thread pool, and calls the callback
+    once, after all of them have completed.
+
+    The jobs are spread across the pool's threads like separate calls to
+    {!Luv.Thread_pool.queue_work}. However, the whole batch uses one
+    allocation for its libuv requests and one GC root. Completions of
+    individual jobs don't wake up OCaml: only the last one does.
+
+    The callback receives the result of each job, in the same order as the
+    jobs. A job that raises an exception has result [Error exn]. The callback
+    is called with [Error _] if libuv fails to queue the jobs.
+
+    If [?queue] is given, the whole batch is submitted to libuv once the queue
+    has a free thread, and [?loop] defaults to the queue's loop. The batch
+    counts as one item of the queue, even though its jobs may occupy several
+    threads of the pool at once. To keep to a queue's size, split the work
+    into batches no larger than it. *)
+
+(** Chains of C functions run back to back in the thread pool.
+
+    {!Luv.Thread_pool.queue_c_work} allocates a little C memory for each call,
+    and runs one C function per trip through the thread pool. When several C
+    functions process the same data in turn, for example to decompress,
+    checksum, and then parse a buffer, a pipeline runs all of them in one
+    trip, and wakes up OCaml only once, with the final result:
+
+    {[
+      match Luv.Thread_pool.Pipeline.create [decompress; checksum; parse] with
+      | Error _ -> (* ... *)
+      | Ok pipeline ->
+        Luv.Thread_pool.Pipeline.run pipeline ~argument:job (function
+          | Ok bytes_parsed -> (* ... *)
+          | Error (stage, error) -> (* ... *))
+    ]}
+
+    Each stage is the address of a C function of type [int (*)(void*)]. Every
+    stage of a run is called with the same argument, typically a pointer to a
+    C structure the stages use to pass data to each other. A stage that
+    returns a negative libuv error code ends the run early. Otherwise, the
+    result of the run is the value returned by the last stage.
+
+    The libuv requests used by a pipeline are allocated once, when it is
+    created, as a fixed number of slots. Each run occupies one slot. Runs
+    started while all slots are busy wait in the pipeline until a slot is
+    free. *)
+module Pipeline :
+sig
+  type t
+  (** C work pipelines. *)
+
+  val create :
+    ?loop:Loop.t -> ?slots:int -> nativeint list -> (t, Error.t) result
+  (** Creates a pipeline from the addresses of its stages, in the order in
+      which they are to be called.
+
+      [?slots] is the number of runs that can be in the thread pool at once.
+      The default is the size of the thread pool.
+
+      Raises [Invalid_argument] if the list of stages is empty. *)
+
+  val run :
+    t ->
+    ?argument:nativeint ->
+    ((int, int * Error.t) result -> unit) ->
+      unit
+  (** Runs the stages of the pipeline in a thread of the thread pool.
+
+      The default value of [?argument] is [NULL] (0).
+
+      The callback is called in the loop thread, once, with either [Ok result],
+      where [result] is the value returned by the last stage, or
+      [Error (stage, error)], where [stage] is the index of the stage that
+      failed. Errors from libuv itself, which occur before any stage runs, are
+      reported as failures of stage 0. Runs started after
+      {!Luv.Thread_pool.Pipeline.close} fail with [`ECANCELED]. *)
+
+  val close : t -> unit
+  (** Stops the pipeline from accepting new runs. Runs already started or
+      waiting for a slot still complete. The pipeline's C memory is freed
+      after the last of them completes. *)
+
+  val slots : t -> int
+  (** Number of slots in the pipeline. *)
+
+  val running : t -> int
+  (** Number of runs currently in the thread pool. *)
+
+  val pending : t -> int
+  (** Number of runs waiting for a free slot. *)
+end
 
 val set_size : ?if_not_already_set:bool -> int -> unit
 (** Sets
@@ -5,8 +5,8 @@
 
 type t = [ `Timer ] Handle.t
 
-let init ?loop () =
-  let timer = Handle.allocate C.Types.Timer.t in
+let init ?loop ?object_pool () =
+  let timer = Handle.allocate ?pool:object_pool C.Types.Timer.t in
   C.Functions.Timer.init (Loop.or_default loop) timer
   |> Error.to_result timer
 
@@ -17,11 +17,15 @@ type t = [ `Timer ] Handle.t
     in addition to the functions in this module. In particular, see
     {!Luv.Handle.close}. *)
 
-val init : ?loop:Loop.t -> unit -> (t, Error.t) result
+val init :
+  ?loop:Loop.t -> ?object_pool:Object_pool.t -> unit -> (t, Error.t) result
 (** Allocates and initializes a timer.
 
     Binds {{:http://docs.libuv.org/en/v1.x/timer.html#c.uv_timer_init}
-    [uv_timer_init]}. *)
+    [uv_timer_init]}.
+
+    If [?object_pool] is given, the timer is taken from it, and returned to it
+    when closed. See {!Luv.Object_pool}. *)
 
 val start :
   ?call_update_time:bool -> ?repeat:int -> t -> int -> (unit -> unit) ->
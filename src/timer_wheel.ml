@@ -0,0 +1,231 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(* A hierarchical timing wheel, as in Varghese and Lauck, and Linux's classic
+   timer implementation. Time is counted in ticks of the wheel's resolution.
+   Level 0 has one slot per tick for the next slot_count ticks. Each higher
+   level has slots slot_count times as wide as the one below it. When the tick
+   count crosses a slot boundary of a higher level, the timeouts in that slot
+   are cascaded, i.e. re-inserted, into lower levels. Timeouts further in the
+   future than the top level can represent are kept in its furthest slot, and
+   re-inserted each time that slot is cascaded.
+
+   Each slot is a circular doubly-linked list with a sentinel, so inserting
+   and cancelling are O(1). *)
+
+let slot_bits = 6
+let slot_count = 1 lsl slot_bits
+let slot_mask = slot_count - 1
+let levels = 4
+
+type timeout = {
+  wheel : t;
+  mutable callback : unit -> unit;
+  mutable deadline : int;
+  mutable previous : timeout;
+  mutable next : timeout;
+}
+
+and t = {
+  timer : Timer.t;
+  resolution : int;
+  mutable slots : timeout array array;
+  mutable current : int;
+  mutable count : int;
+  mutable wakeup : int;
+}
+
+let make_sentinel wheel =
+  let rec node =
+    {wheel; callback = ignore; deadline = 0; previous = node; next = node} in
+  node
+
+let is_empty sentinel =
+  sentinel.next == sentinel
+
+let unlink timeout =
+  timeout.previous.next <- timeout.next;
+  timeout.next.previous <- timeout.previous;
+  timeout.previous <- timeout;
+  timeout.next <- timeout
+
+let is_active timeout =
+  timeout.next != timeout
+
+let insert wheel timeout =
+  let delta = timeout.deadline - wheel.current in
+  let rec find_level level =
+    if level = levels - 1 || delta < 1 lsl (slot_bits * (level + 1)) then
+      level
+    else
+      find_level (level + 1)
+  in
+  let level = find_level 0 in
+  let deadline =
+    min timeout.deadline (wheel.current + (1 lsl (slot_bits * levels)) - 1) in
+  let index = (deadline lsr (slot_bits * level)) land slot_mask in
+  let sentinel = wheel.slots.(level).(index) in
+  timeout.previous <- sentinel.previous;
+  timeout.next <- sentinel;
+  sentinel.previous.next <- timeout;
+  sentinel.previous <- timeout
+
+(* The slot's list is moved to a fresh sentinel before re-inserting its
+   timeouts, so that timeouts that land in the same slot again are not visited
+   twice. *)
+let cascade wheel level =
+  let index = (wheel.current lsr (slot_bits * level)) land slot_mask in
+  let sentinel = wheel.slots.(level).(index) in
+  if not (is_empty sentinel) then begin
+    let detached = make_sentinel wheel in
+    detached.next <- sentinel.next;
+    detached.previous <- sentinel.previous;
+    sentinel.next.previous <- detached;
+    sentinel.previous.next <- detached;
+    sentinel.next <- sentinel;
+    sentinel.previous <- sentinel;
+    while not (is_empty detached) do
+      let timeout = detached.next in
+      unlink timeout;
+      insert wheel timeout
+    done
+  end
+
+let rec fire wheel sentinel =
+  if not (is_empty sentinel) then begin
+    let timeout = sentinel.next in
+    unlink timeout;
+    wheel.count <- wheel.count - 1;
+    timeout.callback ();
+    fire wheel sentinel
+  end
+
+let advance wheel =
+  wheel.current <- wheel.current + 1;
+  let rec cascade_from level =
+    if level < levels
+        && wheel.current land ((1 lsl (slot_bits * level)) - 1) = 0 then begin
+      cascade_from (level + 1);
+      cascade wheel level
+    end
+  in
+  cascade_from 1;
+  fire wheel wheel.slots.(0).(wheel.current land slot_mask)
+
+let now wheel =
+  Unsigned.UInt64.to_int (Loop.now (Handle.get_loop wheel.timer))
+
+let now_in_ticks wheel =
+  now wheel / wheel.resolution
+
+let never = max_int
+
+(* The next tick at which there may be work: the first non-empty level 0 slot
+   before the next level 1 boundary, or that boundary, where a cascade may
+   bring timeouts into level 0. *)
+let next_wakeup wheel =
+  let boundary = slot_count - wheel.current land slot_mask in
+  let rec scan ticks =
+    if ticks >= boundary then
+      wheel.current + boundary
+    else if not (is_empty
+        wheel.slots.(0).((wheel.current + ticks) land slot_mask)) then
+      wheel.current + ticks
+    else
+      scan (ticks + 1)
+  in
+  scan 1
+
+let rec schedule wheel =
+  if wheel.count = 0 then begin
+    wheel.wakeup <- never;
+    ignore (Timer.stop wheel.timer)
+  end
+  else begin
+    let wakeup = next_wakeup wheel in
+    wheel.wakeup <- wakeup;
+    let delay = max 0 (wakeup * wheel.resolution - now wheel) in
+    ignore (Timer.start
+      ~call_update_time:false wheel.timer delay (fun () -> expire wheel))
+  end
+
+and expire wheel =
+  let now = now_in_ticks wheel in
+  while wheel.current < now && wheel.count > 0 do
+    advance wheel
+  done;
+  if wheel.count = 0 then
+    wheel.current <- now;
+  schedule wheel
+
+let create ?loop ?(resolution = 1) () =
+  match Timer.init ?loop () with
+  | Error e ->
+    Error e
+  | Ok timer ->
+    let wheel = {
+      timer;
+      resolution = max 1 resolution;
+      slots = [||];
+      current = 0;
+      count = 0;
+      wakeup = never;
+    }
+    in
+    wheel.slots <-
+      Array.init levels (fun _ ->
+        Array.init slot_count (fun _ -> make_sentinel wheel));
+    wheel.current <- now_in_ticks wheel;
+    Ok wheel
+
+let arm timeout delay =
+  let wheel = timeout.wheel in
+  if wheel.count = 0 then
+    wheel.current <- now_in_ticks wheel;
+  (* The deadline is rounded up from the absolute time, rather than adding the
+     rounded-up delay to the current tick, which starts up to a whole tick
+     earlier than now. *)
+  let deadline =
+    (now wheel + max 0 delay + wheel.resolution - 1) / wheel.resolution in
+  timeout.deadline <- max (wheel.current + 1) deadline;
+  insert wheel timeout;
+  wheel.count <- wheel.count + 1;
+  if timeout.deadline < wheel.wakeup then
+    schedule wheel
+
+let add wheel delay callback =
+  let rec timeout = {
+    wheel;
+    callback = ignore;
+    deadline = 0;
+    previous = timeout;
+    next = timeout;
+  }
+  in
+  timeout.callback <- Error.catch_exceptions callback;
+  arm timeout delay;
+  timeout
+
+let cancel timeout =
+  if is_active timeout then begin
+    unlink timeout;
+    timeout.wheel.count <- timeout.wheel.count - 1
+  end
+
+let restart timeout delay =
+  cancel timeout;
+  arm timeout delay
+
+let count wheel =
+  wheel.count
+
+let close wheel callback =
+  wheel.slots |> Array.iter (Array.iter (fun sentinel ->
+    while not (is_empty sentinel) do
+      unlink sentinel.next
+    done));
+  wheel.count <- 0;
+  wheel.wakeup <- never;
+  Handle.close wheel.timer callback
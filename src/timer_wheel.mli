@@ -0,0 +1,69 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(** Large numbers of lightweight timeouts.
+
+    Each {!Luv.Timer.t} is a libuv handle, with its own C allocation, GC root,
+    and node in libuv's timer heap. A program that arms several timeouts per
+    connection, for many connections, and restarts them constantly, can spend
+    a noticeable amount of time maintaining timers.
+
+    A timer wheel instead multiplexes any number of timeouts onto one
+    {!Luv.Timer.t}. Timeouts are plain OCaml records kept in a hierarchical
+    timing wheel, so adding, cancelling, and restarting a timeout are all O(1),
+    and don't call into libuv:
+
+    {[
+      let wheel = Luv.Timer_wheel.create () |> Result.get_ok in
+
+      let idle =
+        Luv.Timer_wheel.add wheel 30_000 (fun () ->
+          Luv.Handle.close connection ignore)
+      in
+
+      (* On each read: *)
+      Luv.Timer_wheel.restart idle 30_000
+    ]}
+
+    Timeouts fire in ticks of the wheel's resolution, and never early. A
+    timeout of [n] milliseconds fires after at least [n] milliseconds, rounded
+    up to the next tick. *)
+
+type t
+(** Timer wheels. *)
+
+type timeout
+(** Timeouts in a wheel. *)
+
+val create : ?loop:Loop.t -> ?resolution:int -> unit -> (t, Error.t) result
+(** Creates a timer wheel, driven by one timer on [?loop].
+
+    [?resolution] is the length of a tick, in milliseconds. The default is 1.
+    Coarser resolutions cause the loop to wake up less often.
+
+    The wheel keeps the loop alive only while it has active timeouts. *)
+
+val add : t -> int -> (unit -> unit) -> timeout
+(** [Luv.Timer_wheel.add wheel milliseconds callback] arms a timeout, which
+    calls [callback] once, after [milliseconds]. *)
+
+val cancel : timeout -> unit
+(** Disarms a timeout. Does nothing if the timeout has already fired or been
+    cancelled. *)
+
+val restart : timeout -> int -> unit
+(** [Luv.Timer_wheel.restart timeout milliseconds] re-arms a timeout to fire
+    [milliseconds] from now, whether it was still active, had already fired, or
+    had been cancelled. *)
+
+val is_active : timeout -> bool
+(** Whether the timeout is still due to fire. *)
+
+val count : t -> int
+(** Number of active timeouts in the wheel. *)
+
+val close : t -> (unit -> unit) -> unit
+(** Cancels all timeouts in the wheel, and closes its timer. The callback is
+    called once the timer is closed. *)
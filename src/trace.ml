@@ -0,0 +1,94 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+type event = {
+  thread : int;
+  kind : string;
+  handle : nativeint;
+  start : int;
+  finish : int;
+  lock_wait : int;
+}
+
+let default_buffer_size = 65536
+
+let start ?(buffer_size = default_buffer_size) () =
+  C.Functions.Metrics.trace_start (Unsigned.Size_t.of_int buffer_size)
+  |> Error.to_result ()
+
+let stop =
+  C.Functions.Metrics.trace_stop
+
+let kind_name kind =
+  match C.Functions.Metrics.instrumentation_kind_name kind with
+  | Some name -> name
+  | None -> "unknown"
+
+let events ?(clear = false) () =
+  let event_size = C.Types.Metrics.trace_event_size in
+  let limit = Unsigned.Size_t.to_int (C.Functions.Metrics.trace_count ()) in
+  let words = Ctypes.CArray.make Ctypes.uint64_t (max 1 (limit * event_size)) in
+  let count =
+    C.Functions.Metrics.trace_read
+      (Ctypes.CArray.start words) (Unsigned.Size_t.of_int limit) clear
+    |> Unsigned.Size_t.to_int
+  in
+  let word index field =
+    Ctypes.CArray.get words (index * event_size + field) in
+  let int index field =
+    Unsigned.UInt64.to_int (word index field) in
+  let rec collect index acc =
+    if index < 0 then
+      acc
+    else
+      let event = {
+        thread = int index 0;
+        kind = kind_name (int index 1);
+        handle = Unsigned.UInt64.to_int64 (word index 2) |> Int64.to_nativeint;
+        start = int index 3;
+        finish = int index 4;
+        lock_wait = int index 5;
+      }
+      in
+      collect (index - 1) (event::acc)
+  in
+  collect (count - 1) []
+
+let microseconds nanoseconds =
+  Printf.sprintf "%i.%03i" (nanoseconds / 1000) (nanoseconds mod 1000)
+
+let to_chrome_json events =
+  let pid = Pid.getpid () in
+  let slice ~name ~thread ~start ~duration ~args =
+    Printf.sprintf
+      "{\"name\":\"%s\",\"cat\":\"luv\",\"ph\":\"X\",\"pid\":%i,\"tid\":%i,\
+       \"ts\":%s,\"dur\":%s,\"args\":{%s}}"
+      name pid thread (microseconds start) (microseconds duration) args
+  in
+  let event_slices event =
+    let callback =
+      slice
+        ~name:event.kind
+        ~thread:event.thread
+        ~start:event.start
+        ~duration:(event.finish - event.start)
+        ~args:
+          (Printf.sprintf "\"handle\":\"0x%nx\",\"lock_wait_us\":%s"
+            event.handle (microseconds event.lock_wait))
+    in
+    if event.lock_wait = 0 then
+      [callback]
+    else
+      [slice
+        ~name:"runtime lock"
+        ~thread:event.thread
+        ~start:(event.start - event.lock_wait)
+        ~duration:event.lock_wait
+        ~args:"";
+       callback]
+  in
+  "{\"traceEvents\":[\n" ^
+  String.concat ",\n" (List.concat (List.map event_slices events)) ^
+  "\n]}\n"
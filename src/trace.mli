@@ -0,0 +1,77 @@
+(* This file is part of Luv, released under the MIT license. See LICENSE.md for
+   details, or visit https://github.com/aantron/luv/blob/master/LICENSE.md. *)
+
+
+
+(** Callback tracing.
+
+    While tracing is on, Luv records each call from libuv into OCaml as an
+    event: what kind of handle or request the callback is for, the handle or
+    request's address, when the callback started and finished, and how long
+    libuv's thread waited for the OCaml runtime lock before it could call the
+    callback.
+
+    Events are recorded in C, into a fixed-size ring buffer for each thread
+    that runs a loop, so recording doesn't allocate and threads don't contend.
+    When a buffer is full, its oldest events are overwritten. The cost of
+    tracing is that of reading a monotonic clock and taking an uncontended
+    mutex, for each callback. When tracing is off, the cost is one memory read.
+
+    Events can be written out in the
+    {{:https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU}
+    Chrome trace event format}, which can be viewed in
+    {{:https://ui.perfetto.dev} Perfetto} or [chrome://tracing]:
+
+    {[
+      Luv.Trace.start () |> Result.get_ok;
+      ignore (Luv.Loop.run () : bool);
+      Luv.Trace.stop ();
+
+      let channel = open_out "trace.json" in
+      output_string channel (Luv.Trace.to_chrome_json (Luv.Trace.events ()));
+      close_out channel
+    ]} *)
+
+type event = {
+  thread : int;
+  kind : string;
+  handle : nativeint;
+  start : int;
+  finish : int;
+  lock_wait : int;
+}
+(** Recorded callbacks.
+
+    - [thread] numbers the threads that recorded events, starting from 1.
+    - [kind] is the type of the handle or request, as given by libuv's
+      {{:http://docs.libuv.org/en/v1.x/handle.html#c.uv_handle_type_name}
+      [uv_handle_type_name]} or
+      {{:http://docs.libuv.org/en/v1.x/request.html#c.uv_req_type_name}
+      [uv_req_type_name]}, for example ["tcp"] or ["write"].
+    - [handle] is the address of the handle or request.
+    - [start] and [finish] are the times at which the callback started and
+      finished, in nanoseconds, as given by {!Luv.Time.hrtime}.
+    - [lock_wait] is the time, in nanoseconds, spent waiting for the runtime
+      lock before the callback started. *)
+
+val start : ?buffer_size:int -> unit -> (unit, Error.t) result
+(** Starts tracing.
+
+    [?buffer_size] is the number of events kept for each thread. The default is
+    65536. It applies to threads that record their first event after this
+    call. *)
+
+val stop : unit -> unit
+(** Stops tracing. Events recorded so far are kept. *)
+
+val events : ?clear:bool -> unit -> event list
+(** Retrieves the events recorded so far, oldest first within each thread.
+
+    If [~clear:true] is given, the events returned are then discarded. Events
+    recorded concurrently by other threads, which are not returned, are kept for
+    the next call. *)
+
+val to_chrome_json : event list -> string
+(** Formats events as a Chrome trace. Each event becomes a complete event
+    (phase ["X"]), preceded by a ["runtime lock"] event if its callback had to
+    wait for the runtime lock. Times are in microseconds. *)
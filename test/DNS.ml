@@ -45,5 +45,35 @@ let tests = [
 
       Alcotest.(check bool) "resolved" true !resolved
     end;
+
+    "cache", `Quick, begin fun () ->
+      let cache = Luv.DNS.Cache.create () in
+      let results = ref [] in
+      let lookup () =
+        Luv.DNS.Cache.getaddrinfo cache ~family:`INET ~node:"localhost" ()
+            begin fun result ->
+          results := (check_success_result "getaddrinfo" result)::!results
+        end
+      in
+
+      lookup ();
+      lookup ();
+      Alcotest.(check int) "pending" 0 (List.length !results);
+      run ();
+      Alcotest.(check int) "coalesced" 2 (List.length !results);
+      lookup ();
+      Alcotest.(check int) "hit" 3 (List.length !results);
+      Alcotest.(check int) "size" 1 (Luv.DNS.Cache.size cache);
+
+      begin match !results with
+      | [first; second; third] ->
+        Alcotest.(check bool) "shared" true (first == second && second == third)
+      | _ ->
+        Alcotest.fail "results"
+      end;
+
+      Luv.DNS.Cache.invalidate cache "localhost";
+      Alcotest.(check int) "invalidated" 0 (Luv.DNS.Cache.size cache)
+    end;
   ]
 ]
@@ -68,6 +68,25 @@ let with_directory f =
   Sys.remove file_2;
   Unix.rmdir directory
 
+let with_bulk_input f =
+  let filename = "bulk_test_input" in
+  let content = String.init 16384 (fun index -> Char.chr (index mod 251)) in
+
+  let channel = open_out_bin filename in
+  output_string channel content;
+  close_out channel;
+
+  let file =
+    Luv.File.Sync.open_ filename [`RDONLY]
+    |> check_success_result "open_"
+  in
+
+  f file content;
+
+  Luv.File.Sync.close file
+  |> check_success_result "close";
+  Sys.remove filename
+
 let call_scandir_next_repeatedly scan =
   let rec repeat entry_accumulator =
     match Luv.File.scandir_next scan with
@@ -1002,6 +1021,100 @@ let tests = [
       end
     end;
 
+    "bulk: read", `Quick, begin fun () ->
+      with_bulk_input begin fun file content ->
+        let bulk = Luv.File.Bulk.create ~chunk_size:4096 ~depth:3 () in
+        let received = Bytes.make 9000 ' ' in
+        let finished = ref false in
+
+        Luv.File.Bulk.read bulk file ~offset:100L ~length:9000L
+            begin fun offset buffer ->
+          Luv.Buffer.blit_to_bytes
+            buffer received ~destination_offset:(Int64.to_int offset - 100)
+        end
+            begin fun result ->
+          check_success_result "read" result;
+          finished := true
+        end;
+
+        run ();
+        Luv.File.Bulk.close bulk;
+        Alcotest.(check bool) "finished" true !finished;
+        Alcotest.(check string)
+          "content" (String.sub content 100 9000) (Bytes.to_string received)
+      end
+    end;
+
+    "bulk: copy", `Quick, begin fun () ->
+      with_bulk_input begin fun file content ->
+        let to_ =
+          Luv.File.Sync.open_ "bulk_test_output" [`RDWR; `CREAT; `TRUNC]
+          |> check_success_result "open_"
+        in
+        let bulk = Luv.File.Bulk.create ~chunk_size:4096 ~depth:2 () in
+        let finished = ref false in
+
+        Luv.File.Bulk.copy
+            bulk file ~offset:1000L ~to_ ~to_offset:0L ~length:12000L
+            begin fun result ->
+          check_success_result "copy" result;
+          finished := true
+        end;
+
+        run ();
+        Luv.File.Bulk.close bulk;
+        Luv.File.Sync.close to_ |> check_success_result "close";
+        Alcotest.(check bool) "finished" true !finished;
+
+        let channel = open_in_bin "bulk_test_output" in
+        let copied = really_input_string channel (in_channel_length channel) in
+        close_in channel;
+        Sys.remove "bulk_test_output";
+        Alcotest.(check string) "content" (String.sub content 1000 12000) copied
+      end
+    end;
+
+    "bulk: eof", `Quick, begin fun () ->
+      with_bulk_input begin fun file _ ->
+        let bulk = Luv.File.Bulk.create ~chunk_size:4096 () in
+        let finished = ref false in
+
+        Luv.File.Bulk.read bulk file ~offset:0L ~length:20000L
+            (fun _ _ -> ())
+            begin fun result ->
+          check_error_result "read" `EOF result;
+          finished := true
+        end;
+
+        run ();
+        Luv.File.Bulk.close bulk;
+        Alcotest.(check bool) "finished" true !finished
+      end
+    end;
+
+    "map", `Quick, begin fun () ->
+      with_bulk_input begin fun file content ->
+        let buffer =
+          Luv.File.map file ~offset:5000L ~length:100
+          |> check_success_result "map"
+        in
+        let finished = ref false in
+
+        Luv.File.madvise buffer `WILLNEED begin fun result ->
+          check_success_result "madvise" result;
+          finished := true
+        end;
+
+        run ();
+        Alcotest.(check bool) "finished" true !finished;
+        Alcotest.(check string)
+          "content" (String.sub content 5000 100) (Luv.Buffer.to_string buffer);
+
+        Luv.File.unmap buffer
+        |> check_success_result "unmap"
+      end
+    end;
+
     "access: async", `Quick, begin fun () ->
       let finished = ref false in
 
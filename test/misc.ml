@@ -88,4 +88,33 @@ let tests = [
         Alcotest.fail "buffer contents"
     end;
   ];
+
+  "buffer pool", [
+    "reuse", `Quick, begin fun () ->
+      let pool = Luv.Buffer_pool.create ~size_classes:[16; 64] () in
+      let buffer = Luv.Buffer_pool.allocate pool 10 in
+      Alcotest.(check int) "size" 16 (Luv.Buffer.size buffer);
+      Alcotest.(check int) "outstanding" 1 (Luv.Buffer_pool.outstanding pool);
+      Luv.Buffer_pool.release pool (Luv.Buffer.sub buffer ~offset:0 ~length:4);
+      Alcotest.(check int) "released" 0 (Luv.Buffer_pool.outstanding pool);
+      let buffer' = Luv.Buffer_pool.allocate pool 16 in
+      if buffer' != buffer then
+        Alcotest.fail "buffer not reused"
+    end;
+
+    "oversized", `Quick, begin fun () ->
+      let pool = Luv.Buffer_pool.create ~size_classes:[16; 64] () in
+      let buffer = Luv.Buffer_pool.allocate pool 1000 in
+      Alcotest.(check int) "size" 64 (Luv.Buffer.size buffer)
+    end;
+
+    "double release", `Quick, begin fun () ->
+      let pool = Luv.Buffer_pool.create () in
+      let buffer = Luv.Buffer_pool.allocate pool 100 in
+      Luv.Buffer_pool.release pool buffer;
+      match Luv.Buffer_pool.release pool buffer with
+      | () -> Alcotest.fail "no exception"
+      | exception Invalid_argument _ -> ()
+    end;
+  ];
 ]
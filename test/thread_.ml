@@ -67,6 +67,180 @@ let tests = [
       end
     end;
 
+    "work: queue", `Quick, begin fun () ->
+      let queue = Luv.Thread_pool.Queue.create ~size:1 "test" in
+      let running = ref 0 in
+      let most_running = ref 0 in
+      let completed = ref 0 in
+
+      for _ = 1 to 3 do
+        Luv.Thread_pool.queue_work ~queue begin fun () ->
+          incr running;
+          most_running := max !most_running !running;
+          Unix.sleepf 0.01;
+          decr running
+        end
+        begin fun result ->
+          check_success_result "queue_work" result;
+          incr completed
+        end
+      done;
+
+      Alcotest.(check int) "pending" 2 (Luv.Thread_pool.Queue.pending queue);
+      run ();
+
+      Alcotest.(check int) "completed" 3 !completed;
+      Alcotest.(check int) "most running" 1 !most_running;
+      Alcotest.(check int) "running" 0 (Luv.Thread_pool.Queue.running queue)
+    end;
+
+    "work: queues on separate loops", `Quick, begin fun () ->
+      let loop = Luv.Loop.init () |> check_success_result "Loop.init" in
+      let queue = Luv.Thread_pool.Queue.create ~size:1 "default" in
+      let queue' = Luv.Thread_pool.Queue.create ~loop ~size:1 "other" in
+      let completed = ref 0 in
+      let completed' = ref 0 in
+
+      for _ = 1 to 2 do
+        Luv.Thread_pool.queue_work ~queue ignore (fun result ->
+          check_success_result "queue_work" result;
+          incr completed);
+        Luv.Thread_pool.queue_work ~queue:queue' ignore (fun result ->
+          check_success_result "queue_work" result;
+          incr completed')
+      done;
+
+      ignore (Luv.Loop.run ~loop () : bool);
+
+      Alcotest.(check int) "other completed" 2 !completed';
+      Alcotest.(check int) "default completed" 0 !completed;
+      Alcotest.(check int) "default pending" 1
+        (Luv.Thread_pool.Queue.pending queue);
+
+      run ();
+
+      Alcotest.(check int) "default completed" 2 !completed;
+      Luv.Loop.close loop |> check_success_result "Loop.close"
+    end;
+
+    "work: batch", `Quick, begin fun () ->
+      let results = ref [||] in
+
+      Luv.Thread_pool.queue_batch
+        (Array.init 10 (fun index () ->
+          if index = 3 then raise Exit else index * index))
+        begin fun result ->
+          results := check_success_result "queue_batch" result
+        end;
+
+      run ();
+
+      Alcotest.(check int) "count" 10 (Array.length !results);
+      !results |> Array.iteri begin fun index result ->
+        match result with
+        | Ok square -> Alcotest.(check int) "square" (index * index) square
+        | Error Exit -> Alcotest.(check int) "exception index" 3 index
+        | Error _ -> Alcotest.fail "unexpected exception"
+      end
+    end;
+
+    "work: batch in queue", `Quick, begin fun () ->
+      let queue = Luv.Thread_pool.Queue.create ~size:1 "test" in
+      let completed = ref 0 in
+
+      for _ = 1 to 2 do
+        Luv.Thread_pool.queue_batch ~queue [|ignore; ignore|]
+            begin fun result ->
+          let results = check_success_result "queue_batch" result in
+          Alcotest.(check int) "count" 2 (Array.length results);
+          incr completed
+        end
+      done;
+
+      Alcotest.(check int) "pending" 1 (Luv.Thread_pool.Queue.pending queue);
+      run ();
+
+      Alcotest.(check int) "completed" 2 !completed;
+      Alcotest.(check int) "running" 0 (Luv.Thread_pool.Queue.running queue)
+    end;
+
+    "work: pipeline", `Quick, begin fun () ->
+      let libc =
+        ["libc.so.6"; "libc.so"; "/usr/lib/libSystem.B.dylib"]
+        |> List.fold_left (fun libc path ->
+          match libc with
+          | None -> Luv.DLL.open_ path
+          | Some _ -> libc) None
+      in
+      match libc with
+      | None ->
+        ()
+      | Some libc ->
+        let symbol name =
+          match Luv.DLL.sym libc name with
+          | Some address -> address
+          | None -> Alcotest.fail name
+        in
+        (* Each stage is called with a C string. strlen always succeeds, and
+           atoi reports failure when the string is a negative number, which is
+           then taken as an error code. *)
+        let pipeline =
+          [symbol "strlen"; symbol "atoi"]
+          |> Luv.Thread_pool.Pipeline.create ~slots:2
+          |> check_success_result "create"
+        in
+        let arguments = ["1"; "22"; "-22"; "333"; "-2"] in
+        let strings = List.map Ctypes.CArray.of_string arguments in
+        let results = Array.make (List.length arguments) None in
+
+        strings |> List.iteri begin fun index string ->
+          let argument =
+            Ctypes.(raw_address_of_ptr (to_voidp (CArray.start string))) in
+          Luv.Thread_pool.Pipeline.run pipeline ~argument (fun result ->
+            results.(index) <- Some result)
+        end;
+
+        Alcotest.(check int) "slots" 2
+          (Luv.Thread_pool.Pipeline.slots pipeline);
+        Alcotest.(check int) "running" 2
+          (Luv.Thread_pool.Pipeline.running pipeline);
+        Alcotest.(check int) "pending" 3
+          (Luv.Thread_pool.Pipeline.pending pipeline);
+
+        Luv.Thread_pool.Pipeline.close pipeline;
+        let after_close = ref None in
+        Luv.Thread_pool.Pipeline.run pipeline (fun result ->
+          after_close := Some result);
+
+        run ();
+
+        let check_result index expected =
+          match results.(index), expected with
+          | Some (Ok result), `Ok expected ->
+            Alcotest.(check int) "result" expected result
+          | Some (Error (stage, error)), `Error (stage', error') ->
+            Alcotest.(check int) "stage" stage' stage;
+            check_error_code "error" error' error
+          | _ ->
+            Alcotest.fail (List.nth arguments index)
+        in
+        check_result 0 (`Ok 1);
+        check_result 1 (`Ok 22);
+        check_result 2 (`Error (1, `EINVAL));
+        check_result 3 (`Ok 333);
+        check_result 4 (`Error (1, `ENOENT));
+
+        begin match !after_close with
+        | Some (Error (0, `ECANCELED)) -> ()
+        | _ -> Alcotest.fail "run after close"
+        end;
+        Alcotest.(check int) "running" 0
+          (Luv.Thread_pool.Pipeline.running pipeline);
+
+        ignore (Sys.opaque_identity strings);
+        Luv.DLL.close libc
+    end;
+
     "create", `Quick, begin fun () ->
       let parent_thread_id = get_thread_id () in
       let child_thread_id = ref parent_thread_id in
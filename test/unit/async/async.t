@@ -10,3 +10,6 @@
   $ dune exec ./exception.exe
   Exception
   Ok
+
+  $ dune exec ./channel.exe
+  40000 true
@@ -0,0 +1,33 @@
+let threads = 4
+let messages = 10000
+
+let () =
+  let received = ref 0 in
+  let in_order = ref true in
+  let last = Array.make threads (-1) in
+
+  let close = ref ignore in
+
+  Luv.Channel.init begin fun (thread, message) ->
+    if message <> last.(thread) + 1 then
+      in_order := false;
+    last.(thread) <- message;
+    incr received;
+    if !received = threads * messages then
+      !close ()
+  end
+  |> ok "init" @@ fun channel ->
+
+  close := (fun () -> Luv.Channel.close channel ignore);
+
+  for thread = 0 to threads - 1 do
+    ignore @@ Thread.create begin fun () ->
+      for message = 0 to messages - 1 do
+        Luv.Channel.send channel (thread, message) |> ok "send" ignore
+      done
+    end ()
+  done;
+
+  Luv.Loop.run () |> ignore;
+
+  Printf.printf "%i %b\n" !received !in_order
@@ -0,0 +1,36 @@
+let rec fibonacci n =
+  if n < 2 then n else fibonacci (n - 1) + fibonacci (n - 2)
+
+let () =
+  let pool =
+    match Luv_domain_pool.create ~domains:2 () with
+    | Ok pool -> pool
+    | Error error -> failwith (Luv.Error.strerror error)
+  in
+
+  let results = Array.make 8 0 in
+  for index = 0 to 7 do
+    Luv_domain_pool.submit pool (fun () -> fibonacci (20 + index))
+      (function
+        | Ok value -> results.(index) <- value
+        | Error exn -> raise exn)
+  done;
+
+  let outer = ref "" in
+  let nested = ref "" in
+  Luv_domain_pool.submit pool
+    (fun () ->
+      Luv_domain_pool.submit pool (fun () -> raise Exit) (function
+        | Error Exit -> nested := "nested: Exit"
+        | _ -> nested := "nested: unexpected");
+      "outer")
+    (function
+      | Ok value -> outer := value
+      | Error _ -> outer := "outer: unexpected");
+
+  ignore (Luv.Loop.run () : bool);
+
+  print_endline !outer;
+  print_endline !nested;
+  Array.iter (Printf.printf "%i\n") results;
+  Luv_domain_pool.shutdown pool
@@ -0,0 +1,35 @@
+let () =
+  Helpers.with_loop @@ fun loop ->
+
+  Luv.Metrics.enable_instrumentation loop |> ok "enable" @@ fun () ->
+
+  Luv.Timer.init ~loop () |> ok "timer init" @@ fun timer ->
+  Luv.Timer.start timer 10 (fun () -> Luv.Handle.close timer ignore)
+  |> ok "timer start" ignore;
+  Luv.Thread_pool.queue_work ~loop ignore ignore;
+
+  ignore (Luv.Loop.run ~loop () : bool);
+
+  let count measurements kind =
+    match List.assoc kind measurements.Luv.Metrics.callbacks with
+    | exception Not_found -> 0
+    | histogram -> histogram.Luv.Metrics.count
+  in
+
+  Luv.Metrics.instrumentation ~reset:true loop
+  |> ok "instrumentation" @@ fun measurements ->
+  Printf.printf "%i %i %i %b\n"
+    (count measurements "timer")
+    (count measurements "work")
+    measurements.Luv.Metrics.work_wait.Luv.Metrics.count
+    (measurements.Luv.Metrics.iterations > 0);
+
+  Luv.Metrics.instrumentation loop
+  |> ok "instrumentation" @@ fun measurements ->
+  Printf.printf "%i\n" (List.length measurements.Luv.Metrics.callbacks);
+
+  Luv.Metrics.disable_instrumentation loop;
+  ignore (Luv.Loop.run ~loop () : bool);
+
+  Luv.Metrics.instrumentation loop
+  |> error [`EINVAL] "after disable" ignore
@@ -36,3 +36,11 @@
 
   $ dune exec ./update_time.exe
   Ok
+
+  $ dune exec ./instrumentation.exe
+  2 1 1 true
+  0
+
+  $ dune exec ./trace.exe
+  2 true {"traceEvents"
+  0
@@ -0,0 +1,25 @@
+let () =
+  Luv.Trace.start () |> ok "start" @@ fun () ->
+
+  Luv.Timer.init () |> ok "timer init" @@ fun timer ->
+  Luv.Timer.start timer 10 (fun () -> Luv.Handle.close timer ignore)
+  |> ok "timer start" ignore;
+
+  ignore (Luv.Loop.run () : bool);
+  Luv.Trace.stop ();
+
+  let events = Luv.Trace.events ~clear:true () in
+  let timer_events =
+    List.filter (fun event -> event.Luv.Trace.kind = "timer") events in
+  let well_formed =
+    List.for_all
+      (fun event -> event.Luv.Trace.finish >= event.Luv.Trace.start)
+      events
+  in
+  let json = Luv.Trace.to_chrome_json events in
+  Printf.printf "%i %b %s\n"
+    (List.length timer_events)
+    well_formed
+    (String.sub json 0 14);
+
+  Printf.printf "%i\n" (List.length (Luv.Trace.events ()))
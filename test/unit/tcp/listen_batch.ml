@@ -0,0 +1,33 @@
+let connections = 10
+
+let () =
+  Luv.Sockaddr.ipv4 "127.0.0.1" 5129 |> ok "ipv4" @@ fun address ->
+
+  Luv.TCP.init () |> ok "server init" @@ fun server ->
+  Luv.TCP.bind server address |> ok "bind" @@ fun () ->
+
+  let accepted = ref 0 in
+  let largest = ref 0 in
+  Luv.TCP.listen_batch ~max_connections:4 server begin fun result ->
+    result |> ok "listen_batch" @@ fun clients ->
+    largest := max !largest (List.length clients);
+    accepted := !accepted + List.length clients;
+    List.iter (fun client -> Luv.Handle.close client ignore) clients;
+    if !accepted = connections then
+      Luv.Handle.close server ignore
+  end;
+
+  (* Over loopback, each connection is established by the kernel during
+     connect, so all of them are waiting in the accept queue by the time the
+     loop first polls the listener. *)
+  for _ = 1 to connections do
+    Luv.TCP.init () |> ok "client init" @@ fun client ->
+    Luv.TCP.connect client address begin fun result ->
+      result |> ok "connect" @@ fun () ->
+      Luv.Handle.close client ignore
+    end
+  done;
+
+  Luv.Loop.run () |> ignore;
+
+  Printf.printf "%i %b\n" !accepted (Sys.win32 || !largest > 1)
@@ -0,0 +1,39 @@
+let () =
+  let pool = Luv.Object_pool.create () in
+
+  Luv.Sockaddr.ipv4 "127.0.0.1" 5130 |> ok "ipv4" @@ fun address ->
+
+  Luv.TCP.init () |> ok "server init" @@ fun server ->
+  Luv.TCP.bind server address |> ok "bind" @@ fun () ->
+  Luv.Stream.listen server begin fun result ->
+    result |> ok "listen" @@ fun () ->
+    Luv.TCP.init ~object_pool:pool () |> ok "accept init" @@ fun client ->
+    Luv.Stream.accept ~server ~client |> ok "accept" @@ fun () ->
+    Luv.Stream.read_start client (function
+      | Error `EOF ->
+        Luv.Handle.close client ignore;
+        Luv.Handle.close server ignore
+      | Error _ as result -> result |> ok "read" ignore
+      | Ok _ -> ())
+  end;
+
+  Luv.TCP.init ~object_pool:pool () |> ok "client init" @@ fun client ->
+  Luv.TCP.connect client address begin fun result ->
+    result |> ok "connect" @@ fun () ->
+    Luv.Stream.write client [Luv.Buffer.from_string "foo"] (fun result _ ->
+      result |> ok "write" @@ fun () ->
+      Luv.Handle.close client ignore)
+  end;
+
+  Luv.Loop.run () |> ignore;
+
+  (* Two TCP handles, a connect request, and a write request. *)
+  let available = Luv.Object_pool.available pool in
+
+  Luv.TCP.init ~object_pool:pool () |> ok "reuse" @@ fun tcp ->
+  Printf.printf "%i %i\n" available (Luv.Object_pool.available pool);
+  Luv.Handle.close tcp ignore;
+  Luv.Loop.run () |> ignore;
+
+  Luv.Object_pool.clear pool;
+  Printf.printf "%i\n" (Luv.Object_pool.available pool)
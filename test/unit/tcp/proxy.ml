@@ -0,0 +1,73 @@
+let read_all tcp f =
+  let received = Buffer.create 16 in
+  Luv.Stream.read_start tcp begin function
+    | Ok b ->
+      Buffer.add_string received (Luv.Buffer.to_string b)
+    | Error `EOF ->
+      f (Buffer.contents received)
+    | Error _ as result ->
+      result |> ok "read_start" ignore
+  end
+
+let listen port f =
+  Luv.Sockaddr.ipv4 "127.0.0.1" port |> ok "ipv4" @@ fun address ->
+  Luv.TCP.init () |> ok "server init" @@ fun server ->
+  Luv.TCP.bind server address |> ok "bind" @@ fun () ->
+  Luv.Stream.listen server begin fun result ->
+    result |> ok "listen" @@ fun () ->
+    Luv.TCP.init () |> ok "accept init" @@ fun client ->
+    Luv.Stream.accept ~server ~client |> ok "accept" @@ fun () ->
+    Luv.Handle.close server ignore;
+    f client
+  end;
+  address
+
+let () =
+  let backend_address =
+    listen 5126 begin fun backend ->
+      read_all backend begin fun data ->
+        Luv.Stream.write backend [Luv.Buffer.from_string ("reply:" ^ data)]
+            begin fun result _ ->
+          result |> ok "backend write" @@ fun () ->
+          Luv.Handle.close backend ignore
+        end
+      end
+    end
+  in
+
+  let proxy_result = ref "" in
+  let client_result = ref "" in
+
+  let proxy_address =
+    listen 5127 begin fun inbound ->
+      Luv.TCP.init () |> ok "outbound init" @@ fun outbound ->
+      Luv.TCP.connect outbound backend_address begin fun result ->
+        result |> ok "connect" @@ fun () ->
+        Luv.Stream.proxy inbound outbound begin fun result ~forward ~backward ->
+          result |> ok "proxy" @@ fun () ->
+          proxy_result := Printf.sprintf "%i %i" forward backward;
+          Luv.Handle.close inbound ignore;
+          Luv.Handle.close outbound ignore
+        end
+      end
+    end
+  in
+
+  Luv.TCP.init () |> ok "client init" @@ fun client ->
+  Luv.TCP.connect client proxy_address begin fun result ->
+    result |> ok "client connect" @@ fun () ->
+    Luv.Stream.write client [Luv.Buffer.from_string "hello"]
+        begin fun result _ ->
+      result |> ok "client write" @@ fun () ->
+      Luv.Stream.shutdown client ignore
+    end;
+    read_all client begin fun data ->
+      client_result := data;
+      Luv.Handle.close client ignore
+    end
+  end;
+
+  Luv.Loop.run () |> ignore;
+
+  print_endline !proxy_result;
+  Printf.printf "%S\n" !client_result
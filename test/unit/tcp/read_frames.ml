@@ -0,0 +1,29 @@
+let () =
+  let frames = ref 0 in
+
+  Helpers.with_server_and_client
+    ~port:5121
+    ~server:begin fun server_tcp accept_tcp ->
+      Luv.Stream.read_frames accept_tcp (`Length_prefixed 2)
+          begin fun result ->
+        result |> ok "read_frames" @@ fun frame ->
+        Printf.printf "%S\n" (Luv.Buffer.to_string frame);
+        incr frames;
+        if !frames = 3 then begin
+          Luv.Handle.close accept_tcp ignore;
+          Luv.Handle.close server_tcp ignore
+        end
+      end
+    end
+    ~client:begin fun client_tcp _ ->
+      Luv.Stream.write client_tcp [Luv.Buffer.from_string "\000\003foo\000"]
+          begin fun result _ ->
+        result |> ok "write" @@ fun () ->
+        Luv.Stream.write client_tcp
+            [Luv.Buffer.from_string "\005hello\000\000"]
+            begin fun result _ ->
+          Luv.Handle.close client_tcp ignore;
+          result |> ok "write" ignore
+        end
+      end
+    end
@@ -0,0 +1,26 @@
+let () =
+  Helpers.with_server_and_client
+    ~port:5122
+    ~server:begin fun server_tcp accept_tcp ->
+      Luv.Stream.read_frames accept_tcp (`Delimited '\n') begin function
+        | Ok frame ->
+          Printf.printf "%S\n" (Luv.Buffer.to_string frame)
+        | Error `EOF ->
+          print_endline "EOF";
+          Luv.Handle.close accept_tcp ignore;
+          Luv.Handle.close server_tcp ignore
+        | Error e ->
+          Printf.printf "Error: %s\n" (Luv.Error.strerror e)
+      end
+    end
+    ~client:begin fun client_tcp _ ->
+      Luv.Stream.write client_tcp [Luv.Buffer.from_string "foo\nbar\nba"]
+          begin fun result _ ->
+        result |> ok "write" @@ fun () ->
+        Luv.Stream.write client_tcp [Luv.Buffer.from_string "z\nqux"]
+            begin fun result _ ->
+          Luv.Handle.close client_tcp ignore;
+          result |> ok "write" ignore
+        end
+      end
+    end
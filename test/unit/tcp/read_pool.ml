@@ -0,0 +1,23 @@
+let () =
+  let pool = Luv.Buffer_pool.create () in
+
+  Helpers.with_server_and_client
+    ~port:5120
+    ~server:begin fun server_tcp accept_tcp ->
+      Luv.Stream.read_start ~pool accept_tcp begin fun result ->
+        result |> ok "read_start" @@ fun b ->
+        Printf.printf "%S\n" (Luv.Buffer.to_string b);
+        Printf.printf "%i\n" (Luv.Buffer_pool.outstanding pool);
+        Luv.Buffer_pool.release pool b;
+        Printf.printf "%i\n" (Luv.Buffer_pool.outstanding pool);
+        Luv.Handle.close accept_tcp ignore;
+        Luv.Handle.close server_tcp ignore
+      end
+    end
+    ~client:begin fun client_tcp _ ->
+      Luv.Stream.write client_tcp [Luv.Buffer.from_string "foo"]
+          begin fun result _ ->
+        Luv.Handle.close client_tcp ignore;
+        result |> ok "write" ignore
+      end
+    end
@@ -0,0 +1,33 @@
+let () =
+  let path = Filename.temp_file "luv" "send_file" in
+  let channel = open_out_bin path in
+  output_string channel "0123456789abcdef";
+  close_out channel;
+
+  Helpers.with_server_and_client
+    ~port:5125
+    ~server:begin fun server_tcp accept_tcp ->
+      let received = Buffer.create 16 in
+      Luv.Stream.read_start accept_tcp begin function
+        | Ok b ->
+          Buffer.add_string received (Luv.Buffer.to_string b)
+        | Error `EOF ->
+          Printf.printf "%S\n" (Buffer.contents received);
+          Luv.Handle.close accept_tcp ignore;
+          Luv.Handle.close server_tcp ignore
+        | Error _ as result ->
+          result |> ok "read_start" ignore
+      end
+    end
+    ~client:begin fun client_tcp _ ->
+      Luv.File.Sync.open_ path [`RDONLY] |> ok "open_" @@ fun file ->
+      Luv.Stream.write client_tcp [Luv.Buffer.from_string "head:"] ignore;
+      Luv.Stream.send_file client_tcp file ~offset:4L ~length:8
+          begin fun result bytes_sent ->
+        result |> ok "send_file" @@ fun () ->
+        Printf.printf "%i\n" bytes_sent;
+        Luv.File.Sync.close file |> ok "close" ignore;
+        Sys.remove path;
+        Luv.Handle.close client_tcp ignore
+      end
+    end
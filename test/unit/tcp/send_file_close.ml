@@ -0,0 +1,47 @@
+let () =
+  let path = Filename.temp_file "luv" "send_file_close" in
+  let channel = open_out_bin path in
+  seek_out channel (64 * 1024 * 1024 - 1);
+  output_char channel '\000';
+  close_out channel;
+
+  Helpers.with_server_and_client
+    ~port:5131
+    ~server:begin fun server_tcp accept_tcp ->
+      (* The server doesn't read until the client has closed its socket, so the
+         client's send buffer fills up, and send_file waits for it to become
+         writable. *)
+      Luv.Timer.init () |> ok "timer init" @@ fun timer ->
+      Luv.Timer.start timer 100 begin fun () ->
+        Luv.Handle.close timer ignore;
+        Luv.Stream.read_start accept_tcp begin function
+          | Ok _ ->
+            ()
+          | Error `EOF ->
+            print_endline "EOF";
+            Luv.Handle.close accept_tcp ignore;
+            Luv.Handle.close server_tcp ignore
+          | Error _ as result ->
+            result |> ok "read_start" ignore
+        end
+      end
+      |> ok "timer start" ignore
+    end
+    ~client:begin fun client_tcp _ ->
+      Luv.File.Sync.open_ path [`RDONLY] |> ok "open_" @@ fun file ->
+      Luv.Timer.init () |> ok "timer init" @@ fun timer ->
+      Luv.Timer.start timer 50 begin fun () ->
+        Luv.Handle.close timer ignore;
+        Luv.Handle.close client_tcp ignore
+      end
+      |> ok "timer start" ignore;
+      Luv.Stream.send_file client_tcp file ~offset:0L ~length:(64 * 1024 * 1024)
+          begin fun result _ ->
+        begin match result with
+        | Ok () -> print_endline "Ok"
+        | Error e -> print_endline (Luv.Error.err_name e)
+        end;
+        Luv.File.Sync.close file |> ok "close" ignore;
+        Sys.remove path
+      end
+    end
@@ -0,0 +1,55 @@
+let connections = 8
+
+let () =
+  Luv.Sockaddr.ipv4 "127.0.0.1" 5128 |> ok "ipv4" @@ fun address ->
+
+  let serve shard client =
+    let reply =
+      Luv.Buffer.from_string (string_of_int (Luv.Sharded_server.index shard)) in
+    Luv.Stream.write client [reply] (fun _ _ -> Luv.Handle.close client ignore)
+  in
+
+  (* Each shard hands every connection it accepts off to the other shard, so
+     that every connection goes through a hand-off, however the kernel spreads
+     the connections between the listeners. *)
+  let shards = ref [] in
+  let handed_off = ref 0 in
+
+  Luv.Sharded_server.start ~shards:2 address begin fun shard client ->
+    let index = Luv.Sharded_server.index shard in
+    let others =
+      List.filter (fun other -> Luv.Sharded_server.index other <> index)
+        !shards
+    in
+    match others with
+    | [target] ->
+      Luv.Sharded_server.hand_off client target (fun result ->
+        result |> ok "hand_off result" @@ fun client ->
+        incr handed_off;
+        serve target client)
+      |> ok "hand_off" ignore
+    | _ ->
+      serve shard client
+  end
+  |> ok "start" @@ fun server ->
+
+  shards := Luv.Sharded_server.shards server;
+
+  let replies = ref [] in
+  for _ = 1 to connections do
+    Luv.TCP.init () |> ok "init" @@ fun tcp ->
+    Luv.TCP.connect tcp address begin fun result ->
+      result |> ok "connect" @@ fun () ->
+      Luv.Stream.read_start tcp (function
+        | Error `EOF -> Luv.Handle.close tcp ignore
+        | Error _ as result -> result |> ok "read" ignore
+        | Ok buffer -> replies := Luv.Buffer.to_string buffer::!replies)
+    end
+  done;
+
+  Luv.Loop.run () |> ignore;
+
+  Luv.Sharded_server.stop server;
+  Luv.Sharded_server.join server |> ok "join" @@ fun () ->
+
+  Printf.printf "%i %i\n" (List.length !replies) !handed_off
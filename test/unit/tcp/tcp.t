@@ -100,3 +100,53 @@
 
   $ dune exec ./socketpair.exe
   "foo"
+
+  $ dune exec ./read_pool.exe
+  "foo"
+  1
+  0
+
+  $ dune exec ./read_frames.exe
+  "foo"
+  "hello"
+  ""
+
+  $ dune exec ./read_frames_delimited.exe
+  "foo"
+  "bar"
+  "baz"
+  EOF
+
+  $ dune exec ./writer.exe
+  9
+  3
+  3
+  3
+  "foobarbaz"
+
+  $ dune exec ./write_request.exe
+  EBUSY
+  false
+  "foobar"
+
+  $ dune exec ./send_file.exe
+  8
+  "head:456789ab"
+
+  $ dune exec ./proxy.exe
+  5 11
+  "reply:hello"
+
+  $ dune exec ./sharded.exe
+  8 8
+
+  $ dune exec ./listen_batch.exe
+  10 true
+
+  $ dune exec ./object_pool.exe
+  4 3
+  0
+
+  $ dune exec ./send_file_close.exe
+  ECANCELED
+  EOF
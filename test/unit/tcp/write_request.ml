@@ -0,0 +1,36 @@
+let () =
+  Helpers.with_server_and_client
+    ~port:5124
+    ~server:begin fun server_tcp accept_tcp ->
+      let received = Buffer.create 16 in
+      Luv.Stream.read_start accept_tcp begin function
+        | Ok b ->
+          Buffer.add_string received (Luv.Buffer.to_string b)
+        | Error `EOF ->
+          Printf.printf "%S\n" (Buffer.contents received);
+          Luv.Handle.close accept_tcp ignore;
+          Luv.Handle.close server_tcp ignore
+        | Error _ as result ->
+          result |> ok "read_start" ignore
+      end
+    end
+    ~client:begin fun client_tcp _ ->
+      let request = Luv.Stream.Write_request.make () in
+      Luv.Stream.write ~request client_tcp [Luv.Buffer.from_string "foo"]
+          begin fun result _ ->
+        result |> ok "write" @@ fun () ->
+        Luv.Stream.write ~request client_tcp [Luv.Buffer.from_string "bar"]
+            begin fun result _ ->
+          result |> ok "write" @@ fun () ->
+          Printf.printf "%b\n" (Luv.Stream.Write_request.in_use request);
+          Luv.Stream.Write_request.release request;
+          Luv.Handle.close client_tcp ignore
+        end
+      end;
+      Luv.Stream.write ~request client_tcp [Luv.Buffer.from_string "baz"]
+          begin fun result _ ->
+        match result with
+        | Error `EBUSY -> print_endline "EBUSY"
+        | _ -> print_endline "Unexpected"
+      end
+    end
@@ -0,0 +1,36 @@
+let () =
+  Helpers.with_server_and_client
+    ~port:5123
+    ~server:begin fun server_tcp accept_tcp ->
+      let received = Buffer.create 16 in
+      Luv.Stream.read_start accept_tcp begin function
+        | Ok b ->
+          Buffer.add_string received (Luv.Buffer.to_string b)
+        | Error `EOF ->
+          Printf.printf "%S\n" (Buffer.contents received);
+          Luv.Handle.close accept_tcp ignore;
+          Luv.Handle.close server_tcp ignore
+        | Error _ as result ->
+          result |> ok "read_start" ignore
+      end
+    end
+    ~client:begin fun client_tcp _ ->
+      Luv.Stream.Writer.create client_tcp |> ok "create" @@ fun writer ->
+      let remaining = ref 3 in
+      let write s =
+        Luv.Stream.Writer.write writer [Luv.Buffer.from_string s]
+            begin fun result bytes ->
+          result |> ok "write" @@ fun () ->
+          Printf.printf "%i\n" bytes;
+          decr remaining;
+          if !remaining = 0 then begin
+            Luv.Stream.Writer.close writer;
+            Luv.Handle.close client_tcp ignore
+          end
+        end
+      in
+      write "foo";
+      write "bar";
+      write "baz";
+      Printf.printf "%i\n" (Luv.Stream.Writer.pending_bytes writer)
+    end
@@ -50,3 +50,12 @@
   true
   false
   false
+
+  $ dune exec ./wheel.exe
+  4 false
+  10
+  30
+  restarted
+  100
+  0 false
+  10 0
@@ -0,0 +1,48 @@
+let () =
+  Luv.Timer_wheel.create () |> ok "create" @@ fun wheel ->
+
+  let fired name () = print_endline name in
+  ignore (Luv.Timer_wheel.add wheel 30 (fired "30"));
+  ignore (Luv.Timer_wheel.add wheel 10 (fired "10"));
+  ignore (Luv.Timer_wheel.add wheel 100 (fired "100"));
+  let cancelled = Luv.Timer_wheel.add wheel 20 (fired "cancelled") in
+  let restarted = Luv.Timer_wheel.add wheel 5 (fired "restarted") in
+  Luv.Timer_wheel.cancel cancelled;
+  Luv.Timer_wheel.restart restarted 50;
+  Printf.printf "%i %b\n"
+    (Luv.Timer_wheel.count wheel) (Luv.Timer_wheel.is_active cancelled);
+
+  ignore (Luv.Loop.run () : bool);
+
+  Printf.printf "%i %b\n"
+    (Luv.Timer_wheel.count wheel) (Luv.Timer_wheel.is_active restarted);
+  Luv.Timer_wheel.close wheel ignore;
+  ignore (Luv.Loop.run () : bool);
+
+  (* With a coarse resolution, timeouts added between ticks must still not fire
+     early. A repeating timer adds them at varying offsets from the ticks. *)
+  let loop = Luv.Loop.default () in
+  Luv.Timer_wheel.create ~resolution:10 () |> ok "create" @@ fun wheel ->
+  Luv.Timer.init () |> ok "timer init" @@ fun timer ->
+  let added = ref 0 in
+  let fired = ref 0 in
+  let early = ref 0 in
+  Luv.Timer.start timer 0 ~repeat:3 begin fun () ->
+    let start = Luv.Loop.now loop in
+    ignore (Luv.Timer_wheel.add wheel 10 begin fun () ->
+      incr fired;
+      let elapsed = Unsigned.UInt64.(to_int (sub (Luv.Loop.now loop) start)) in
+      if elapsed < 10 then
+        incr early
+    end);
+    incr added;
+    if !added = 10 then
+      Luv.Handle.close timer ignore
+  end
+  |> ok "timer start" ignore;
+
+  ignore (Luv.Loop.run () : bool);
+
+  Printf.printf "%i %i\n" !fired !early;
+  Luv.Timer_wheel.close wheel ignore;
+  ignore (Luv.Loop.run () : bool)
@@ -0,0 +1,24 @@
+let () =
+  Helpers.with_sender_and_receiver
+    ~port:5213
+    ~sender:begin fun sender_udp address ->
+      let b = Luv.Buffer.from_string "foo" in
+      Luv.UDP.send sender_udp [b] address @@ fun result ->
+      result |> ok "send" @@ fun () ->
+      Luv.Handle.close sender_udp ignore
+    end
+    ~receiver:begin fun receiver_udp ->
+      Luv.UDP.recv_batch_start receiver_udp begin fun result ->
+        result |> ok "recv_batch_start" @@ fun batch ->
+        Printf.printf "%i\n" (Luv.UDP.Batch.count batch);
+        let datagram = Luv.UDP.Batch.datagram batch 0 in
+        Printf.printf "%S\n" (Luv.Buffer.to_string datagram);
+        Printf.printf "%b\n" (Luv.UDP.Batch.partial batch 0);
+        begin match Luv.Sockaddr.to_string (Luv.UDP.Batch.peer batch 0) with
+        | Some address -> print_endline address
+        | None -> print_endline "None"
+        end;
+        Luv.UDP.recv_stop receiver_udp |> ok "recv_stop" @@ fun () ->
+        Luv.Handle.close receiver_udp ignore
+      end
+    end
@@ -0,0 +1,41 @@
+let datagrams = 5
+
+let () =
+  Luv.Sockaddr.ipv4 "127.0.0.1" 5217 |> ok "ipv4" @@ fun address ->
+
+  Luv.UDP.init ~recvmmsg:true () |> ok "receiver init" @@ fun receiver_udp ->
+  Luv.UDP.bind receiver_udp address |> ok "bind" @@ fun () ->
+  let batching = Luv.UDP.using_recvmmsg receiver_udp in
+
+  Luv.UDP.init () |> ok "sender init" @@ fun sender_udp ->
+  let rec send n =
+    if n < datagrams then begin
+      let b = Luv.Buffer.from_string (string_of_int n) in
+      Luv.UDP.try_send sender_udp [b] address |> ok "try_send" @@ fun () ->
+      send (n + 1)
+    end
+  in
+  send 0;
+  Luv.Handle.close sender_udp ignore;
+
+  let received = ref [] in
+  let largest = ref 0 in
+
+  Luv.UDP.recv_batch_start receiver_udp begin fun result ->
+    result |> ok "recv_batch_start" @@ fun batch ->
+    let count = Luv.UDP.Batch.count batch in
+    largest := max !largest count;
+    for i = 0 to count - 1 do
+      let datagram = Luv.UDP.Batch.datagram batch i in
+      received := Luv.Buffer.to_string datagram :: !received
+    done;
+    if List.length !received >= datagrams then begin
+      Luv.UDP.recv_stop receiver_udp |> ok "recv_stop" @@ fun () ->
+      Luv.Handle.close receiver_udp ignore
+    end
+  end;
+
+  Luv.Loop.run () |> ignore;
+
+  print_endline (String.concat " " (List.rev !received));
+  Printf.printf "%b\n" (not batching || !largest > 1)
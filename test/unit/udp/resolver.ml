@@ -0,0 +1,149 @@
+(* A stub DNS server, which answers over UDP and TCP from a small fixed zone. *)
+
+let uint16 n =
+  String.init 2 (fun i -> Char.chr ((n lsr (8 * (1 - i))) land 0xff))
+
+let rec encode_name name =
+  let label label = String.make 1 (Char.chr (String.length label)) ^ label in
+  match String.index name '.' with
+  | exception Not_found ->
+    label name ^ "\000"
+  | index ->
+    let rest = String.sub name (index + 1) (String.length name - index - 1) in
+    label (String.sub name 0 index) ^ encode_name rest
+
+let read_question query =
+  let rec read offset labels =
+    let length = Char.code query.[offset] in
+    if length = 0 then
+      String.concat "." (List.rev labels), offset + 1
+    else
+      read
+        (offset + 1 + length) ((String.sub query (offset + 1) length)::labels)
+  in
+  let name, end_ = read 12 [] in
+  let byte offset = Char.code query.[offset] in
+  let qtype = ((byte end_) lsl 8) lor (byte (end_ + 1)) in
+  name, qtype, String.sub query 12 (end_ + 4 - 12)
+
+let record ?(name = "\xc0\x0c") rtype rdata =
+  name ^ uint16 rtype ^ uint16 1 ^ "\000\000\000\060" ^
+  uint16 (String.length rdata) ^ rdata
+
+let respond ~tcp query =
+  let name, qtype, question = read_question query in
+  let flags, answers =
+    match String.lowercase_ascii name, qtype with
+    | "www.example.test", 1 ->
+      0x8180, [
+        record 5 (encode_name "host.example.test");
+        record ~name:(encode_name "host.example.test") 1 "\010\000\000\001";
+      ]
+    | "_sip._udp.example.test", 33 ->
+      0x8180, [
+        record 33 (uint16 20 ^ uint16 0 ^ uint16 5061 ^
+          encode_name "other.example.test");
+        record 33 (uint16 10 ^ uint16 5 ^ uint16 5060 ^
+          encode_name "sip.example.test");
+      ]
+    | "big.example.test", 28 when not tcp ->
+      0x8380, []
+    | "big.example.test", 28 ->
+      0x8180, [record 28 (String.make 15 '\000' ^ "\001")]
+    | _ ->
+      0x8183, []
+  in
+  String.sub query 0 2 ^ uint16 flags ^ uint16 1 ^
+  uint16 (List.length answers) ^ uint16 0 ^ uint16 0 ^
+  question ^ String.concat "" answers
+
+let print_addresses addresses =
+  addresses |> List.iter (fun address ->
+    match Luv.Sockaddr.to_string address with
+    | Some address -> print_endline address
+    | None -> print_endline "None")
+
+let () =
+  Luv.Sockaddr.ipv4 "127.0.0.1" 5216 |> ok "ipv4" @@ fun address ->
+
+  Luv.UDP.init () |> ok "udp init" @@ fun udp ->
+  Luv.UDP.bind udp address |> ok "udp bind" @@ fun () ->
+  Luv.UDP.recv_start udp begin fun result ->
+    result |> ok "recv" @@ fun (buffer, peer, _) ->
+    match peer with
+    | None ->
+      ()
+    | Some peer ->
+      let response = respond ~tcp:false (Luv.Buffer.to_string buffer) in
+      Luv.UDP.send udp [Luv.Buffer.from_string response] peer (fun result ->
+        result |> ok "send" ignore)
+  end;
+
+  Luv.TCP.init () |> ok "tcp init" @@ fun server ->
+  Luv.TCP.bind server address |> ok "tcp bind" @@ fun () ->
+  Luv.Stream.listen server begin fun result ->
+    result |> ok "listen" @@ fun () ->
+    Luv.TCP.init () |> ok "accept init" @@ fun client ->
+    Luv.Stream.accept ~server ~client |> ok "accept" @@ fun () ->
+    Luv.Stream.read_start client begin fun result ->
+      result |> ok "read" @@ fun buffer ->
+      let query = Luv.Buffer.to_string buffer in
+      let query = String.sub query 2 (String.length query - 2) in
+      let response = respond ~tcp:true query in
+      let response = uint16 (String.length response) ^ response in
+      Luv.Stream.write client [Luv.Buffer.from_string response]
+          (fun result _ ->
+        result |> ok "write" @@ fun () ->
+        Luv.Handle.close client ignore)
+    end
+  end;
+
+  let config = {
+    Luv.Resolver.Config.nameservers = [address];
+    search = ["example.test"];
+    ndots = 1;
+    timeout = 1000;
+    attempts = 1;
+  }
+  in
+  let hosts = Luv.Resolver.Hosts.parse "10.1.2.3 Static.test # comment\n" in
+  let resolver = Luv.Resolver.create ~config ~hosts () in
+
+  (* Literals are answered immediately, without querying for either family. *)
+  Luv.Resolver.addresses resolver "127.0.0.1" begin fun result ->
+    result |> ok "addresses" print_addresses
+  end;
+  Luv.Resolver.a resolver "::1" begin function
+    | Ok _ -> print_endline "Ok"
+    | Error e -> print_endline (Luv.Error.err_name e)
+  end;
+
+  Luv.Resolver.a resolver "www" begin fun result ->
+    result |> ok "a" @@ fun addresses ->
+    print_addresses addresses;
+
+    Luv.Resolver.srv resolver "_sip._udp.example.test" @@ fun result ->
+    result |> ok "srv" @@ fun records ->
+    records |> List.iter (fun record ->
+      let open Luv.Resolver.Srv in
+      Printf.printf "%s %i %i\n" record.target record.port record.priority);
+
+    Luv.Resolver.aaaa resolver "big.example.test" @@ fun result ->
+    result |> ok "aaaa" @@ fun addresses ->
+    print_addresses addresses;
+
+    Luv.Resolver.a resolver "static.test" @@ fun result ->
+    result |> ok "hosts" @@ fun addresses ->
+    print_addresses addresses;
+
+    Luv.Resolver.a resolver "missing.test." @@ fun result ->
+    begin match result with
+    | Error `EAI_NONAME -> print_endline "EAI_NONAME"
+    | _ -> print_endline "Unexpected"
+    end;
+
+    Luv.Handle.close udp ignore;
+    Luv.Handle.close server ignore
+  end;
+
+  Luv.Loop.run () |> ignore
@@ -0,0 +1,28 @@
+let () =
+  Helpers.with_sender_and_receiver
+    ~port:5214
+    ~sender:begin fun sender_udp address ->
+      let datagrams = [
+        [Luv.Buffer.from_string "foo"], address;
+        [Luv.Buffer.from_string "b"; Luv.Buffer.from_string "ar"], address;
+        [Luv.Buffer.from_string "baz"], address;
+      ]
+      in
+      Luv.UDP.send_batch sender_udp datagrams @@ fun result ->
+      result |> ok "send_batch" @@ fun () ->
+      Luv.Handle.close sender_udp ignore
+    end
+    ~receiver:begin fun receiver_udp ->
+      let received = ref 0 in
+      Luv.UDP.recv_start receiver_udp begin fun result ->
+        result |> ok "recv_start" @@ fun (buffer, peer, _) ->
+        if peer <> None then begin
+          Printf.printf "%S\n" (Luv.Buffer.to_string buffer);
+          incr received;
+          if !received = 3 then begin
+            Luv.UDP.recv_stop receiver_udp |> ok "recv_stop" ignore;
+            Luv.Handle.close receiver_udp ignore
+          end
+        end
+      end
+    end
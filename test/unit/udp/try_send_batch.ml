@@ -0,0 +1,19 @@
+let () =
+  Helpers.with_sender_and_receiver
+    ~port:5215
+    ~sender:begin fun sender_udp address ->
+      let datagrams = [
+        [Luv.Buffer.from_string "foo"], address;
+        [Luv.Buffer.from_string "bar"], address;
+      ]
+      in
+      Luv.UDP.try_send_batch sender_udp datagrams
+      |> ok "try_send_batch" @@ fun sent ->
+      Printf.printf "%i\n" sent;
+      Luv.Handle.close sender_udp ignore
+    end
+    ~receiver:begin fun receiver_udp ->
+      Helpers.recv receiver_udp @@ fun () ->
+      Helpers.recv receiver_udp @@ fun () ->
+      Luv.Handle.close receiver_udp ignore
+    end
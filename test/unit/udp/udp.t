@@ -41,3 +41,33 @@
 
   $ dune exec ./handle.exe
   Ok
+
+  $ dune exec ./recv_batch.exe
+  1
+  "foo"
+  false
+  127.0.0.1
+
+  $ dune exec ./send_batch.exe
+  "foo"
+  "bar"
+  "baz"
+
+  $ dune exec ./try_send_batch.exe
+  2
+  "foo"
+  "bar"
+
+  $ dune exec ./resolver.exe
+  127.0.0.1
+  EAI_NODATA
+  10.0.0.1
+  sip.example.test 5060 10
+  other.example.test 5061 20
+  ::1
+  10.1.2.3
+  EAI_NONAME
+
+  $ dune exec ./recv_batch_mmsg.exe
+  0 1 2 3 4
+  true